@@ -10,7 +10,7 @@
 
 /* compile & link with:
  * 
- * c++ --std=c++14 -I/usr/include/libdrm upload_pbo.cpp -lX11 -lGLEW -lGLU -lGL
+ * c++ --std=c++14 -I/usr/include/libdrm upload_pbo.cpp -lX11 -lGLEW -lGLU -lGL -lEGL -pthread
  * 
  * 
  */
@@ -25,14 +25,69 @@
  * 
  * ./a.out 3            Tries to upload textures with TBOs - no luck
  * 
+ * ./a.out 6            Upload & download bandwidth : asynchronous readback with a ring of pack PBOs
+ * 
+ * ./a.out 7            Partial texture updates : upload only the tiles that changed since the previous frame
+ * 
+ * ./a.out 8            Memcpy bandwidth of 4K staging buffers & file-mapped frames : normal pages vs. huge pages
+ * 
+ * ./a.out 9            Memcpy vs. non-temporal streaming stores, into heap memory and into mapped PBO memory
+ * 
+ * ./a.out 10           Frame from file to PBOs : ifstream + memcpys vs. pread straight into mapped PBO memory
+ * 
+ * ./a.out 11           Replay many raw streams concurrently : io_uring (or reader threads) => frame pool => PBOs => textures
+ * 
+ * ./a.out 12           Frames from an external decoder process through a shared memory ring => PBO => textures
+ * 
+ * ./a.out 13           Dma-buf frames => textures : EGLImage import (no copies) vs. copy fallback
+ * 
+ * ./a.out 14 [file]    Play all frames of a y4m file (or raw 1280x720 I420 file) : file mapping => PBO => textures
+ * 
+ * ./a.out 15           Synthetic frames : generator throughput, upload of changing frames with a frame counter check
+ * 
+ * ./a.out 16           Many streams under an upload budget per frame : priorities by tile size, drop & defer counters
+ * 
+ * ./a.out 17           Frame pacing : vsync aware render loop with just in time uploads, missed vblanks & input to display latency
+ * 
+ * ./a.out 18           Many windows with one context : a window manager renders all windows & their stream tiles in one pass
+ * 
+ * ./a.out 19           GL state cache : state calls per frame of a multi-window render loop, with & without skipping no-op calls
+ * 
+ * ./a.out 20           Many tiles : a draw call per tile vs. one instanced draw with per-tile parameters in a persistent mapped uniform buffer
+ * 
+ * ./a.out 21           Small tiles of 1080p streams : full resolution vs. mipmaps vs. gpu box filter vs. cpu downscale before upload
+ * 
+ * ./a.out 22           YUV => RGB on the cpu (SIMD kernels, row threads, into a PBO) vs. the fragment shader : pick the faster at startup
+ * 
+ * ./a.out 23           10-bit yuv (P010, yuv420p10le) : R16 textures vs. cpu down-conversion to 8-bit
+ * 
+ * ./a.out 24           Packed 4:2:2 (YUYV, UYVY) : RGBA8 texture & shader unpacking vs. cpu repacking
+ * 
+ * Tests 4 & 5 take an optional file too : a y4m file or a raw 1280x720 I420 file (default 1.yuv)
+ * 
+ * ./a.out --strategy pbo --size 1920x1080 --format i420 --streams 4 --duration 5 --threads 2 --ring 3 --output csv
+ * 
+ *                      Benchmark driver : upload frames with the given parameters, print fps, MB/s and latency percentiles.  See --help
+ * 
+ * ./a.out --size 1280x720,1920x1080,3840x2160 --streams 1,4,16 --ring 1,2,3 --threads 1,4 --duration 2
+ * 
+ *                      Parameter sweep : comma separated lists run every combination, one table row per cell
+ * 
  */
 
 
 #include<GL/glew.h>
 #include<GL/glx.h>
+#include<EGL/egl.h>
+#include<EGL/eglext.h>
+#include<drm_fourcc.h>
+#include<linux/udmabuf.h>
+#include<sys/ioctl.h>
 
 #include <fcntl.h> 
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <stdlib.h>
 #include <cstdlib>
@@ -48,7 +103,10 @@
 #include <sstream>
 
 #include <vector>  
+#include <array>
+#include <memory>
 #include <algorithm>
+#include <cmath>
 #include <sys/time.h>
 #include <time.h>
 // #include <linux/time.h>
@@ -56,6 +114,8 @@
 
 #include <map>
 #include <list>
+#include <functional>
+#include <getopt.h>
 
 #include <chrono> 
 #include <thread>
@@ -67,6 +127,29 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <deque>
+
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 using namespace std::chrono_literals;
 using std::this_thread::sleep_for;
@@ -93,6 +176,226 @@ namespace glx_attr { // https://stackoverflow.com/questions/11623451/static-vs-n
 };
 
 
+/** Tracing : scoped events in Chrome's trace event format, to see where a frame's time goes across threads
+ * 
+ * Put TRACE_SCOPE("name") at the top of a block : an event from there to the end of the block is recorded into a ring buffer of
+ * the calling thread (no locks, no allocations once the thread has its ring).  The name must be a string literal : only the pointer
+ * is stored.  Nothing is recorded until Tracer::start.  Tracer::write dumps all threads into a json file for chrome://tracing or
+ * https://ui.perfetto.dev
+ * 
+ * Compile with -DNO_TRACE and the macros expand to nothing.
+ * 
+ */
+struct TraceEvent {
+  const char* name;
+  uint64_t    ts;   ///< start, ns since Tracer::start
+  uint64_t    dur;  ///< ns
+};
+
+
+class TraceBuffer { // events of one thread, the oldest overwritten when full
+  
+public:
+  TraceBuffer(std::size_t capacity); ///< capacity : a power of two
+  
+public:
+  std::vector<TraceEvent> events;
+  std::atomic<uint64_t>   count;  ///< events recorded since Tracer::start.  Only the owner thread writes
+  long                    tid;    ///< kernel thread id
+  std::string             name;   ///< see TRACE_THREAD_NAME
+  bool                    exited; ///< the thread is gone : the ring is kept for Tracer::write & freed by the next Tracer::start
+  
+public:
+  void record(const char* name, uint64_t ts, uint64_t dur) {
+    uint64_t n = count.load(std::memory_order_relaxed);
+    events[n & (events.size()-1)] = TraceEvent{name, ts, dur};
+    count.store(n+1, std::memory_order_release);
+  }
+};
+
+
+class Tracer {
+  
+public:
+  static Tracer& get(); ///< The process-wide tracer
+  
+protected:
+  Tracer();
+  
+protected:
+  std::atomic<bool>         enabled;
+  std::chrono::steady_clock::time_point t0;
+  std::size_t               capacity;  ///< events per thread
+  std::mutex                mutex;     ///< for buffers : taken once per thread & when writing
+  std::vector<std::unique_ptr<TraceBuffer>> buffers; ///< owned here, so that they outlive their threads
+  
+protected:
+  struct ThreadState { // per thread : a ring only once the thread records while tracing is on
+    const char*  name;
+    TraceBuffer* buffer;
+    ThreadState() : name(NULL), buffer(NULL) {}
+    ~ThreadState();   ///< The thread exits : marks its ring
+  };
+  static ThreadState& threadState();
+  
+public:
+  bool     isEnabled() {return enabled.load(std::memory_order_relaxed);}
+  uint64_t now() {return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count();}
+  void     start(std::size_t capacity=1<<16); ///< Forget old events & start recording.  Call while the traced threads are idle
+  void     stop();
+  TraceBuffer* threadBuffer();                ///< Ring of the calling thread, created at first use while tracing.  NULL if tracing is off
+  void     setThreadName(const char* name);     ///< Just remembered : no ring is created for it
+  uint64_t getDropped();                      ///< Events overwritten because a ring was full
+  bool     write(const char* fname);          ///< Trace event json of all threads.  Call after Tracer::stop
+};
+
+
+class TraceScope {
+  
+public:
+  TraceScope(const char* name) : name(name), on(Tracer::get().isEnabled()), ts(on ? Tracer::get().now() : 0) {}
+  ~TraceScope() {
+    if (on) {
+      Tracer&      tracer = Tracer::get();
+      TraceBuffer* buffer = tracer.threadBuffer();
+      if (buffer) {
+        buffer->record(name, ts, tracer.now()-ts);
+      }
+    }
+  }
+  
+protected:
+  const char* name;
+  bool        on;
+  uint64_t    ts;
+};
+
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef NO_TRACE
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Tracer::get().setThreadName(name)
+#endif
+
+
+/** Metrics : live counters for monitoring, in the Prometheus text format
+ * 
+ * Metrics are registered once (MetricsRegistry::counter etc., under a lock) and the returned references are kept by the
+ * upload & render code : updating one is a relaxed atomic add, never a lock.  A metric is a name & a label set, say
+ * "upload_frames_total" & "stream=\"3\"".  Registering the same pair again returns the same metric.
+ * 
+ * MetricsExporter publishes the registry from a thread of its own : rewritten to a file (for node_exporter's textfile collector)
+ * and/or served on a unix socket (say, "socat - UNIX-CONNECT:/tmp/upload.sock").
+ * 
+ */
+class MetricCounter {
+  
+public:
+  MetricCounter() : value(0) {}
+  void     add(uint64_t n=1) {value.fetch_add(n, std::memory_order_relaxed);}
+  uint64_t get()             {return value.load(std::memory_order_relaxed);}
+  
+protected:
+  std::atomic<uint64_t> value;
+};
+
+
+class MetricGauge {
+  
+public:
+  MetricGauge() : value(0) {}
+  void    set(int64_t v)     {value.store(v, std::memory_order_relaxed);}
+  void    add(int64_t n)     {value.fetch_add(n, std::memory_order_relaxed);}
+  int64_t get()              {return value.load(std::memory_order_relaxed);}
+  
+protected:
+  std::atomic<int64_t> value;
+};
+
+
+class MetricHistogram {
+  
+public:
+  MetricHistogram(const std::vector<double>& bounds); ///< bounds : upper bounds of the buckets, ascending.  +Inf is implicit
+  void observe(double v);
+  
+public:
+  std::vector<double>   bounds;
+  std::unique_ptr<std::atomic<uint64_t>[]> counts; ///< per bucket (not cumulative), the last one for +Inf
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;                        ///< in units of 1e-9 (ns for seconds), so that it's a plain atomic add
+};
+
+
+class MetricsRegistry {
+  
+public:
+  static MetricsRegistry& get(); ///< The process-wide registry
+  static const std::vector<double>& timeBuckets(); ///< seconds, 100 us .. 1 s : for fence waits, frame intervals & latencies
+  
+protected:
+  enum Type {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+  };
+  struct Metric {
+    std::string name;
+    std::string labels;  ///< 'stream="3"' or ""
+    std::string help;
+    Type        type;
+    std::unique_ptr<MetricCounter>   counter;
+    std::unique_ptr<MetricGauge>     gauge;
+    std::unique_ptr<MetricHistogram> histogram;
+  };
+  
+protected:
+  std::mutex         mutex;
+  std::list<Metric>  metrics; ///< in registration order.  A list : the references handed out stay valid
+  
+protected:
+  Metric& find(const std::string& name, const std::string& labels, const std::string& help, Type type); ///< Or register.  Call with mutex held
+  
+public:
+  MetricCounter&   counter(const std::string& name, const std::string& help, const std::string& labels="");
+  MetricGauge&     gauge(const std::string& name, const std::string& help, const std::string& labels="");
+  MetricHistogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const std::string& labels="");
+  void             write(std::ostream& out);     ///< Prometheus text exposition format
+  bool             writeFile(const char* fname); ///< Atomically : written next to fname & renamed over it
+  static std::string label(const char* key, int value); ///< 'key="value"'
+};
+
+
+class MetricsExporter {
+  
+public:
+  /** Default constructor : starts the exporter thread
+   * 
+   * @param fname     Prometheus text file, rewritten every interval.  "" = none
+   * @param socket    unix socket path : each connection gets the metrics & is closed.  "" = none
+   * @param interval  seconds
+   * 
+   */
+  MetricsExporter(const std::string& fname, const std::string& socket, double interval=1.0);
+  ~MetricsExporter(); ///< Default destructor.  Writes the file one last time
+  
+protected:
+  std::string       fname;
+  std::string       socket_path;
+  double            interval;
+  int               listen_fd;
+  std::atomic<bool> running;
+  std::thread       thread;
+  
+protected:
+  void loop();
+};
+
+
 /** A general purpose shader class.  Subclass for, say:
  * 
  * - RGB interpolation
@@ -129,6 +432,7 @@ public:
   void scale(GLfloat fx, GLfloat fy); ///< Set transformation matrix to simple scaling
   void use();       ///< Use this shader program
   void validate();  ///< Validate shader program
+  GLuint getProgram() {return program;} ///< For render loops : glUseProgram without the logging of Shader::use
   
 };
 
@@ -178,6 +482,200 @@ public:
 
 
 
+/** Semi-planar 4:2:0 (PIXFMT_NV12) : Y from an R8 texture, U & V from one RG8 texture of half the size (see packNV12) */
+class YUVNV12Shader : public Shader {
+
+public:
+  YUVNV12Shader();
+  ~YUVNV12Shader();
+  
+public: // declare GLint variable references here with "* SHADER PROGRAM VAR"
+  GLint  texy;  ///< OpenGL FRAGMENT SHADER PROGRAM VAR : Y texture
+  GLint  texuv; ///< OpenGL FRAGMENT SHADER PROGRAM VAR : interleaved UV texture
+  
+protected: // functions that return shader programs
+  const char* vertex_shader();
+  const char* fragment_shader();
+  
+public: 
+  void findVars();
+  
+};
+
+
+/** Shows an RGBA texture as is : for frames converted to rgb on the cpu (see yuvToRGBA) */
+class RGBShader : public Shader {
+
+public:
+  RGBShader();
+  ~RGBShader();
+  
+public: // declare GLint variable references here with "* SHADER PROGRAM VAR"
+  GLint  texrgb; ///< OpenGL FRAGMENT SHADER PROGRAM VAR : RGBA texture
+  
+protected: // functions that return shader programs
+  const char* vertex_shader();
+  const char* fragment_shader();
+  
+public: 
+  void findVars();
+  
+};
+
+
+/** YUV 4:2:0 with 16-bit samples (PIXFMT_P010 & PIXFMT_I420P10) from normalized R16 / RG16 textures
+ * 
+ * A 10-bit sample in a 16-bit word reads as v/65535 in the shader : "scale" (see yuv16Scale) brings it back to [0,1], and then it's the same
+ * yuv2rgb as YUVShader.  With "interleaved", U & V come from the RG texture texu (P010), otherwise from texu & texv.
+ * 
+ */
+class YUV16Shader : public Shader {
+
+public:
+  YUV16Shader();
+  ~YUV16Shader();
+  
+public: // declare GLint variable references here with "* SHADER PROGRAM VAR"
+  GLint  texy;         ///< OpenGL FRAGMENT SHADER PROGRAM VAR : Y texture
+  GLint  texu;         ///< OpenGL FRAGMENT SHADER PROGRAM VAR : U texture, or UV texture if interleaved
+  GLint  texv;         ///< OpenGL FRAGMENT SHADER PROGRAM VAR : V texture
+  GLint  scale;        ///< OpenGL FRAGMENT SHADER PROGRAM VAR : sample scaling, see yuv16Scale
+  GLint  interleaved;  ///< OpenGL FRAGMENT SHADER PROGRAM VAR : 1 = UV in texu (P010)
+  
+protected: // functions that return shader programs
+  const char* vertex_shader();
+  const char* fragment_shader();
+  
+public: 
+  void findVars();
+  
+};
+
+
+/** Packed 4:2:2 (PIXFMT_YUYV & PIXFMT_UYVY) straight from the camera buffer : no repacking on the cpu
+ * 
+ * The frame is uploaded as an RGBA8 texture of w/2 x h, one texel per pixel pair : YUYV => (Y0, U, Y1, V), UYVY => (U, Y0, V, Y1).
+ * Each fragment fetches its texel with texelFetch & picks Y0 or Y1 by the parity of its pixel column, so the texture is sampled
+ * nearest-neighbour (a bilinear fetch would blend luma with chroma).
+ * 
+ */
+class YUYVShader : public Shader {
+
+public:
+  YUYVShader();
+  ~YUYVShader();
+  
+public: // declare GLint variable references here with "* SHADER PROGRAM VAR"
+  GLint  texyuyv;      ///< OpenGL FRAGMENT SHADER PROGRAM VAR : the packed RGBA8 texture
+  GLint  uyvy;         ///< OpenGL FRAGMENT SHADER PROGRAM VAR : 1 = UYVY byte order, 0 = YUYV
+  
+protected: // functions that return shader programs
+  const char* vertex_shader();
+  const char* fragment_shader();
+  
+public: 
+  void findVars();
+  
+};
+
+
+/** Draws many yuv tiles with a single instanced draw call
+ * 
+ * Planes come from texture arrays (a layer per stream).  Per-tile transform, screen rectangle and layer, plus the colour matrix, are
+ * in a std140 uniform block "FrameParams" : the tile is picked with gl_InstanceID, so there are no per-draw uniform updates.
+ * See TileRenderer.
+ * 
+ */
+class YUVTileShader : public Shader {
+
+public:
+  YUVTileShader();
+  ~YUVTileShader();
+  
+public: // declare GLint variable references here with "* SHADER PROGRAM VAR"
+  GLint  texy;   ///< OpenGL FRAGMENT SHADER PROGRAM VAR : Y texture array
+  GLint  texu;   ///< OpenGL FRAGMENT SHADER PROGRAM VAR : U texture array
+  GLint  texv;   ///< OpenGL FRAGMENT SHADER PROGRAM VAR : V texture array
+  GLuint params; ///< OpenGL SHADER PROGRAM UNIFORM BLOCK : FrameParams
+  
+  static const int max_tiles = 128; ///< fits in the minimum GL_MAX_UNIFORM_BLOCK_SIZE (16 kB).  Keep in sync with the shader
+  
+protected: // functions that return shader programs
+  const char* vertex_shader();
+  const char* fragment_shader();
+  
+public: 
+  void findVars();
+  
+};
+
+
+/** Call counters of a GLStateCache */
+struct GLStateStats {
+  uint64_t calls;    ///< state calls asked for
+  uint64_t skipped;  ///< of which were no-ops, not passed to the driver
+};
+
+
+/** Tracks GL binding & uniform state and skips calls that wouldn't change anything
+ * 
+ * Covers the program, VAO, active texture unit, 2D texture per unit, buffer bindings per target, viewport and int & mat4 uniforms
+ * per program.  All calls that touch this state must go through the cache : after raw GL calls, or after deleting objects whose names
+ * may be reused, call GLStateCache::invalidate.
+ * 
+ * With setEnabled(false), every call is passed through but still counted : compare the counters to see how many calls are saved.
+ * 
+ */
+class GLStateCache {
+  
+public:
+  GLStateCache();  ///< Default constructor.  Everything unknown
+  ~GLStateCache(); ///< Default destructor
+  
+protected:
+  static const int max_units = 32;
+  static const GLuint unknown = GLuint(-1);
+  
+protected:
+  bool    enabled;
+  GLuint  program;
+  GLuint  vao;
+  GLenum  active_unit;  ///< GL_TEXTURE0 + i, or 0 : unknown
+  std::array<GLuint, max_units>          textures; ///< GL_TEXTURE_2D binding per unit
+  std::array<GLint, 4>                   view;     ///< viewport
+  std::map<GLenum, GLuint>               buffers;  ///< target => buffer
+  std::map<std::pair<GLuint, GLint>, GLint> uniforms_i;                   ///< (program, location) => value
+  std::map<std::pair<GLuint, GLint>, std::array<GLfloat,16>> uniforms_m4; ///< (program, location) => value
+  GLStateStats stats;
+  
+protected:
+  bool skip(bool same) { // count & decide
+    stats.calls++;
+    if (same && enabled) {
+      stats.skipped++;
+      return true;
+    }
+    return false;
+  }
+  
+public:
+  void invalidate();                        ///< Forget everything : the next calls go to the driver
+  void setEnabled(bool enabled)             {this->enabled=enabled; invalidate();}
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  void activeTexture(GLenum unit);
+  void bindTexture(GLenum target, GLuint texture);  ///< Only GL_TEXTURE_2D is cached
+  void bindTextureUnit(int unit, GLuint texture);   ///< activeTexture + bindTexture(GL_TEXTURE_2D, ..)
+  void bindBuffer(GLenum target, GLuint buffer);
+  void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+  void uniform1i(GLint location, GLint value);       ///< For the current program
+  void uniformMatrix4fv(GLint location, const GLfloat* value); ///< For the current program.  Not transposed
+  GLStateStats getStats()                   {return stats;}
+  void resetStats()                         {stats = GLStateStats{0, 0};}
+  void printStats(uint64_t frames=1);       ///< Calls & skipped calls, per frame
+};
+
+
 class OpenGLContext {
   
 public:
@@ -206,726 +704,7471 @@ protected: // opengl vaos etc.
 public:
   void makeCurrent(Window window_id);
   void loadExtensions();
+  Display* getDisplay() {return display_id;}
   Window createWindow();
   void reserve(Shader *shader);
   void renderYUVShader(Window window_id, YUVShader* shader, GLuint y_index, GLuint u_index, GLuint v_index);
   void renderYUVBlockShader(Window window_id, YUVBlockShader* shader, GLuint tex_index);
+  /** Draw yuv textures into a viewport of the current window, keeping the aspect ratio of the image.  No swap, no clear, no logging : for render loops
+   * 
+   * @param x, y, w, h          viewport in window pixels
+   * @param img_w, img_h        image dimensions
+   * 
+   */
+  void drawYUVShader(YUVShader* shader, GLuint y_index, GLuint u_index, GLuint v_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h);
+  void drawYUVNV12Shader(YUVNV12Shader* shader, GLuint y_index, GLuint uv_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h); ///< Same for NV12 : R8 luma & RG8 chroma
+  void drawRGBShader(RGBShader* shader, GLuint rgb_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h); ///< Same for an RGBA texture
+  void drawYUYVShader(YUYVShader* shader, bool uyvy, GLuint yuyv_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h); ///< Same for a packed 4:2:2 texture (UYVY byte order if uyvy)
+  void drawYUV16Shader(YUV16Shader* shader, GLfloat scale, bool interleaved, GLuint y_index, GLuint u_index, GLuint v_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h); ///< Same for 16-bit planes (scale from yuv16Scale) : v_index is ignored if interleaved (P010)
+  GLXContext getContext() {return glc;}
+  GLuint     getVAO()     {return VAO;} ///< The quad set up by OpenGLContext::reserve
+  GLStateCache& getState() {return state;} ///< Binding & uniform state of this context, for render loops
+  
+protected:
+  GLStateCache  state;
+  
+protected:
+  void drawQuad(GLint transform_location, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h); ///< Letterbox the quad of the current program for the draw* methods & draw it
 };
 
 
-// helper functions
-uint readbytes(const char* fname, uint8_t*& buffer) {
-  uint      size;
-  std::ifstream file;
+/** A ring of pixel pack buffer objects (PBOs) for asynchronous readback
+ * 
+ * PackPBORing::read issues glReadPixels into the next GL_PIXEL_PACK_BUFFER of the ring and puts a fence after it.
+ * The call returns immediately: the GPU => PBO transfer happens in the background.
+ * 
+ * A few frames later, PackPBORing::map returns a pointer to the oldest readback, once its fence has been signaled.
+ * When done with the data (say, it has been passed to an encoder), call PackPBORing::unmap to recycle the PBO.
+ * 
+ */
+class PackPBORing {
   
-  file.open(fname,std::ios::in|std::ios::binary|std::ios::ate);
-  size = file.tellg();
-
-  file.seekg(0,std::ios::beg);
-  file.read((char*)buffer,size);
-  file.close();
+public:
+  /** Default constructor
+   * 
+   * @param w       width of the frame to be read
+   * @param h       height of the frame to be read
+   * @param format  pixel format, i.e. GL_RGBA, GL_BGRA, GL_RED
+   * @param type    data type, i.e. GL_UNSIGNED_BYTE
+   * @param bpp     bytes per pixel
+   * @param depth   number of PBOs in the ring, i.e. how many frames later the results are available
+   * 
+   */
+  PackPBORing(GLsizei w, GLsizei h, GLenum format, GLenum type, GLsizei bpp, int depth=3);
+  ~PackPBORing(); ///< Default destructor
   
-  printf("read %i bytes\n",size);
+protected:
+  GLsizei w, h, size;
+  GLenum  format, type;
+  std::vector<GLuint> pbos;   ///< ids of the pack PBOs
+  std::vector<GLsync> fences; ///< one fence per PBO : signaled when glReadPixels into that PBO has completed
+  int     head;     ///< next PBO to be written by glReadPixels
+  int     tail;     ///< oldest PBO with a pending readback
+  int     pending;  ///< number of readbacks in flight
+  bool    mapped;   ///< is the PBO at tail mapped?
   
-  return size;
+public:
+  bool     read(GLint x=0, GLint y=0); ///< Start an asynchronous readback from the current read framebuffer.  Returns false if the ring is full
+  GLubyte* map(bool wait=false);       ///< Map the oldest readback.  Returns NULL if it is not ready yet (and wait=false)
+  void     unmap();                    ///< Release the mapping and recycle the PBO
+  int      getPending() {return pending;}
+  GLsizei  getSize()    {return size;}
+};
+
+
+/** Pixel formats of the frames we move around */
+enum PixelFormat {
+  PIXFMT_I420,  ///< planar 4:2:0 : Y, U, V planes
+  PIXFMT_NV12,  ///< semi-planar 4:2:0 : Y plane, interleaved UV plane
+  PIXFMT_BGRA,  ///< packed 8-bit BGRA
+  PIXFMT_P010,  ///< semi-planar 4:2:0, 16 bits per sample with the 10 significant bits at the top : Y plane, interleaved UV plane
+  PIXFMT_I420P10, ///< planar 4:2:0, 16-bit little endian samples with 10 significant bits at the bottom (ffmpeg's yuv420p10le)
+  PIXFMT_YUYV,  ///< packed 4:2:2 : Y0 U Y1 V per pixel pair (YUY2, v4l2 cameras)
+  PIXFMT_UYVY   ///< packed 4:2:2 : U Y0 V Y1 per pixel pair
+};
+
+const char* pixelFormatName(PixelFormat format) {
+  switch (format) {
+    case(PIXFMT_I420):
+      return "i420";
+    case(PIXFMT_NV12):
+      return "nv12";
+    case(PIXFMT_BGRA):
+      return "bgra";
+    case(PIXFMT_P010):
+      return "p010";
+    case(PIXFMT_I420P10):
+      return "yuv420p10le";
+    case(PIXFMT_YUYV):
+      return "yuyv";
+    case(PIXFMT_UYVY):
+      return "uyvy";
+    default:
+      return "unknown";
+  }
 }
 
+std::size_t frameSize(PixelFormat format, GLsizei w, GLsizei h) { // bytes per frame, no padding
+  switch (format) {
+    case(PIXFMT_I420):
+    case(PIXFMT_NV12):
+      return (std::size_t(w)*h*3)/2;
+    case(PIXFMT_BGRA):
+      return std::size_t(w)*h*4;
+    case(PIXFMT_P010):
+    case(PIXFMT_I420P10):
+      return std::size_t(w)*h*3;
+    case(PIXFMT_YUYV):
+    case(PIXFMT_UYVY):
+      return std::size_t(w)*h*2;
+    default:
+      return 0;
+  }
+}
 
-void getPBO(GLuint& index, GLsizei size, GLubyte*& payload) { // modify pointer in-place
-  glGenBuffers(1, &index);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, index);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW); // reserve n_payload bytes to index/handle pbo_id
-  
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind (not mandatory)
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, index); // rebind (not mandatory)
-  
-  payload = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-  
-  std::cout << "getPBO : " << index << " " << (unsigned long)payload << std::endl;
-  
-  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer ** MANDATORY **
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind ** MANDATORY **
+GLfloat yuv16Scale(PixelFormat format) { // scales a normalized 16-bit texture sample back to [0,1] for YUV16Shader
+  switch (format) {
+    case(PIXFMT_P010):
+      return 65535.0f/65472.0f;  // v<<6 : 1023<<6 = 65472 is the top
+    case(PIXFMT_I420P10):
+      return 65535.0f/1023.0f;
+    default:
+      return 1.0f;
+  }
 }
 
 
 
-Shader::Shader() {
-  /*
-  compile(); // woops.. at constructor time, overwritten virtual methods are NOT called
-  use();
-  findVars();
-  */
-}
+/** How staging memory is backed
+ * 
+ * A 4K RGBA frame is 33 MB : with 4 KB pages, a linear memcpy over it walks through thousands of TLB entries.
+ * With 2 MB pages it's a couple of dozen.
+ */
+enum PageMode {
+  PAGES_DEFAULT,   ///< normal pages
+  PAGES_THP,       ///< transparent huge pages : 2 MB aligned anonymous mapping + madvise(MADV_HUGEPAGE)
+  PAGES_HUGETLB    ///< explicit huge pages from the hugetlbfs pool (MAP_HUGETLB) .. needs vm.nr_hugepages > 0
+};
 
-Shader::~Shader() {
-  glDeleteProgram(this->program);
+static const std::size_t huge_page_size = 2*1024*1024;
+
+const char* pageModeName(PageMode mode) {
+  switch (mode) {
+    case(PAGES_THP):
+      return "thp";
+    case(PAGES_HUGETLB):
+      return "hugetlb";
+    default:
+      return "default";
+  }
 }
 
 
-void Shader::compile() {
-  GLuint id_vertex_shader, id_fragment_shader;
-  const char *source;
-  int length, cc;
-  GLint success;
-  GLchar infoLog[512];
+/** Recycling counters of a FramePool */
+struct FramePoolStats {
+  uint64_t allocs;    ///< buffers taken from the heap
+  uint64_t reuses;    ///< buffers served from a free list
+  uint64_t releases;  ///< buffers returned to the pool
+  uint64_t bytes_reserved; ///< total bytes held by the pool (in use + free)
+  uint64_t bytes_in_use;   ///< bytes handed out and not yet released
+};
+
+
+/** A pool of aligned cpu-side frame buffers, recycled by size class
+ * 
+ * FramePool::get returns a buffer of at least the requested size.  Requests are rounded up to a size class (powers of two for small buffers,
+ * quarter-octave steps for large ones) and served from the free list of that class if possible.  FramePool::release puts the buffer back
+ * to its free list : nothing is returned to the heap before FramePool::trim or the destructor, so that a streaming loop that keeps
+ * asking for frames of the same size does not fragment the heap.
+ * 
+ * Thread safe.
+ * 
+ */
+class FramePool {
   
-  std::cout << "Shader: compile: " <<std::endl;
-  std::cout << "Shader: compile: vertex program=" << std::endl << vertex_shader() << std::endl;
-  std::cout << "Shader: compile: fragment program=" << std::endl << fragment_shader() << std::endl;
+public:
+  /** Default constructor
+   * 
+   * @param alignment  alignment of the buffers.  Use 64 for cache lines or sysconf(_SC_PAGESIZE) for pages
+   * @param mode       back the buffers with huge pages.  Buffers are then 2 MB aligned, regardless of alignment
+   * 
+   */
+  FramePool(std::size_t alignment=64, PageMode mode=PAGES_DEFAULT);
+  ~FramePool(); ///< Default destructor.  Frees all buffers, including the ones still in use
   
-  // create and compiler vertex shader
-  source=vertex_shader();
-  id_vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  length = std::strlen(source);
-  glShaderSource(id_vertex_shader, 1, &source, &length); 
-  glCompileShader(id_vertex_shader);
-  glGetShaderiv(id_vertex_shader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    glGetShaderInfoLog(id_vertex_shader, 512, NULL, infoLog);
-    std::cout << "Shader: compile: vertex shader program (len="<<length<<") COMPILATION FAILED!" << std::endl << infoLog << std::endl;
-  }
+protected:
+  std::size_t alignment;
+  PageMode    mode;
+  std::mutex  mutex;
+  std::map<std::size_t, std::vector<GLubyte*>> free_buffers; ///< size class => free buffers of that class
+  std::map<GLubyte*, std::size_t>              used_buffers; ///< buffer => its size class
+  FramePoolStats stats;
+  
+protected:
+  GLubyte* allocate(std::size_t size);   ///< Get memory from the system
+  void     deallocate(GLubyte* buffer, std::size_t size); ///< Return memory to the system.  size : as passed to allocate, unmapping needs it
+  
+public:
+  static std::size_t sizeClass(std::size_t size); ///< Round size up to its size class
+  GLubyte* get(std::size_t size);   ///< Get a buffer of at least size bytes
+  void     release(GLubyte* buffer);///< Give a buffer back to the pool
+  void     trim();                  ///< Return all free buffers to the system
+  FramePoolStats getStats();        ///< Recycling counters for monitoring
+  void     printStats();
+};
 
-  // create and compiler fragment shader
-  source=fragment_shader();
-  id_fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  length = std::strlen(source);
-  glShaderSource(id_fragment_shader, 1, &source, &length);   
-  glCompileShader(id_fragment_shader);
-  glGetShaderiv(id_fragment_shader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    glGetShaderInfoLog(id_fragment_shader, 512, NULL, infoLog);
-    std::cout << "Shader: compile: fragment shader program (len="<<length<<") COMPILATION FAILED!" << std::endl << infoLog << std::endl;
-  }
 
-  // Shader Program
-  this->program = glCreateProgram();
-  std::cout << "Shader: compile: program index=" << this->program << "\n";
+/** A minimal io_uring wrapper, talking to the kernel with raw syscalls (no liburing)
+ * 
+ * Just what we need for reads : queue reads into the submission ring, submit and wait with a single io_uring_enter, pop completions.
+ * IoUring::ok is false if io_uring is not available (old kernel, seccomp, not compiled in) : the caller should fall back to threads.
+ * 
+ */
+class IoUring {
   
-  glAttachShader(this->program, id_vertex_shader);
-  glAttachShader(this->program, id_fragment_shader);
-  glLinkProgram(this->program);
-  // Print linking errors if any
-  glGetProgramiv(this->program, GL_LINK_STATUS, &success);
-  if (!success)
-  {
-    glGetProgramInfoLog(this->program, 512, NULL, infoLog);
-    std::cout << "Shader: compile: fragment shader LINKING FAILED!" << std::endl << infoLog << std::endl;
-  }
-  // Delete the shaders as they're linked into our program now and no longer necessery
-  glDeleteShader(id_vertex_shader);
-  glDeleteShader(id_fragment_shader);
-}
+public:
+  IoUring(unsigned entries); ///< Default constructor.  entries : size of the submission ring
+  ~IoUring();                ///< Default destructor
+  
+protected:
+  int       ring_fd;
+  unsigned  sq_entries;
+  unsigned  to_submit;     ///< queued but not yet submitted
+  void      *sq_ptr, *cq_ptr;
+  std::size_t sq_size, cq_size;
+  unsigned  *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned  *cq_head, *cq_tail, *cq_mask;
+#ifdef HAVE_IO_URING
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+#endif
+  
+public:
+  bool ok() {return ring_fd>=0;}
+  bool registerBuffers(const std::vector<struct iovec>& iovecs); ///< Register buffers for IORING_OP_READ_FIXED
+  bool prepRead(int fd, GLubyte* buffer, unsigned len, off_t offset, uint64_t user_data, int buf_index=-1); ///< Queue a read.  buf_index>=0 : registered buffer
+  int  submit(unsigned wait_nr); ///< Submit queued reads, wait for at least wait_nr completions.  Returns the number submitted, or -errno
+  bool peek(uint64_t& user_data, int& res); ///< Pop a completion, if any
+};
 
 
-void Shader::findVars() {
-  position=0; // this is hard-coded into the shader code (see "location=0")
-  texcoord=1; // this is hard-coded into the shader code (see "location=1")
-  
-  transform=glGetUniformLocation(program,"transform");
-  std::cout << "Shader: findVars: Location of the transform matrix: " << transform << std::endl;
-}
+/** A frame read by FrameIngest, sitting in a FramePool buffer */
+struct IngestFrame {
+  int         stream;  ///< stream (file) index
+  uint64_t    index;   ///< frame number within the stream
+  int         slot;    ///< internal : FrameIngest buffer slot
+  GLubyte*    data;
+  std::size_t size;
+};
 
 
-void Shader::scale(GLfloat fx, GLfloat fy) {
-  GLfloat mat[4][4] = {
-    {fx,               0.0f,             0.0f,   0.0f}, 
-    {0.0f,             fy,               0.0f,   0.0f},
-    {0.0f,             0.0f,             1.0f,   0.0f},
-    {0.0f,             0.0f,             0.0f,   1.0f}
+/** Replays many raw frame files concurrently
+ * 
+ * A fixed number of frame buffers (slots) is taken from a FramePool.  The ingest engine keeps reads outstanding into all free slots,
+ * round-robin over the streams, and completed frames are queued for the upload thread, that gets them with FrameIngest::pop and gives
+ * them back with FrameIngest::release.  So the number of slots is the queue depth : reads in flight + frames waiting for upload.
+ * 
+ * Uses io_uring (with the slots registered as fixed buffers, if allowed) where available.  Otherwise, a pool of reader threads does
+ * blocking preads.
+ * 
+ */
+class FrameIngest {
+  
+public:
+  /** Default constructor
+   * 
+   * @param pool       where the frame buffers come from
+   * @param framesize  bytes per frame.  The files are headerless : frame i is at offset i*framesize
+   * @param nslots     queue depth
+   * @param use_uring  try io_uring first
+   * @param nthreads   number of reader threads, if io_uring is not used
+   * 
+   */
+  FrameIngest(FramePool* pool, std::size_t framesize, int nslots=32, bool use_uring=true, int nthreads=4);
+  ~FrameIngest(); ///< Default destructor.  Stops the engine
+  
+protected:
+  struct Stream {
+    int       fd;
+    uint64_t  nframes;
+    uint64_t  next;  ///< next frame to read.  Wraps around at the end of the file
+    bool      failed;///< a read failed (error, or eof : the file shrank) : retired, no more reads from it
   };
-  glUniformMatrix4fv(transform, 1, GL_FALSE, mat[0]);
-}
+  
+protected:
+  FramePool*   pool;
+  std::size_t  framesize;
+  int          nthreads;
+  IoUring*     ring;
+  bool         fixed;    ///< slots registered with io_uring
+  bool         running;
+  int          next_stream;
+  std::vector<Stream>      streams;
+  std::vector<GLubyte*>    slots;
+  std::vector<IngestFrame> in_flight;  ///< by slot
+  std::vector<int>         free_slots;
+  std::deque<IngestFrame>  ready;
+  std::vector<std::thread> threads;
+  std::mutex               mutex;
+  std::condition_variable  cond;
+  
+public: // counters
+  uint64_t     nread;    ///< frames read
+  uint64_t     nfailed;  ///< failed or short reads
+  int          nretired; ///< streams given up on after read errors
+  
+protected:
+  void nextRead(int slot); ///< Assign the current stream & frame to a free slot.  Call with the mutex locked
+  void advanceRead();      ///< Move on to the next stream & frame, once the read is queued.  Call with the mutex locked
+  bool skipFailed();       ///< Move on to a stream that isn't retired.  false if none is left.  Call with the mutex locked
+  void retire(int stream); ///< Stop reading from a stream after a read error.  Call with the mutex locked
+  bool probeRead();        ///< Check the ring can actually read : IORING_OP_READ is missing before linux 5.6
+  void uringLoop();
+  void threadLoop();
+  
+public:
+  int  addStream(const char* fname);  ///< Add a raw file before FrameIngest::start.  Returns the stream index, -1 if not usable
+  void start();
+  void stop();
+  bool pop(IngestFrame& frame, int timeout_ms=100); ///< Get the next read frame.  false on timeout
+  void release(const IngestFrame& frame);           ///< Give the frame buffer back for the next read
+  const char* backend() {return ring ? (fixed ? "io_uring (fixed buffers)" : "io_uring") : "threads";}
+};
 
 
-void Shader::use() {
-  std::cout << "Shader: use: using program index=" << this->program << std::endl;
-  glUseProgram(this->program);
-}
+/** Per-frame metadata in a ShmFrameRing slot */
+struct ShmFrameInfo {
+  uint64_t  seq;     ///< frame sequence number, set by the ring
+  int64_t   pts;     ///< presentation timestamp in ns (CLOCK_MONOTONIC, if the producer is live)
+  uint32_t  format;  ///< PixelFormat
+  uint32_t  width;
+  uint32_t  height;
+  uint32_t  stride;  ///< bytes per luma line
+  uint32_t  size;    ///< payload bytes
+};
 
 
-void Shader::validate() {
-  GLint params, maxLength;
-  //The maxLength includes the NULL character
-  // std::vector<GLchar> infoLog(maxLength);
-  
-  std::cout << std::endl << "Shader: validating program index=" << program << std::endl;
-  std::cout              << "Shader: is program              =" << bool(glIsProgram(program)) << std::endl;
-  glValidateProgram(program);
-  glGetProgramiv(program,GL_VALIDATE_STATUS,&params);
-  std::cout              << "Shader: validate status         =" << params << std::endl;
-  glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);  
-  char infoLog[maxLength];
+/** Header at the start of a ShmFrameRing shared memory region
+ * 
+ * The two sequence counters are futex words : the producer waits on read_seq when the ring is full,
+ * the consumer waits on write_seq when it's empty.
+ */
+struct ShmRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nslots;
+  uint32_t slotsize;   ///< payload capacity of a slot
+  std::atomic<uint32_t> write_seq; ///< frames published by the producer
+  std::atomic<uint32_t> read_seq;  ///< frames consumed
+  std::atomic<uint32_t> closed;    ///< producer is gone
+};
 
-  glGetProgramInfoLog(program, maxLength, &maxLength, &infoLog[0]);
-  std::cout              << "Shader: infoLog length          =" << maxLength << std::endl;
-  std::cout              << "Shader: infoLog                 =" << std::string(infoLog) << std::endl;
-  std::cout << std::endl;
-  
-}
 
+enum ShmReadStatus {
+  SHM_READ_OK,       ///< a frame
+  SHM_READ_TIMEOUT,  ///< no frame yet : the producer is slow, try again
+  SHM_READ_CLOSED,   ///< the producer has closed the ring and all frames have been read
+  SHM_READ_REJECTED  ///< the producer published a bad frame (say, size larger than the slot) : it has been skipped
+};
 
-YUVShader::YUVShader() : Shader() {
-  compile();
-  use();
-  findVars();
-}
 
-YUVShader::~YUVShader() {
-}
+/** A single-producer, single-consumer frame ring in POSIX shared memory
+ * 
+ * For decoders running in separate processes.  The region is laid out as [ShmRingHeader][slot 0]...[slot n-1],
+ * each slot being [ShmFrameInfo][payload], page aligned.
+ * 
+ * The producer (decoder) calls ShmFrameRing::beginWrite, decodes into the returned memory and publishes with ShmFrameRing::commitWrite.
+ * The consumer calls ShmFrameRing::beginRead, copies the payload straight into a mapped PBO (a single copy from the decoder's output
+ * to gpu staging) and frees the slot with ShmFrameRing::endRead.  Signalling is done with futexes on the sequence counters.
+ * 
+ * With name=NULL, the region is an anonymous memfd : it's shared with child processes forked after construction.
+ * 
+ */
+class ShmFrameRing {
+  
+public:
+  /** Default constructor
+   * 
+   * @param name      shm_open name, say "/upload_pbo".  NULL : anonymous memfd
+   * @param create    create the region (consumer side) or attach to an existing one (producer side)
+   * @param nslots    number of frames in the ring (create=true only)
+   * @param slotsize  max payload bytes per frame (create=true only)
+   * 
+   */
+  ShmFrameRing(const char* name, bool create, uint32_t nslots=4, uint32_t slotsize=0);
+  ~ShmFrameRing(); ///< Default destructor.  Unlinks the name if we created it
+  
+protected:
+  std::string    name;
+  bool           owner;
+  int            fd;
+  std::size_t    mapsize;
+  std::size_t    slotstride;  ///< bytes between slots
+  GLubyte*       region;
+  ShmRingHeader* header;
+  
+protected:
+  ShmFrameInfo* slotInfo(uint32_t seq) {return (ShmFrameInfo*)(region + slotstride*(1 + seq % header->nslots));}
+  GLubyte*      slotData(uint32_t seq) {return (GLubyte*)slotInfo(seq) + sizeof(ShmFrameInfo);}
+  
+public:
+  bool      ok() {return header!=NULL;}
+  uint32_t  getSlotSize() {return header->slotsize;}
+  GLubyte*  beginWrite(int timeout_ms=1000);          ///< Producer : get the next free slot.  NULL on timeout
+  void      commitWrite(const ShmFrameInfo& info);    ///< Producer : publish the slot
+  void      close();                                  ///< Producer : no more frames
+  /** Consumer : get the next frame
+   * 
+   * The other process is not trusted : a frame with info.size beyond the slot or beyond max_size is given back & reported as
+   * SHM_READ_REJECTED, so that a faulty producer can't make the caller copy past its buffers.
+   * 
+   * @param info        frame description, copied out of shared memory
+   * @param data        the payload (SHM_READ_OK only)
+   * @param timeout_ms  wait at most this long for a frame
+   * @param max_size    the largest payload the caller can take.  0 = the slot size
+   * 
+   */
+  ShmReadStatus beginRead(ShmFrameInfo& info, GLubyte*& data, int timeout_ms=1000, std::size_t max_size=0);
+  void      endRead();                                ///< Consumer : give the slot back to the producer
+};
 
 
-void YUVShader::findVars() {
-  position=0; // this is hard-coded into the shader code (see "location=0")
-  texcoord=1; // this is hard-coded into the shader code (see "location=1")
-  
-  std::cout << "YUVShader: findVars: Location of position: " << position << std::endl;
-  std::cout << "YUVShader: findVars: Location of texcoord: " << texcoord << std::endl;
+typedef void (*EGLImageTargetTexture2DOESProc)(GLenum target, void* image); ///< glEGLImageTargetTexture2DOES
+
+
+/** Imports dma-buf frames as textures, without cpu copies
+ * 
+ * Each plane of the dma-buf is wrapped into an EGLImage (EGL_EXT_image_dma_buf_import) as a single or two channel image
+ * (DRM_FORMAT_R8 / DRM_FORMAT_GR88) and bound to a GL_TEXTURE_2D with glEGLImageTargetTexture2DOES.  So an I420 frame becomes the same
+ * three GL_RED textures YUVShader samples.
+ * 
+ * EGLImages need an EGL context : the importer creates its own on the X display, with a pbuffer surface.
+ * 
+ * If the import fails (no extension, driver can't import that buffer), the frame is mmap'ed and uploaded with glTexSubImage2D instead.
+ * 
+ */
+class DmaBufImporter {
   
-  transform=glGetUniformLocation(program,"transform");
-  std::cout << "YUVShader: findVars: Location of the transform matrix: " << transform << std::endl;
+public:
+  DmaBufImporter(Display* display_id); ///< Default constructor.  Creates an EGL context and makes it current
+  ~DmaBufImporter();                   ///< Default destructor
   
-  texy=glGetUniformLocation(program,"texy");
-  std::cout << "YUVShader: findVars: Location of texy: " << texy << std::endl;
+protected:
+  EGLDisplay  egl_display;
+  EGLContext  egl_context;
+  EGLSurface  egl_surface;
+  bool        can_import;   ///< EGL_EXT_image_dma_buf_import present
+  PFNEGLCREATEIMAGEKHRPROC       eglCreateImageKHR;
+  PFNEGLDESTROYIMAGEKHRPROC      eglDestroyImageKHR;
+  EGLImageTargetTexture2DOESProc glEGLImageTargetTexture2DOES;
+  std::vector<EGLImageKHR>       images; ///< images of the last imported frame
   
-  texu=glGetUniformLocation(program,"texu");
-  std::cout << "YUVShader: findVars: Location of texu: " << texu << std::endl;
+protected:
+  bool importPlane(int fd, uint32_t fourcc, GLsizei w, GLsizei h, GLsizei offset, GLsizei stride, GLuint tex); ///< Zero-copy path for one plane
+  void copyPlane(const GLubyte* data, GLenum format, GLsizei w, GLsizei h, GLsizei stride, GLsizei bpp, GLuint tex);   ///< Fallback path for one plane
   
-  texv=glGetUniformLocation(program,"texv");
-  std::cout << "YUVShader: findVars: Location of texv: " << texv << std::endl;
-}
+public:
+  bool ok()        {return egl_context!=EGL_NO_CONTEXT;}
+  bool canImport() {return can_import;}
+  void makeCurrent();
+  /** Bind a dma-buf frame to textures
+   * 
+   * @param fd       dma-buf file descriptor
+   * @param format   PIXFMT_I420 (3 planes), PIXFMT_NV12 (2 planes) or PIXFMT_BGRA (1 plane)
+   * @param offsets  byte offset of each plane in the buffer
+   * @param strides  bytes per line of each plane
+   * @param texs     a texture for each plane
+   * @param copy     force the copy path
+   * 
+   * Returns true if the frame was imported without copies, false if it was copied.
+   */
+  bool importFrame(int fd, PixelFormat format, GLsizei w, GLsizei h, const GLsizei* offsets, const GLsizei* strides, const GLuint* texs, bool copy=false);
+  void releaseFrame(); ///< Destroy the EGLImages of the last frame
+};
 
 
+/** A frame of a Y4MReader, pointing into the file mapping (no copies) */
+struct Y4MFrame {
+  GLubyte*    data;    ///< all planes, one after another
+  std::size_t size;
+  std::string params;  ///< per-frame parameters from the FRAME header (say, "Ib"), if any
+};
 
-/*** YUV Shader Program ***/
 
-const char* YUVShader::vertex_shader () { return 
-// shader vertex source code
-// We swap the y-axis by substracing our coordinates from 1.
-// This is done because most images have the top y-axis
-// inversed with OpenGL's top y-axis.
-// TexCoord = texcoord;
-"#version 300 es\n"
-"precision mediump float;\n"
-// "in vec2 scaling;\n"
-"uniform mat4 transform;\n"
-"layout (location = 0) in vec3 position;\n"
-"layout (location = 1) in vec2 texcoord;\n"
-"out vec2 TexCoord;\n"
-"void main()\n"
-"{\n"
-// "  gl_Position = vec4(position, 1.0f) * vec4(scaling,1.0f,1.0f);\n"
-"  gl_Position = transform * vec4(position, 1.0f);\n"
-"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
-"}\n";
-}
+/** Reads YUV4MPEG2 (.y4m) files
+ * 
+ * The file is mapped into memory (see mapFile) and indexed once : frames are handed out as pointers into the mapping, without copies.
+ * Width, height, framerate, interlacing, pixel aspect and colourspace (chroma subsampling & bit depth) come from the stream header.
+ * 
+ * Headerless raw I420 files (like 1.yuv) are read too, if their dimensions are given.
+ * 
+ */
+class Y4MReader {
+  
+public:
+  /** Default constructor
+   * 
+   * @param fname  file name
+   * @param raw_w  width of a headerless I420 file.  Ignored for y4m files
+   * @param raw_h  height of a headerless I420 file.  Ignored for y4m files
+   * @param mode   page mode for the mapping
+   * 
+   */
+  Y4MReader(const char* fname, GLsizei raw_w=0, GLsizei raw_h=0, PageMode mode=PAGES_DEFAULT);
+  ~Y4MReader(); ///< Default destructor
+  
+protected:
+  GLubyte*    map;
+  std::size_t mapsize;
+  PageMode    mode;
+  bool        y4m;          ///< has a YUV4MPEG2 header
+  GLsizei     width, height;
+  int         fps_num, fps_den;
+  int         aspect_num, aspect_den;
+  char        interlacing;  ///< p (progressive), t (top field first), b (bottom field first), m (mixed)
+  std::string colourspace;  ///< 420jpeg, 420paldv, 420mpeg2, 422, 444, mono ..
+  int         bitdepth;     ///< 8, or say 10 for C420p10
+  std::size_t framesize;
+  std::vector<std::size_t> offsets; ///< offset of each frame's data
+  std::vector<std::string> params;  ///< per-frame parameters
+  
+protected:
+  bool parseHeader(std::size_t& pos);
+  
+public:
+  bool        ok()            {return !offsets.empty();}
+  bool        isY4M()         {return y4m;}
+  GLsizei     getWidth()      {return width;}
+  GLsizei     getHeight()     {return height;}
+  double      getFps()        {return fps_den>0 ? double(fps_num)/fps_den : 0;}
+  char        getInterlacing(){return interlacing;}
+  std::string getColourspace(){return colourspace;}
+  int         getBitDepth()   {return bitdepth;}
+  std::size_t getFrameSize()  {return framesize;}
+  int         getFrameCount() {return offsets.size();}
+  bool        isI420()        {return bitdepth==8 && colourspace.compare(0,3,"420")==0 && width%2==0 && height%2==0;} ///< the layout of planeLayout(PIXFMT_I420) : odd sizes have bigger chroma planes
+  Y4MFrame    frame(int i);   ///< Frame i, zero-copy
+  void        print();
+};
 
-const char* YUVShader::fragment_shader  () { return
-"#version 300 es\n"
-"precision mediump float;\n"
-"in vec3 ourColor;\n"
-"in vec2 TexCoord;\n"
-"uniform sampler2D texy; // Y \n"
-"uniform sampler2D texu; // U \n"
-"uniform sampler2D texv; // V \n"
-"out vec4 colour;\n"
-" // \n"
-"vec3 yuv2rgb(in vec3 yuv) \n"
-"{ \n"
-"    // YUV offset  \n"
-"    // const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"
-"    const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"  
-"    // RGB coefficients \n"
-"    const vec3 Rcoeff = vec3( 1.164, 0.000,  1.596); \n"
-"    const vec3 Gcoeff = vec3( 1.164, -0.391, -0.813); \n"
-"    const vec3 Bcoeff = vec3( 1.164, 2.018,  0.000); \n"  
-"    vec3 rgb; \n"
-"    yuv = clamp(yuv, 0.0, 1.0); \n"
-"    yuv += offset; \n"
-"    rgb.r = dot(yuv, Rcoeff);  \n"
-"    rgb.g = dot(yuv, Gcoeff); \n"  
-"    rgb.b = dot(yuv, Bcoeff); \n"  
-"    return rgb; \n"
-"} \n"
-" // \n"
-"vec3 get_yuv_from_texture(in vec2 tcoord) \n"
-"{ \n"
-"    vec3 yuv; \n"
-"    yuv.x = texture(texy, tcoord).r; \n"
-"    // Get the U and V values \n"
-"    yuv.y = texture(texu, tcoord).r; \n"
-"    yuv.z = texture(texv, tcoord).r; \n"
-"    return yuv; \n"
-"} \n"
-" // \n"
-"vec4 mytexture2D(in vec2 tcoord) \n"
-"{ \n"
-"    vec3 rgb, yuv; \n"
-"    yuv = get_yuv_from_texture(tcoord); \n"
-"    // Do the color transform \n"
-"    rgb = yuv2rgb(yuv); \n"
-"    return vec4(rgb, 1.0); \n"
-"} \n"
-" // \n"
-"void main()\n"
-"{\n"
-" //      color = texture(ourTexture1, TexCoord); \n"
-"   colour = mytexture2D(TexCoord); \n"
-"}\n";
-}
 
+/** Procedural frames for repeatable load tests
+ * 
+ * Every frame is different, so that drivers and caches can't cheat : a diagonal gradient moving with the frame number, noise in the
+ * low bits and the frame number itself, stamped as 32 black/white 8x8 blocks at the top-left corner of the luma plane (blue channel for
+ * BGRA).  Read it back with FrameGenerator::readCounter to check for dropped or reordered frames at the other end of a pipeline.
+ * 
+ * Each plane is "ramp + row offset + noise", computed 16 bytes at a time with SSE2.
+ * 
+ */
+class FrameGenerator {
+  
+public:
+  /** Default constructor
+   * 
+   * @param format  PIXFMT_I420, PIXFMT_NV12, PIXFMT_BGRA, PIXFMT_YUYV, PIXFMT_UYVY, PIXFMT_P010 or PIXFMT_I420P10
+   * @param w       width (even)
+   * @param h       height (even)
+   * @param fps     frame rate for FrameGenerator::wait.  0 = as fast as possible
+   * @param seed    noise seed
+   * 
+   */
+  FrameGenerator(PixelFormat format, GLsizei w, GLsizei h, double fps=0, uint32_t seed=1);
+  ~FrameGenerator(); ///< Default destructor
+  
+protected:
+  struct Plane {
+    std::size_t          offset;      ///< byte offset of the plane in the frame
+    GLsizei              linesize;    ///< bytes per line
+    GLsizei              lines;
+    int                  speed;       ///< how fast the gradient moves with the frame number
+    std::vector<GLubyte> ramp;        ///< per-byte value of a line
+    std::vector<GLubyte> addmask;     ///< 0xff : the byte moves with line & frame number, 0 : fixed (say, alpha)
+    std::vector<GLubyte> noisemask;   ///< bits of noise per byte
+  };
+  
+protected:
+  PixelFormat        format;
+  GLsizei            w, h;
+  double             fps;
+  uint32_t           noise[4];   ///< xorshift state, one per 32-bit lane
+  uint64_t           count;      ///< frames generated
+  std::vector<Plane> planes;
+  std::vector<GLubyte> narrow;   ///< 16-bit formats : the frame is generated as I420 here, then widened with i420ToYUV16
+  std::chrono::steady_clock::time_point t0;
+  
+protected:
+  void addPlane(std::size_t offset, GLsizei linesize, GLsizei lines, int speed, const GLubyte* pattern, int bpp, const GLubyte* fixed);
+  void fillPlane(GLubyte* dst, const Plane& plane, uint64_t index);
+  static GLsizei     stampBpp(PixelFormat format);    ///< bytes between two pixels of the frame number stamp
+  static std::size_t stampOffset(PixelFormat format); ///< byte of the first stamped pixel : luma, or blue
+  
+public:
+  std::size_t getFrameSize() {return frameSize(format, w, h);}
+  uint64_t    getCount()     {return count;}
+  void        generate(GLubyte* dst, uint64_t index); ///< Frame number index into dst
+  uint64_t    next(GLubyte* dst);                     ///< Next frame into dst.  Returns its number
+  void        wait();                                 ///< Sleep until it's time for the next frame, according to fps
+  static uint32_t readCounter(const GLubyte* data, PixelFormat format, GLsizei w); ///< Frame number stamped into a frame
+};
 
 
-YUVBlockShader::YUVBlockShader() : Shader() {
-  compile();
-  use();
-  findVars();
-}
+typedef void (*GLXSwapIntervalEXTProc)(Display* dpy, GLXDrawable drawable, int interval);                              ///< glXSwapIntervalEXT
+typedef int  (*GLXSwapIntervalMESAProc)(unsigned int interval);                                                        ///< glXSwapIntervalMESA
+typedef int  (*GLXSwapIntervalSGIProc)(int interval);                                                                  ///< glXSwapIntervalSGI
+typedef Bool (*GLXGetSyncValuesOMLProc)(Display* dpy, GLXDrawable drawable, int64_t* ust, int64_t* msc, int64_t* sbc); ///< glXGetSyncValuesOML
+typedef Bool (*GLXGetMscRateOMLProc)(Display* dpy, GLXDrawable drawable, int32_t* numerator, int32_t* denominator);    ///< glXGetMscRateOML
 
-YUVBlockShader::~YUVBlockShader() {
-}
 
+/** Presentation counters of a FramePacer.  Per stream, the latencies are from frame input to display */
+struct PresentStats {
+  uint64_t frames;       ///< frames presented
+  uint64_t missed;       ///< vblanks missed (only for the whole pacer)
+  double   latency_avg;  ///< ms
+  double   latency_max;  ///< ms
+};
 
-void YUVBlockShader::findVars() {
-  position=0; // this is hard-coded into the shader code (see "location=0")
-  texcoord=1; // this is hard-coded into the shader code (see "location=1")
-  
-  std::cout << "YUVBlockShader: findVars: Location of position: " << position << std::endl;
-  std::cout << "YUVBlockShader: findVars: Location of texcoord: " << texcoord << std::endl;
+
+/** Paces a render loop to the display refresh
+ * 
+ * Call FramePacer::beginFrame, get the latest frames of your streams, upload them & render, mark the frames with FramePacer::addInput,
+ * then call FramePacer::endFrame to swap.  beginFrame sleeps until "just in time" : the next vblank minus the time the last frames took
+ * to upload and render minus a safety margin.  That way the uploaded frames are as fresh as possible when they hit the screen.
+ * 
+ * The swap interval is set with GLX_EXT_swap_control (or the MESA / SGI variants), or eglSwapInterval.  With GLX_OML_sync_control, the
+ * refresh rate comes from glXGetMscRateOML and missed vblanks from the media stream counter, otherwise both are estimated from the
+ * swap timestamps.  endFrame waits for the swap (glFinish), so that its timestamp is the moment the frame was put on display.
+ * 
+ */
+class FramePacer {
   
-  transform=glGetUniformLocation(program,"transform");
-  std::cout << "YUVBlockShader: findVars: Location of the transform matrix: " << transform << std::endl;
+public:
+  /** Constructor for a glx window
+   * 
+   * @param display   X display
+   * @param drawable  the window
+   * @param interval  vblanks per frame.  0 = no vsync
+   * 
+   */
+  FramePacer(Display* display, GLXDrawable drawable, int interval=1);
+  FramePacer(EGLDisplay display, EGLSurface surface, int interval=1); ///< Constructor for an egl surface
+  ~FramePacer(); ///< Default destructor
   
-  texBlock=glGetUniformLocation(program,"texBlock");
-  std::cout << "YUVBlockShader: findVars: Location of texBlock: " << texBlock << std::endl;
+protected:
+  bool        egl;
+  Display*    display;
+  GLXDrawable drawable;
+  EGLDisplay  egl_display;
+  EGLSurface  egl_surface;
+  int         interval;
+  const char* swap_control;  ///< name of the extension used for the swap interval
+  GLXGetSyncValuesOMLProc getSyncValues; ///< NULL if no GLX_OML_sync_control
+  GLXGetMscRateOMLProc    getMscRate;
   
-  /*
-  texy=glGetUniformLocation(program,"texy");
-  std::cout << "YUVBlockShader: findVars: Location of texy: " << texy << std::endl;
+protected:
+  double   period;          ///< s between vblanks
+  bool     period_known;    ///< from OML : don't estimate
+  double   margin;          ///< s : leave this much slack before the vblank
+  double   work;            ///< s : running estimate of upload + render time
+  bool     jit;             ///< sleep until just in time in beginFrame
+  int64_t  last_msc;
+  uint64_t frames, missed;
+  std::chrono::steady_clock::time_point last_present, frame_start;
+  std::vector<std::pair<int, std::chrono::steady_clock::time_point>> inputs; ///< frames of streams in the current frame
+  std::map<int, PresentStats> stream_stats;
+  std::map<int, double>       latency_sums;
+  
+protected: // see MetricsRegistry
+  MetricCounter*   metric_frames;
+  MetricCounter*   metric_missed;
+  MetricHistogram* metric_interval;
+  MetricHistogram* metric_latency;
   
-  texu=glGetUniformLocation(program,"texu");
-  std::cout << "YUVBlockShader: findVars: Location of texu: " << texu << std::endl;
+protected:
+  void init();
+  static bool hasExtension(const char* extensions, const char* name);
   
-  texv=glGetUniformLocation(program,"texv");
-  std::cout << "YUVBlockShader: findVars: Location of texv: " << texv << std::endl;
-  */
-}
+public:
+  double      getPeriod()        {return period;}
+  bool        hasSyncControl()   {return getSyncValues!=NULL;}
+  const char* getSwapControl()   {return swap_control;}
+  void        setMargin(double ms)     {margin=ms/1000;}
+  void        setJustInTime(bool jit)  {this->jit=jit;}
+  void        beginFrame();    ///< Sleep until it's time to upload & render the next frame
+  void        addInput(int stream, std::chrono::steady_clock::time_point t); ///< A frame of stream, captured / decoded at t, is in this frame
+  void        endFrame();      ///< Swap, wait for it & account latencies and missed vblanks
+  PresentStats getStats();             ///< The whole pacer
+  PresentStats getStats(int stream);   ///< A stream
+  void        printStats();
+};
 
 
+/** Textures of a stream, as rendered by WindowManager */
+struct StreamTextures {
+  GLuint  y_tex, u_tex, v_tex;
+  GLsizei w, h;  ///< image dimensions
+};
 
-/*** YUV Shader Program ***/
 
-const char* YUVBlockShader::vertex_shader () { return 
-// shader vertex source code
-// We swap the y-axis by substracing our coordinates from 1.
-// This is done because most images have the top y-axis
-// inversed with OpenGL's top y-axis.
-// TexCoord = texcoord;
-"#version 300 es\n"
-"precision mediump float;\n"
-// "in vec2 scaling;\n"
-"uniform mat4 transform;\n"
-"layout (location = 0) in vec3 position;\n"
-"layout (location = 1) in vec2 texcoord;\n"
-"out vec2 TexCoord;\n"
-"void main()\n"
-"{\n"
-// "  gl_Position = vec4(position, 1.0f) * vec4(scaling,1.0f,1.0f);\n"
-"  gl_Position = transform * vec4(position, 1.0f);\n"
-"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
-"}\n";
-}
+/** Many X windows rendered with a single glx context
+ * 
+ * Each window has a list of tiles : a stream shown in a rectangle of the window, in normalized [0,1] coordinates (origin at the bottom-left).
+ * Window geometry is cached and updated from ConfigureNotify events (WindowManager::processEvents) instead of asking the X server every
+ * frame, and tile viewports & transforms are only recomputed when the geometry or the assignments change.
+ * 
+ * WindowManager::render draws all windows in one pass : one glXMakeCurrent per window (skipped if it's already current), the program,
+ * VAO and sampler units set once per window, then just viewport, textures and transform per tile.  All state goes through the
+ * GLStateCache of the context, so calls that wouldn't change anything are skipped.  The buffers are swapped after all
+ * windows have been drawn.  A stream can be shown in several windows.
+ * 
+ */
+class WindowManager {
+  
+public:
+  WindowManager(OpenGLContext* ctx); ///< Default constructor.  Before rendering, the VAO of ctx must have been set up with OpenGLContext::reserve
+  ~WindowManager(); ///< Default destructor.  Destroys the windows
+  
+protected:
+  struct Tile {
+    int     stream;
+    GLfloat x, y, w, h;                 ///< normalized rectangle in the window
+    GLint   vx, vy;                     ///< viewport, cached
+    GLsizei vw, vh;
+    std::array<GLfloat,16> transform;   ///< aspect ratio correction, cached
+  };
+  struct ManagedWindow {
+    Window            id;
+    GLsizei           width, height;    ///< cached geometry
+    bool              dirty;            ///< viewports & transforms need recomputing
+    std::vector<Tile> tiles;
+  };
+  
+protected:
+  OpenGLContext*  ctx;
+  std::vector<ManagedWindow>    windows;
+  std::map<int, StreamTextures> streams;
+  Window          current;            ///< window the context is current on
+  uint64_t        context_switches;
+  uint64_t        frames;
+  MetricCounter*  metric_frames;      ///< see MetricsRegistry
+  
+protected:
+  void layout(ManagedWindow& window);
+  
+public:
+  int      addWindow(const char* name=NULL);  ///< Create a window.  Returns its index
+  Window   getWindow(int window)      {return windows[window].id;}
+  int      getWindowCount()           {return windows.size();}
+  void     setStream(int stream, const StreamTextures& textures); ///< Textures of a stream.  Call again if they change
+  void     assign(int window, int stream, GLfloat x, GLfloat y, GLfloat w, GLfloat h); ///< Show stream in a rectangle of window
+  void     assignGrid(int window, const std::vector<int>& streams); ///< Replace the tiles of window with an even grid of streams
+  void     clear(int window);         ///< Remove all tiles of window
+  void     processEvents();           ///< Read window geometry changes from the X event queue
+  void     render(YUVShader* shader); ///< Draw & swap all windows
+  uint64_t getContextSwitches()       {return context_switches;}
+};
 
-const char* YUVBlockShader::fragment_shader  () { return
-"#version 300 es\n"
-"precision mediump float;\n"
-"in vec3 ourColor;\n"
-"in vec2 TexCoord;\n"
-"uniform sampler2D texBlock; \n" // the bgr texture
-"out vec4 colour;\n"
-" // \n"
-"vec3 yuv2rgb(in vec3 yuv) \n"
-"{ \n"
-"    // YUV offset  \n"
-"    // const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"
-"    const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"  
-"    // RGB coefficients \n"
-"    const vec3 Rcoeff = vec3( 1.164, 0.000,  1.596); \n"
-"    const vec3 Gcoeff = vec3( 1.164, -0.391, -0.813); \n"
-"    const vec3 Bcoeff = vec3( 1.164, 2.018,  0.000); \n"  
-"    vec3 rgb; \n"
-"    yuv = clamp(yuv, 0.0, 1.0); \n"
-"    yuv += offset; \n"
-"    rgb.r = dot(yuv, Rcoeff);  \n"
-"    rgb.g = dot(yuv, Gcoeff); \n"  
-"    rgb.b = dot(yuv, Bcoeff); \n"  
-"    return rgb; \n"
-"} \n"
-" // \n"
-"vec3 get_yuv_from_texture(in vec2 tcoord) \n"
-"{ \n"
-"    vec3 yuv; \n"
-"    yuv.x = texture(texBlock, tcoord).b; \n" // yuv is carried in bgr
-"    // Get the U and V values \n"
-"    yuv.y = texture(texBlock, tcoord).g; \n"
-"    yuv.z = texture(texBlock, tcoord).r; \n"
-"    return yuv; \n"
-"} \n"
-" // \n"
-"vec4 mytexture2D(in vec2 tcoord) \n"
-"{ \n"
-"    vec3 rgb, yuv; \n"
-"    yuv = get_yuv_from_texture(tcoord); \n"
-"    // Do the color transform \n"
-"    rgb = yuv2rgb(yuv); \n"
-"    return vec4(rgb, 1.0); \n"
-"} \n"
-" // \n"
-"void main()\n"
-"{\n"
-"   // colour = texture(texBlock, TexCoord); \n"
-"   colour = mytexture2D(TexCoord); \n"
-"}\n";
-}
+
+/** Per-tile parameters of YUVTileShader, std140 layout (96 bytes) */
+struct TileParams {
+  GLfloat transform[16];  ///< mat4, column major
+  GLfloat rect[4];        ///< x0, y0, x1, y1 in normalized device coordinates
+  GLint   layer[4];       ///< [0] : texture array layer, the rest is padding
+};
 
 
+/** The uniform block of YUVTileShader, std140 layout */
+struct FrameParams {
+  GLfloat    colour[16];  ///< mat4 : yuv => rgb, offsets in the last column
+  TileParams tiles[YUVTileShader::max_tiles];
+};
 
-OpenGLContext::OpenGLContext() {  
-  // GLXFBConfig *fbConfigs;
-  int numReturned;
+static_assert(sizeof(TileParams)==96, "TileParams must match the std140 layout of the shader");
+static_assert(sizeof(FrameParams)<=16384, "FrameParams must fit in the minimum GL_MAX_UNIFORM_BLOCK_SIZE");
+
+
+/** Renders up to YUVTileShader::max_tiles stream tiles per frame with one instanced draw call
+ * 
+ * The streams share the dimensions w x h : their I420 planes live in three texture arrays, a layer per stream.
+ * 
+ * Tiles are given with TileRenderer::addTile.  TileRenderer::render writes all per-tile parameters into a uniform buffer at once and
+ * draws.  The uniform buffer is persistently mapped (GL_ARB_buffer_storage) and split into three regions, used round-robin and guarded
+ * by fences, so that writing the parameters of this frame never stalls on the gpu reading those of the previous one.  Without buffer
+ * storage, the parameters go in with glBufferSubData.
+ * 
+ */
+class TileRenderer {
   
-  // initial connection to the xserver
-  this->display_id = XOpenDisplay(NULL);
-  if (this->display_id == NULL) {
-    std::cout << "OpenGLThtead: initGLX: cannot connect to X server" << std::endl;
-  }
+public:
+  /** Default constructor.  The context must be current and its VAO set up with OpenGLContext::reserve
+   * 
+   * @param ctx     the context
+   * @param w, h    dimensions of the streams
+   * @param layers  number of streams
+   * 
+   */
+  TileRenderer(OpenGLContext* ctx, GLsizei w, GLsizei h, int layers);
+  ~TileRenderer(); ///< Default destructor
   
-  // glx frame buffer configuration [GLXFBConfig * list of GLX frame buffer configuration parameters] => consistent visual [XVisualInfo] parameters for the X-window
-  this->root_id =DefaultRootWindow(this->display_id); // get the root window of this display
-    
-  /* Request a suitable framebuffer configuration - try for a double buffered configuration first */
-  this->doublebuffer_flag=true;
-  this->fbConfigs = glXChooseFBConfig(this->display_id,DefaultScreen(this->display_id),glx_attr::doubleBufferAttributes,&numReturned);
-  // MEMORY LEAK when running with valgrind, see: http://stackoverflow.com/questions/10065849/memory-leak-using-glxcreatecontext
+protected:
+  static const int nregions = 3;
   
-  this->att=glx_attr::doubleBufferAttributes;
-  // this->fbConfigs = NULL; // force single buffer
+protected:
+  OpenGLContext*  ctx;
+  YUVTileShader*  shader;
+  GLsizei         w, h;
+  int             layers;
+  GLuint          arrays[3];          ///< y, u, v texture arrays
+  GLuint          ubo;
+  GLubyte*        mapped;             ///< persistent mapping, or NULL
+  GLsizeiptr      region_size;        ///< sizeof(FrameParams), rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  int             region;
+  std::array<GLsync, nregions> fences;
+  FrameParams     params;             ///< staging for the glBufferSubData path
+  int             ntiles;
   
-  if (this->fbConfigs == NULL) {  /* no double buffered configs available */
+public:
+  bool     isPersistent()      {return mapped!=NULL;}
+  int      getTileCount()      {return ntiles;}
+  void     uploadLayer(int layer, const GLubyte* frame); ///< An I420 frame into layer.  frame can be an offset into a bound unpack PBO
+  void     clearTiles();
+  /** Show layer in a rectangle of the window
+   * 
+   * @param x, y, tw, th    rectangle in window pixels, origin at the bottom-left
+   * @param win_w, win_h    window dimensions
+   * 
+   */
+  bool     addTile(int layer, GLint x, GLint y, GLsizei tw, GLsizei th, GLsizei win_w, GLsizei win_h);
+  void     render();           ///< Parameters of all tiles => uniform buffer, one draw call
+};
+
+
+/** How StreamDownscaler makes the textures of small tiles */
+enum DownscaleMode {
+  DOWNSCALE_NONE,     ///< sample the full resolution textures
+  DOWNSCALE_MIPMAP,   ///< glGenerateMipmap on the planes, up to the level needed
+  DOWNSCALE_GPU_BOX,  ///< halve on the gpu with glBlitFramebuffer (2:1 linear = 2x2 box) into smaller textures
+  DOWNSCALE_CPU       ///< halve on the cpu (downscale2x2) and upload only the small frame
+};
+
+const char* downscaleModeName(DownscaleMode mode);
+
+
+/** The textures of an I420 stream, downscaled according to the size of its tile on screen
+ * 
+ * StreamDownscaler::upload takes a full resolution frame and the size of the tile it's shown in.  The level is the most halvings that
+ * still leave at least a texel per pixel : a 1080p stream in a 240x135 tile is sampled from 240x135 (level 3), instead of aliasing &
+ * wasting texture bandwidth at full resolution.  Tiles larger than half the frame get level 0, i.e. no downscaling.
+ * 
+ * DOWNSCALE_CPU also cuts the upload by 4x per level : use it for streams that are never shown large.
+ * 
+ * Texture binds go through the GLStateCache of the context.
+ * 
+ */
+class StreamDownscaler {
+  
+public:
+  /** Default constructor.  The context must be current
+   * 
+   * @param ctx        the context
+   * @param w, h       frame dimensions
+   * @param mode       see DownscaleMode
+   * @param max_level  most halvings
+   * 
+   */
+  StreamDownscaler(OpenGLContext* ctx, GLsizei w, GLsizei h, DownscaleMode mode, int max_level=3);
+  ~StreamDownscaler(); ///< Default destructor
+  
+protected:
+  OpenGLContext*  ctx;
+  GLsizei         w, h;
+  DownscaleMode   mode;
+  int             max_level;
+  int             level;        ///< of the last upload
+  std::vector<std::array<GLuint, 3>> texs;  ///< [level][plane] : level 0 full resolution.  Mipmap mode : only level 0
+  std::vector<std::array<GLuint, 3>> fbos;  ///< [level][plane] : GPU_BOX mode
+  std::vector<GLubyte> scratch[2];          ///< CPU mode : ping-pong frames
+  uint64_t        bytes;        ///< uploaded
+  
+protected:
+  GLsizei planeWidth(int plane, int level)  {return (plane==0 ? w : w/2) >> level;}
+  GLsizei planeHeight(int plane, int level) {return (plane==0 ? h : h/2) >> level;}
+  void    uploadPlanes(int level, const GLubyte* frame); ///< A packed I420 frame of that level's dimensions
+  
+public:
+  static int chooseLevel(GLsizei w, GLsizei h, GLsizei tile_w, GLsizei tile_h, int max_level); ///< Most halvings that keep the image at least as big as the tile
+  void       upload(const GLubyte* frame, GLsizei tile_w, GLsizei tile_h); ///< Full resolution I420 frame, shown in a tile_w x tile_h tile
+  StreamTextures getTextures(); ///< What to sample for the tile
+  int        getLevel()         {return level;}
+  uint64_t   getBytes()         {return bytes;}
+};
+
+
+/** Where a plane of a frame is and how it's uploaded */
+struct PlaneLayout {
+  std::size_t offset;          ///< byte offset of the plane in the frame
+  GLsizei     w, h;            ///< plane dimensions in texels
+  GLsizei     bpp;             ///< bytes per texel
+  GLenum      format;          ///< GL_RED, GL_RG, GL_BGRA ..
+  GLenum      internal_format; ///< GL_R8, GL_RG8, GL_RGBA8, GL_R16 ..
+  GLenum      type;            ///< GL_UNSIGNED_BYTE or GL_UNSIGNED_SHORT
+};
+
+
+/** A pool of worker threads for data-parallel jobs
+ * 
+ * WorkerPool::run calls job(0) .. job(njobs-1) on the workers (and on the calling thread) and returns when all are done.
+ * Used for splitting copies and pixel conversions into slices.
+ * 
+ */
+class WorkerPool {
+  
+public:
+  WorkerPool(int nthreads); ///< Default constructor.  nthreads : total threads, including the caller.  1 = no workers
+  ~WorkerPool();            ///< Default destructor
+  
+protected:
+  std::vector<std::thread>  threads;
+  std::mutex                mutex;
+  std::condition_variable   cond;       ///< new work
+  std::condition_variable   done_cond;  ///< all work done
+  std::function<void(int)>  job;
+  int                       njobs, next, done;
+  bool                      running;
+  
+protected:
+  void loop();
+  bool work(std::unique_lock<std::mutex>& lk); ///< Run one job, if any left
+  
+public:
+  int  getThreads() {return threads.size()+1;}
+  void run(int njobs, std::function<void(int)> job);
+};
+
+
+/** Where yuv => rgb happens */
+enum ConvertPath {
+  CONVERT_GPU,   ///< upload the planes, convert in the fragment shader (YUVShader)
+  CONVERT_CPU    ///< convert with yuvToRGBA straight into a PBO, upload RGBA (RGBShader)
+};
+
+const char* convertPathName(ConvertPath path);
+
+
+/** Shows I420 frames converting them either on the gpu or on the cpu, and picks the faster one
+ * 
+ * On a software rasterizer (say, llvmpipe on a headless box) the per-pixel yuv2rgb of the fragment shader is expensive, while the
+ * SIMD cpu conversion (AVX2 / SSE2, split by rows over a WorkerPool) is cheap.  ConvertRenderer::choose times both paths offscreen, at
+ * the frame size, and returns the faster one.
+ * 
+ */
+class ConvertRenderer {
+  
+public:
+  /** Default constructor.  The context must be current and its VAO set up with OpenGLContext::reserve
+   * 
+   * @param ctx      the context
+   * @param w, h     frame dimensions
+   * @param workers  threads for the cpu conversion.  NULL = the calling thread
+   * 
+   */
+  ConvertRenderer(OpenGLContext* ctx, GLsizei w, GLsizei h, WorkerPool* workers=NULL);
+  ~ConvertRenderer(); ///< Default destructor
+  
+protected:
+  OpenGLContext*  ctx;
+  GLsizei         w, h;
+  WorkerPool*     workers;
+  YUVShader*      yuv_shader;
+  RGBShader*      rgb_shader;
+  GLuint          y_tex, u_tex, v_tex, rgb_tex;
+  GLuint          rgb_pbo;
+  double          gpu_ms, cpu_ms;   ///< from ConvertRenderer::choose
+  
+public:
+  /** Upload frame, convert & draw it into a viewport of the current framebuffer */
+  void        render(ConvertPath path, const GLubyte* frame, GLint x, GLint y, GLsizei vw, GLsizei vh);
+  ConvertPath choose(const GLubyte* frame, int n=20); ///< Time both paths with frame, offscreen.  Returns the faster
+  double      getGPUms()  {return gpu_ms;}
+  double      getCPUms()  {return cpu_ms;}
+};
+
+
+/** Parameters of a benchmark run */
+struct RunConfig {
+  std::string strategy;  ///< "direct" : glTexSubImage2D from cpu memory.  "pbo" : through a ring of unpack PBOs
+  GLsizei     w, h;
+  PixelFormat format;
+  int         streams;   ///< concurrent streams, each with its own textures (and PBOs)
+  double      duration;  ///< seconds
+  int         threads;   ///< threads for copying into the PBOs
+  int         ring;      ///< PBOs (and fences) per stream
+  std::string source;    ///< "synthetic" or a y4m / raw 1280x720 I420 file
+  std::string output;    ///< "text", "csv" or "json"
+  std::string trace;     ///< trace event json file, "" = no tracing
+  std::string metrics;   ///< prometheus text file, or "unix:PATH" for a socket.  "" = none
+};
+
+
+/** Results of a benchmark run */
+struct RunResult {
+  GLsizei     w;          ///< size and format actually uploaded : the file's with a --source FILE
+  GLsizei     h;
+  PixelFormat format;
+  uint64_t frames;
+  double   seconds;
+  double   fps;           ///< frames per second, all streams
+  double   mbps;          ///< MB/s uploaded
+  double   latency_p50;   ///< ms, frame acquired => upload complete on the gpu
+  double   latency_p95;
+  double   latency_p99;
+  double   latency_max;
+};
+
+
+/** Parameter grid of a sweep : each list given as comma separated values, e.g. --streams 1,4,16.  Every combination is run */
+struct RunSweep {
+  std::vector<std::string> strategies;
+  std::vector<std::pair<GLsizei, GLsizei>> sizes;
+  std::vector<PixelFormat> formats;
+  std::vector<int>         streams;
+  std::vector<int>         threads;
+  std::vector<int>         rings;
+};
+
+
+/** Per-stream counters of an UploadScheduler */
+struct UploadStreamStats {
+  uint64_t pushed;            ///< frames offered to the scheduler
+  uint64_t uploaded;
+  uint64_t dropped_hidden;    ///< frames of a hidden tile, never uploaded
+  uint64_t dropped_replaced;  ///< frames replaced by a newer one before they got their turn
+  uint64_t deferred;          ///< times a pending frame didn't fit in the budget of a tick
+  uint64_t bytes;             ///< bytes uploaded
+  double   latency_avg;       ///< ms, push => upload
+  double   latency_max;
+};
+
+
+/** Decides which streams get their latest frame uploaded, under a byte budget per frame (per vsync)
+ * 
+ * Streams push decoded frames with UploadScheduler::push : a stream has at most one pending frame, a newer one replaces (drops) it.
+ * Once per rendered frame, UploadScheduler::tick calls the upload function for pending frames in order of priority, until the budget
+ * is spent.  The rest are deferred to the next tick, with an increased priority so that small tiles don't starve.
+ * 
+ * The priority of a stream is its on-screen area in pixels (UploadScheduler::setTile) times its priority weight.  Frames of hidden
+ * tiles are dropped at once.  The first upload of a tick is always done, even when it alone exceeds the budget.
+ * 
+ * If a FramePool is given, frames are released to it once they've been uploaded or dropped.
+ * 
+ * Not thread safe : push and tick from the render thread.
+ * 
+ */
+class UploadScheduler {
+  
+public:
+  typedef std::function<void(int stream, const GLubyte* data, std::size_t size)> UploadFunction;
+  
+  /** Default constructor
+   * 
+   * @param budget  bytes to upload per tick
+   * @param pool    frames are released to this pool when they've been uploaded or dropped.  NULL = the caller owns them
+   * 
+   */
+  UploadScheduler(std::size_t budget, FramePool* pool=NULL);
+  ~UploadScheduler(); ///< Default destructor.  Releases pending frames
+  
+protected:
+  struct Stream {
+    bool        visible;
+    double      area;      ///< on-screen pixels of the tile
+    double      weight;    ///< priority multiplier
+    GLubyte*    data;      ///< pending frame or NULL
+    std::size_t size;
+    int         age;       ///< ticks the stream has been deferred since its last upload.  Survives replaced frames
+    std::chrono::steady_clock::time_point t;   ///< when the pending frame was pushed
+    UploadStreamStats stats;
+    double      latency_sum;
+    MetricCounter* metric_uploaded;   ///< see MetricsRegistry
+    MetricCounter* metric_bytes;
+    MetricCounter* metric_hidden;
+    MetricCounter* metric_replaced;
+    MetricCounter* metric_deferred;
+  };
+  
+protected:
+  std::size_t           budget;
+  FramePool*            pool;
+  std::vector<Stream>   streams;
+  std::vector<int>      order;  ///< scratch for tick
+  uint64_t              ticks;
+  
+protected:
+  void   drop(Stream& stream);
+  double score(const Stream& stream) {return (stream.area+1)*stream.weight*(1+stream.age);}
+  
+public:
+  int         addStream();                                  ///< Returns the stream index
+  void        setTile(int stream, bool visible, GLsizei w, GLsizei h); ///< On-screen size of the stream's tile
+  void        setWeight(int stream, double weight);        ///< Priority multiplier, default 1
+  void        setBudget(std::size_t budget)  {this->budget=budget;}
+  std::size_t getBudget()                    {return budget;}
+  void        push(int stream, GLubyte* data, std::size_t size); ///< Offer a new frame of a stream
+  std::size_t tick(const UploadFunction& upload);          ///< Upload pending frames within the budget.  Returns bytes uploaded
+  UploadStreamStats getStats(int stream);
+  void        printStats();
+};
+
+
+/** A rectangular region of a frame, in pixels.  Used for partial (dirty region) texture updates */
+struct Rect {
+  GLint   x, y;
+  GLsizei w, h;
+};
+
+
+// helper functions
+std::size_t stagingSize(std::size_t size, PageMode mode) { // mapped size of a staging buffer
+  if (mode==PAGES_DEFAULT) {
+    return size;
+  }
+  return ((size+huge_page_size-1)/huge_page_size)*huge_page_size;
+}
+
+
+/** Allocate staging memory with huge pages
+ * 
+ * Tries the requested mode and falls back gracefully : PAGES_HUGETLB => PAGES_THP => PAGES_DEFAULT.  On return, mode is the one that was
+ * actually obtained (PAGES_THP is advisory : the kernel may still use small pages).  Free with freeStaging, using the requested mode.
+ */
+GLubyte* allocStaging(std::size_t size, PageMode& mode) {
+  void*       buffer;
+  GLubyte*    aligned;
+  std::size_t mapsize = stagingSize(size, mode);
+  
+  if (mode==PAGES_HUGETLB) {
+    buffer = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (buffer!=MAP_FAILED) {
+      return (GLubyte*)buffer;
+    }
+    std::cout << "allocStaging : MAP_HUGETLB failed (" << strerror(errno) << ") : falling back to transparent huge pages" << std::endl;
+    mode = PAGES_THP;
+  }
+  
+  if (mode==PAGES_THP) {
+    // over-allocate, so that we can cut out a 2 MB aligned region : the kernel can only use huge pages for aligned 2 MB extents
+    buffer = mmap(NULL, mapsize+huge_page_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (buffer==MAP_FAILED) {
+      std::cout << "allocStaging : mmap failed (" << strerror(errno) << ")" << std::endl;
+      return NULL;
+    }
+    aligned = (GLubyte*)((((uintptr_t)buffer)+huge_page_size-1) & ~(uintptr_t)(huge_page_size-1));
+    if (aligned>(GLubyte*)buffer) { // trim head
+      munmap(buffer, aligned-(GLubyte*)buffer);
+    }
+    munmap(aligned+mapsize, ((GLubyte*)buffer+mapsize+huge_page_size)-(aligned+mapsize)); // trim tail
+    if (madvise(aligned, mapsize, MADV_HUGEPAGE)!=0) {
+      std::cout << "allocStaging : madvise(MADV_HUGEPAGE) failed (" << strerror(errno) << ") : using normal pages" << std::endl;
+      mode = PAGES_DEFAULT;
+    }
+    return aligned;
+  }
+  
+  buffer = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (buffer==MAP_FAILED) {
+    std::cout << "allocStaging : mmap failed (" << strerror(errno) << ")" << std::endl;
+    return NULL;
+  }
+  return (GLubyte*)buffer;
+}
+
+
+void freeStaging(GLubyte* buffer, std::size_t size, PageMode mode) { // mode : the one that was requested from allocStaging
+  munmap(buffer, stagingSize(size, mode));
+}
+
+
+/** Map a file of frames into memory
+ * 
+ * PAGES_DEFAULT and PAGES_THP map the file itself (with PAGES_THP, the kernel is advised to use huge pages for the page cache, where the
+ * filesystem supports it).  With PAGES_HUGETLB, the file is read once into an anonymous huge page mapping instead, since only files on
+ * hugetlbfs can be mapped with huge pages.  On return, size is the file size.  Release with unmapFile, using the same mode.
+ */
+GLubyte* mapFile(const char* fname, std::size_t& size, PageMode mode) {
+  int         fd;
+  struct stat st;
+  void*       buffer;
+  GLubyte*    data;
+  std::size_t n;
+  ssize_t     cc;
+  
+  size = 0;
+  fd = open(fname, O_RDONLY);
+  if (fd<0) {
+    std::cout << "mapFile : could not open " << fname << " (" << strerror(errno) << ")" << std::endl;
+    return NULL;
+  }
+  if (fstat(fd, &st)<0) {
+    std::cout << "mapFile : could not stat " << fname << " (" << strerror(errno) << ")" << std::endl;
+    close(fd);
+    return NULL;
+  }
+  size = st.st_size;
+  if (size==0) {
+    close(fd);
+    return NULL;
+  }
+  
+  if (mode==PAGES_HUGETLB) {
+    PageMode requested = mode; // freeStaging wants the requested mode
+    data = allocStaging(size, mode); // mode might fall back here
+    if (data) {
+      for(n=0; n<size; n=n+cc) {
+        cc = pread(fd, data+n, size-n, n);
+        if (cc<0 && errno==EINTR) {
+          cc=0;
+          continue;
+        }
+        if (cc<=0) {
+          break;
+        }
+      }
+      if (n<size) {
+        std::cout << "mapFile : short read of " << fname << " (" << n << " of " << size << " bytes)" << std::endl;
+        freeStaging(data, size, requested);
+        data = NULL;
+      }
+    }
+    close(fd);
+    if (!data) {
+      size = 0;
+    }
+    return data;
+  }
+  
+  buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping survives
+  if (buffer==MAP_FAILED) {
+    std::cout << "mapFile : mmap failed (" << strerror(errno) << ")" << std::endl;
+    return NULL;
+  }
+  madvise(buffer, size, MADV_SEQUENTIAL);
+  if (mode==PAGES_THP) {
+    madvise(buffer, size, MADV_HUGEPAGE); // advisory : fails silently where file THP is not supported
+  }
+  return (GLubyte*)buffer;
+}
+
+
+void unmapFile(GLubyte* buffer, std::size_t size, PageMode mode) {
+  if (mode==PAGES_HUGETLB) {
+    freeStaging(buffer, size, mode);
+  }
+  else {
+    munmap(buffer, size);
+  }
+}
+
+
+uint readbytes(const char* fname, uint8_t*& buffer) {
+  uint      size;
+  std::ifstream file;
+  
+  file.open(fname,std::ios::in|std::ios::binary|std::ios::ate);
+  size = file.tellg();
+
+  file.seekg(0,std::ios::beg);
+  file.read((char*)buffer,size);
+  file.close();
+  
+  printf("read %i bytes\n",size);
+  
+  return size;
+}
+
+
+/** Read size bytes at offset straight into buffer, say, into mapped PBO memory
+ * 
+ * Unlike readbytes, there's no intermediate heap buffer : the disk/pipe => gpu staging path is a single kernel copy.
+ * Returns the number of bytes read.
+ */
+std::size_t preadbytes(int fd, GLubyte* buffer, std::size_t size, off_t offset) {
+  std::size_t n;
+  ssize_t     cc;
+  
+  for(n=0; n<size; n=n+cc) {
+    cc = pread(fd, buffer+n, size-n, offset+n);
+    if (cc<0 && errno==EINTR) {
+      cc=0;
+      continue;
+    }
+    if (cc<=0) { // eof or error
+      break;
+    }
+  }
+  return n;
+}
+
+
+int futexWait(std::atomic<uint32_t>* addr, uint32_t value, int timeout_ms) { // sleep while *addr==value.  Works across processes in shared memory
+  struct timespec ts;
+  ts.tv_sec  = timeout_ms/1000;
+  ts.tv_nsec = (timeout_ms%1000)*1000000L;
+  return syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+
+void futexWake(std::atomic<uint32_t>* addr) {
+  syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+
+int64_t monotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec)*1000000000LL + ts.tv_nsec;
+}
+
+
+/** Get a dma-buf fd for a memfd, through /dev/udmabuf
+ * 
+ * The memfd must be sealed against shrinking and have a page aligned size.  Returns -1 if udmabuf is not available.
+ */
+int getUdmaBuf(int memfd, std::size_t size) {
+  int    dev, fd;
+  struct udmabuf_create create;
+  
+  dev = open("/dev/udmabuf", O_RDWR);
+  if (dev<0) {
+    std::cout << "getUdmaBuf : no /dev/udmabuf (" << strerror(errno) << ")" << std::endl;
+    return -1;
+  }
+  memset(&create, 0, sizeof(create));
+  create.memfd  = memfd;
+  create.flags  = UDMABUF_FLAGS_CLOEXEC;
+  create.offset = 0;
+  create.size   = size;
+  fd = ioctl(dev, UDMABUF_CREATE, &create);
+  if (fd<0) {
+    std::cout << "getUdmaBuf : UDMABUF_CREATE failed (" << strerror(errno) << ")" << std::endl;
+  }
+  close(dev);
+  return fd;
+}
+
+
+std::vector<PlaneLayout> planeLayout(PixelFormat format, GLsizei w, GLsizei h) {
+  std::size_t size = std::size_t(w)*h;
+  switch (format) {
+    case(PIXFMT_I420):
+      return {
+        PlaneLayout{0,          w,   h,   1, GL_RED, GL_R8, GL_UNSIGNED_BYTE},
+        PlaneLayout{size,       w/2, h/2, 1, GL_RED, GL_R8, GL_UNSIGNED_BYTE},
+        PlaneLayout{(5*size)/4, w/2, h/2, 1, GL_RED, GL_R8, GL_UNSIGNED_BYTE}
+      };
+    case(PIXFMT_NV12):
+      return {
+        PlaneLayout{0,          w,   h,   1, GL_RED, GL_R8,  GL_UNSIGNED_BYTE},
+        PlaneLayout{size,       w/2, h/2, 2, GL_RG,  GL_RG8, GL_UNSIGNED_BYTE}
+      };
+    case(PIXFMT_BGRA):
+      return {
+        PlaneLayout{0,          w,   h,   4, GL_BGRA, GL_RGBA8, GL_UNSIGNED_BYTE}
+      };
+    case(PIXFMT_P010): // normalized 16-bit textures : the shader scales (see YUV16Shader)
+      return {
+        PlaneLayout{0,          w,   h,   2, GL_RED, GL_R16,  GL_UNSIGNED_SHORT},
+        PlaneLayout{2*size,     w/2, h/2, 4, GL_RG,  GL_RG16, GL_UNSIGNED_SHORT}
+      };
+    case(PIXFMT_I420P10):
+      return {
+        PlaneLayout{0,          w,   h,   2, GL_RED, GL_R16, GL_UNSIGNED_SHORT},
+        PlaneLayout{2*size,     w/2, h/2, 2, GL_RED, GL_R16, GL_UNSIGNED_SHORT},
+        PlaneLayout{(5*size)/2, w/2, h/2, 2, GL_RED, GL_R16, GL_UNSIGNED_SHORT}
+      };
+    case(PIXFMT_YUYV): // a pixel pair is one RGBA texel : see YUYVShader
+    case(PIXFMT_UYVY):
+      return {
+        PlaneLayout{0,          w/2, h,   4, GL_RGBA, GL_RGBA8, GL_UNSIGNED_BYTE}
+      };
+    default:
+      return {};
+  }
+}
+
+
+bool parsePixelFormat(const char* name, PixelFormat& format) {
+  const PixelFormat formats[] = {PIXFMT_I420, PIXFMT_NV12, PIXFMT_BGRA, PIXFMT_YUYV, PIXFMT_UYVY, PIXFMT_P010, PIXFMT_I420P10};
+  for(auto it=std::begin(formats); it!=std::end(formats); ++it) {
+    if (strcmp(name, pixelFormatName(*it))==0) {
+      format = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+void getPBO(GLuint& index, GLsizei size, GLubyte*& payload) { // modify pointer in-place
+  glGenBuffers(1, &index);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, index);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW); // reserve n_payload bytes to index/handle pbo_id
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind (not mandatory)
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, index); // rebind (not mandatory)
+  
+  payload = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  
+  std::cout << "getPBO : " << index << " " << (unsigned long)payload << std::endl;
+  
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer ** MANDATORY **
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind ** MANDATORY **
+}
+
+
+#if defined(__SSE2__)
+__attribute__((target("avx")))
+std::size_t streamcopy_avx(GLubyte* dst, const GLubyte* src, std::size_t n) { // dst must be 32-byte aligned.  Returns bytes copied
+  std::size_t i;
+  for(i=0;i+128<=n;i=i+128) { // 4 x 32 bytes : a couple of full cache lines at a time
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src+i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src+i+32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(src+i+64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(src+i+96));
+    _mm256_stream_si256((__m256i*)(dst+i),    a);
+    _mm256_stream_si256((__m256i*)(dst+i+32), b);
+    _mm256_stream_si256((__m256i*)(dst+i+64), c);
+    _mm256_stream_si256((__m256i*)(dst+i+96), d);
+  }
+  return i;
+}
+
+
+std::size_t streamcopy_sse2(GLubyte* dst, const GLubyte* src, std::size_t n) { // dst must be 16-byte aligned.  Returns bytes copied
+  std::size_t i;
+  for(i=0;i+64<=n;i=i+64) { // 4 x 16 bytes = one cache line
+    __m128i a = _mm_loadu_si128((const __m128i*)(src+i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src+i+16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(src+i+32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(src+i+48));
+    _mm_stream_si128((__m128i*)(dst+i),    a);
+    _mm_stream_si128((__m128i*)(dst+i+16), b);
+    _mm_stream_si128((__m128i*)(dst+i+32), c);
+    _mm_stream_si128((__m128i*)(dst+i+48), d);
+  }
+  return i;
+}
+#endif
+
+
+const char* streamcopyKind() { // which kernel streamcopy uses on this cpu
+#if defined(__SSE2__)
+  if (__builtin_cpu_supports("avx")) {
+    return "avx";
+  }
+  return "sse2";
+#else
+  return "memcpy";
+#endif
+}
+
+
+/** Copy with non-temporal (streaming) stores
+ * 
+ * Memory from glMapBuffer is often write-combined or uncached : the stores should go there in full cache lines, without reading the
+ * destination into the cache first.  Non-temporal stores do exactly that.  They also keep a large copy from evicting everything else
+ * from the cache.  Ends with sfence, so that the data is visible before, say, glUnmapBuffer or glTexSubImage2D.
+ * 
+ * Falls back to memcpy where there are no x86 streaming stores.
+ */
+void streamcopy(GLubyte* dst, const GLubyte* src, std::size_t n) {
+#if defined(__SSE2__)
+  static const bool   avx   = __builtin_cpu_supports("avx");
+  const std::size_t   align = avx ? 32 : 16;
+  std::size_t         head, done;
+  
+  head = (align - ((uintptr_t)dst & (align-1))) & (align-1); // bytes until dst is aligned
+  if (head>n) {
+    head=n;
+  }
+  memcpy(dst, src, head);
+  dst=dst+head; src=src+head; n=n-head;
+  
+  done = avx ? streamcopy_avx(dst, src, n) : streamcopy_sse2(dst, src, n);
+  memcpy(dst+done, src+done, n-done); // tail
+  _mm_sfence();
+#else
+  memcpy(dst, src, n);
+#endif
+}
+
+
+void parallelCopy(WorkerPool& workers, GLubyte* dst, const GLubyte* src, std::size_t n) { // streamcopy, split into cache line aligned slices
+  int         nslices = workers.getThreads();
+  std::size_t slice   = ((n/nslices+63)/64)*64;
+  
+  if (nslices<2) {
+    TRACE_SCOPE("copy");
+    streamcopy(dst, src, n);
+    return;
+  }
+  workers.run(nslices, [=](int i) {
+    TRACE_SCOPE("copy slice");
+    std::size_t begin = std::min(n, i*slice);
+    std::size_t end   = std::min(n, begin+slice);
+    streamcopy(dst+begin, src+begin, end-begin);
+  });
+}
+
+
+void getFBO(GLuint& index, GLuint tex_index) { // framebuffer object with a texture as its color attachment .. glReadPixels reads from there
+  glGenFramebuffers(1, &index);
+  glBindFramebuffer(GL_FRAMEBUFFER, index);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_index, 0);
+  
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "getFBO : WARNING! framebuffer " << index << " incomplete" << std::endl;
+  }
+  
+  std::cout << "getFBO : " << index << " with texture " << tex_index << std::endl;
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, 0); // unbind
+}
+
+
+bool tileDiffers(const GLubyte* prev, const GLubyte* cur, GLsizei stridesize, GLsizei linesize, GLsizei lines) { // compare a tile line-by-line, stop at first difference
+  GLsizei i, j;
+  for(i=0;i<lines;i++) {
+    const GLubyte* a = prev + i*stridesize;
+    const GLubyte* b = cur  + i*stridesize;
+    j=0;
+#if defined(__SSE2__)
+    for(;j+16<=linesize;j=j+16) { // 16 bytes at a time
+      __m128i va = _mm_loadu_si128((const __m128i*)(a+j));
+      __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(va,vb))!=0xFFFF) {
+        return true;
+      }
+    }
+#endif
+    for(;j<linesize;j++) { // leftovers
+      if (a[j]!=b[j]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+/** Compare two frames in tiles of tile x tile pixels and fill rects with the changed regions
+ * 
+ * Horizontally adjacent changed tiles are merged into a single rectangle, so that the number of glTexSubImage2D calls stays small.
+ * Returns the number of changed pixels.
+ */
+GLsizei findDirtyRects(const GLubyte* prev, const GLubyte* cur, GLsizei w, GLsizei h, GLsizei bpp, GLsizei tile, std::vector<Rect>& rects) {
+  GLsizei x, y, tw, th, npix;
+  GLsizei stridesize = w*bpp;
+  bool    open;
+  
+  rects.clear();
+  npix = 0;
+  for(y=0;y<h;y=y+tile) {
+    th   = std::min(tile, h-y);
+    open = false;
+    for(x=0;x<w;x=x+tile) {
+      tw = std::min(tile, w-x);
+      if (tileDiffers(prev + y*stridesize + x*bpp, cur + y*stridesize + x*bpp, stridesize, tw*bpp, th)) {
+        if (open) { // extend the previous rectangle
+          rects.back().w += tw;
+        }
+        else {
+          rects.push_back(Rect{x, y, tw, th});
+          open = true;
+        }
+        npix += tw*th;
+      }
+      else {
+        open = false;
+      }
+    }
+  }
+  return npix;
+}
+
+
+void copyRects(GLubyte* dst, const GLubyte* src, GLsizei w, GLsizei bpp, const std::vector<Rect>& rects) { // copy only the given regions between two frames of identical layout (say, frame => pbo)
+  GLsizei i;
+  GLsizei stridesize = w*bpp;
+  for(auto it=rects.begin(); it!=rects.end(); ++it) {
+    for(i=it->y;i<it->y+it->h;i++) {
+      memcpy(dst + i*stridesize + it->x*bpp, src + i*stridesize + it->x*bpp, it->w*bpp);
+    }
+  }
+}
+
+
+/** Upload only the given regions from a PBO into a texture
+ * 
+ * The PBO holds a full frame of width w : GL_UNPACK_ROW_LENGTH, GL_UNPACK_SKIP_PIXELS and GL_UNPACK_SKIP_ROWS pick the sub-rectangle from it.
+ * Returns the number of bytes uploaded.
+ */
+GLsizei uploadRects(GLuint pbo, GLuint tex, GLsizei w, GLsizei bpp, GLenum format, GLenum type, const std::vector<Rect>& rects) {
+  GLsizei nbytes = 0;
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  glBindTexture(GL_TEXTURE_2D, tex); // this is the texture we will manipulate
+  glPixelStorei(GL_UNPACK_ALIGNMENT,  1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+  for(auto it=rects.begin(); it!=rects.end(); ++it) {
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, it->x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS,   it->y);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, it->x, it->y, it->w, it->h, format, type, 0); // copy from pbo to texture 
+    nbytes += it->w*it->h*bpp;
+  }
+  // back to defaults
+  glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+  glPixelStorei(GL_UNPACK_SKIP_ROWS,   0);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH,  0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT,   4);
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+  return nbytes;
+}
+
+
+/** Halve a plane with a 2x2 box filter : dst (w/2 x h/2, packed) is the rounded average of each 2x2 block of src (w x h, packed)
+ * 
+ * 32 source pixels per row pair at a time with SSE2 : even & odd bytes are summed as 16-bit words, so the average is exact.
+ * An odd last column or row is dropped.
+ */
+void downscale2x2(GLubyte* dst, const GLubyte* src, GLsizei w, GLsizei h) {
+  TRACE_SCOPE("downscale");
+  GLsizei x, y, dw, dh;
+  dw = w/2;
+  dh = h/2;
+  for(y=0;y<dh;y++) {
+    const GLubyte* r0 = src + std::size_t(2*y)*w;
+    const GLubyte* r1 = r0 + w;
+    GLubyte*       d  = dst + std::size_t(y)*dw;
+    x=0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i two  = _mm_set1_epi16(2);
+    for(;x+32<=2*dw;x=x+32) {
+      __m128i a0 = _mm_loadu_si128((const __m128i*)(r0+x));
+      __m128i a1 = _mm_loadu_si128((const __m128i*)(r0+x+16));
+      __m128i b0 = _mm_loadu_si128((const __m128i*)(r1+x));
+      __m128i b1 = _mm_loadu_si128((const __m128i*)(r1+x+16));
+      __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                                 _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+      __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                                 _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+      s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+      s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+      _mm_storeu_si128((__m128i*)(d+x/2), _mm_packus_epi16(s0, s1));
+    }
+#endif
+    for(;x<2*dw;x=x+2) {
+      d[x/2] = (r0[x] + r0[x+1] + r1[x] + r1[x+1] + 2) >> 2;
+    }
+  }
+}
+
+/** 16-bit 4:2:0 (PIXFMT_P010 or PIXFMT_I420P10) => 8-bit I420, rounded to nearest : the cpu down-conversion alternative to R16 textures
+ * 
+ * yuv420p10le keeps the 10 bits at the bottom : (v+2)>>2.  P010 keeps them at the top : (v+128)>>8, and its UV plane is deinterleaved.
+ * SSE2 does 16 samples per step (saturating adds for the rounding, so 0xffff can't wrap).
+ */
+void yuv16ToI420(GLubyte* dst, const uint16_t* src, PixelFormat format, GLsizei w, GLsizei h) {
+  TRACE_SCOPE("yuv16 => i420");
+  std::size_t i, n, size, csize;
+  int shift;
+  size  = std::size_t(w)*h;
+  csize = size/4;
+  shift = (format==PIXFMT_P010) ? 8 : 2;
+  
+  auto to8 = [shift](uint16_t v) -> GLubyte {
+    unsigned r = (unsigned(v) + (1u << (shift-1))) >> shift;
+    return r>255 ? 255 : GLubyte(r);
+  };
+  
+#if defined(__SSE2__)
+  const __m128i round = _mm_set1_epi16(1 << (shift-1));
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  auto to8x8 = [&](const uint16_t* p) -> __m128i {
+    return _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i*)p), round), count);
+  };
+#endif
+  
+  // planar part : Y, and U & V for yuv420p10le
+  n = (format==PIXFMT_P010) ? size : size + 2*csize;
+  i = 0;
+#if defined(__SSE2__)
+  for(;i+16<=n;i=i+16) {
+    _mm_storeu_si128((__m128i*)(dst+i), _mm_packus_epi16(to8x8(src+i), to8x8(src+i+8)));
+  }
+#endif
+  for(;i<n;i++) {
+    dst[i] = to8(src[i]);
+  }
+  if (format!=PIXFMT_P010) {
+    return;
+  }
+  
+  // P010 : uvuv.. => uu.. vv..
+  const uint16_t* uv = src + size;
+  GLubyte* u = dst + size;
+  GLubyte* v = dst + size + csize;
+  i = 0;
+#if defined(__SSE2__)
+  const __m128i low = _mm_set1_epi32(0xffff);
+  for(;i+16<=csize;i=i+16) {
+    __m128i a = to8x8(uv+2*i);
+    __m128i b = to8x8(uv+2*i+8);
+    __m128i c = to8x8(uv+2*i+16);
+    __m128i d = to8x8(uv+2*i+24);
+    __m128i u0 = _mm_packs_epi32(_mm_and_si128(a, low), _mm_and_si128(b, low)); // values are <= 256, signed packing is fine
+    __m128i u1 = _mm_packs_epi32(_mm_and_si128(c, low), _mm_and_si128(d, low));
+    __m128i v0 = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+    __m128i v1 = _mm_packs_epi32(_mm_srli_epi32(c, 16), _mm_srli_epi32(d, 16));
+    _mm_storeu_si128((__m128i*)(u+i), _mm_packus_epi16(u0, u1));
+    _mm_storeu_si128((__m128i*)(v+i), _mm_packus_epi16(v0, v1));
+  }
+#endif
+  for(;i<csize;i++) {
+    u[i] = to8(uv[2*i]);
+    v[i] = to8(uv[2*i+1]);
+  }
+}
+
+
+/** 8-bit I420 => PIXFMT_P010 or PIXFMT_I420P10, for test content : samples are scaled to 10 bits (v*1023/255) */
+void i420ToYUV16(uint16_t* dst, const GLubyte* src, PixelFormat format, GLsizei w, GLsizei h) {
+  std::size_t i, size, csize;
+  size  = std::size_t(w)*h;
+  csize = size/4;
+  auto to10 = [](GLubyte v) -> uint16_t {return uint16_t((unsigned(v)*1023 + 127)/255);};
+  if (format==PIXFMT_P010) {
+    for(i=0;i<size;i++) {
+      dst[i] = uint16_t(to10(src[i]) << 6);
+    }
+    for(i=0;i<csize;i++) {
+      dst[size+2*i]   = uint16_t(to10(src[size+i]) << 6);
+      dst[size+2*i+1] = uint16_t(to10(src[size+csize+i]) << 6);
+    }
+  }
+  else {
+    for(i=0;i<size+2*csize;i++) {
+      dst[i] = to10(src[i]);
+    }
+  }
+}
+
+/** Packed 4:2:2 (PIXFMT_YUYV or PIXFMT_UYVY) => I420 on the cpu : the repacking that YUYVShader makes unnecessary, kept as the baseline
+ * 
+ * Chroma of two lines is averaged (rounding up) down to 4:2:0.  SSE2 does 16 pixels of a line pair per step.  h must be even.
+ */
+void packed422ToI420(GLubyte* dst, const GLubyte* src, PixelFormat format, GLsizei w, GLsizei h) {
+  TRACE_SCOPE("422 => i420");
+  GLsizei x, y, cw;
+  int     yo, co; // byte of luma & of U within a pixel pair
+  std::size_t size = std::size_t(w)*h;
+  cw = w/2;
+  yo = (format==PIXFMT_UYVY) ? 1 : 0;
+  co = 1 - yo;
+  
+  for(y=0;y+1<h;y=y+2) {
+    const GLubyte* r0 = src + std::size_t(y)*w*2;
+    const GLubyte* r1 = r0 + std::size_t(w)*2;
+    GLubyte* y0 = dst + std::size_t(y)*w;
+    GLubyte* y1 = y0 + w;
+    GLubyte* u  = dst + size + std::size_t(y/2)*cw;
+    GLubyte* v  = u + size/4;
+    x=0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i low  = _mm_set1_epi32(0xffff);
+    auto luma   = [&](__m128i a) -> __m128i {return yo ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, mask);};
+    auto chroma = [&](__m128i a) -> __m128i {return yo ? _mm_and_si128(a, mask) : _mm_srli_epi16(a, 8);};
+    for(;x+16<=w;x=x+16) {
+      __m128i a0 = _mm_loadu_si128((const __m128i*)(r0+2*x));
+      __m128i a1 = _mm_loadu_si128((const __m128i*)(r0+2*x+16));
+      __m128i b0 = _mm_loadu_si128((const __m128i*)(r1+2*x));
+      __m128i b1 = _mm_loadu_si128((const __m128i*)(r1+2*x+16));
+      _mm_storeu_si128((__m128i*)(y0+x), _mm_packus_epi16(luma(a0), luma(a1)));
+      _mm_storeu_si128((__m128i*)(y1+x), _mm_packus_epi16(luma(b0), luma(b1)));
+      __m128i c0 = _mm_avg_epu16(chroma(a0), chroma(b0)); // u v u v ..
+      __m128i c1 = _mm_avg_epu16(chroma(a1), chroma(b1));
+      __m128i us = _mm_packs_epi32(_mm_and_si128(c0, low), _mm_and_si128(c1, low));
+      __m128i vs = _mm_packs_epi32(_mm_srli_epi32(c0, 16), _mm_srli_epi32(c1, 16));
+      _mm_storel_epi64((__m128i*)(u+x/2), _mm_packus_epi16(us, us));
+      _mm_storel_epi64((__m128i*)(v+x/2), _mm_packus_epi16(vs, vs));
+    }
+#endif
+    for(;x+1<w;x=x+2) {
+      y0[x]   = r0[2*x+yo];
+      y0[x+1] = r0[2*x+2+yo];
+      y1[x]   = r1[2*x+yo];
+      y1[x+1] = r1[2*x+2+yo];
+      u[x/2]  = (r0[2*x+co]   + r1[2*x+co]   + 1) >> 1;
+      v[x/2]  = (r0[2*x+co+2] + r1[2*x+co+2] + 1) >> 1;
+    }
+  }
+}
+
+/** Interleave n U and n V samples into n UV pairs (the chroma plane of NV12)
+ * 
+ * SSE2 does 16 pairs per step.  The destination is typically mapped PBO memory : when it's 16-byte aligned, the stores are
+ * non-temporal, as in streamcopy.
+ */
+void interleaveUV(GLubyte* uv, const GLubyte* u, const GLubyte* v, std::size_t n) {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  if ((uintptr_t(uv) & 15)==0) {
+    for(;i+16<=n;i=i+16) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(u+i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(v+i));
+      _mm_stream_si128((__m128i*)(uv+2*i),    _mm_unpacklo_epi8(a, b));
+      _mm_stream_si128((__m128i*)(uv+2*i+16), _mm_unpackhi_epi8(a, b));
+    }
+    _mm_sfence();
+  }
+  else {
+    for(;i+16<=n;i=i+16) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(u+i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(v+i));
+      _mm_storeu_si128((__m128i*)(uv+2*i),    _mm_unpacklo_epi8(a, b));
+      _mm_storeu_si128((__m128i*)(uv+2*i+16), _mm_unpackhi_epi8(a, b));
+    }
+  }
+#endif
+  for(;i<n;i++) {
+    uv[2*i]   = u[i];
+    uv[2*i+1] = v[i];
+  }
+}
+
+
+/** I420 => NV12 : Y as is, U & V interleaved.  1.5 bytes per pixel, like I420, so one upload of two textures (R8 & RG8) costs no more bus bandwidth than three */
+void packNV12(GLubyte* dst, const GLubyte* i420, GLsizei w, GLsizei h) {
+  TRACE_SCOPE("pack nv12");
+  std::size_t size = std::size_t(w)*h;
+  streamcopy(dst, i420, size);
+  interleaveUV(dst + size, i420 + size, i420 + (5*size)/4, size/4);
+}
+
+
+
+
+
+/* yuv => rgb on the cpu, with the coefficients of the fragment shaders (YUVShader::fragment_shader) :
+ * 
+ * rgb = M * (yuv - (0.0625, 0.5, 0.5)) on [0,1] values, i.e. on [0,255] values :
+ * 
+ *   r = 1.164 * (y - 15.9375)                     + 1.596 * (v - 127.5)
+ *   g = 1.164 * (y - 15.9375) - 0.391 * (u - 127.5) - 0.813 * (v - 127.5)
+ *   b = 1.164 * (y - 15.9375) + 2.018 * (u - 127.5)
+ * 
+ * computed in float & rounded to nearest, so the result matches what the gpu writes into an RGBA8 framebuffer.
+ * A row kernel converts one line of pixels : y, u & v point to the line in each plane (u & v at half horizontal resolution).
+ */
+typedef void (*YUVRowKernel)(GLubyte* rgba, const GLubyte* y, const GLubyte* u, const GLubyte* v, GLsizei w);
+
+
+void yuvrow_c(GLubyte* rgba, const GLubyte* y, const GLubyte* u, const GLubyte* v, GLsizei w) {
+  GLsizei x;
+  float   yf, uf, vf;
+  auto to8 = [](float f) -> GLubyte {return f<=0 ? 0 : (f>=255 ? 255 : GLubyte(f+0.5f));};
+  for(x=0;x<w;x++) {
+    yf = 1.164f*(y[x]-15.9375f);
+    uf = u[x/2]-127.5f;
+    vf = v[x/2]-127.5f;
+    rgba[4*x]   = to8(yf + 1.596f*vf);
+    rgba[4*x+1] = to8(yf - 0.391f*uf - 0.813f*vf);
+    rgba[4*x+2] = to8(yf + 2.018f*uf);
+    rgba[4*x+3] = 255;
+  }
+}
+
+
+#if defined(__SSE2__)
+static inline void yuvStoreRGBA_sse2(GLubyte* rgba, __m128i r16, __m128i g16, __m128i b16) { // 8 pixels of 16-bit r, g, b => 32 bytes of RGBA
+  __m128i r8 = _mm_packus_epi16(r16, r16);
+  __m128i g8 = _mm_packus_epi16(g16, g16);
+  __m128i b8 = _mm_packus_epi16(b16, b16);
+  __m128i rg = _mm_unpacklo_epi8(r8, g8);
+  __m128i ba = _mm_unpacklo_epi8(b8, _mm_set1_epi8(-1));
+  _mm_storeu_si128((__m128i*)rgba,      _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i*)(rgba+16), _mm_unpackhi_epi16(rg, ba));
+}
+
+
+void yuvrow_sse2(GLubyte* rgba, const GLubyte* y, const GLubyte* u, const GLubyte* v, GLsizei w) { // 8 pixels at a time
+  const __m128 cy = _mm_set1_ps(1.164f), oy = _mm_set1_ps(15.9375f), oc = _mm_set1_ps(127.5f);
+  const __m128 rv = _mm_set1_ps(1.596f), gu = _mm_set1_ps(-0.391f), gv = _mm_set1_ps(-0.813f), bu = _mm_set1_ps(2.018f);
+  const __m128i zero = _mm_setzero_si128();
+  GLsizei  x;
+  uint32_t u4, v4;
+  
+  for(x=0;x+8<=w;x=x+8) {
+    memcpy(&u4, u+x/2, 4);
+    memcpy(&v4, v+x/2, 4);
+    __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y+x)), zero);
+    __m128i uu  = _mm_cvtsi32_si128(u4);
+    __m128i vv  = _mm_cvtsi32_si128(v4);
+    __m128i u16 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(uu, uu), zero); // each chroma sample twice
+    __m128i v16 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(vv, vv), zero);
+    __m128i r32[2], g32[2], b32[2];
+    for(int half=0;half<2;half++) {
+      __m128 yf = _mm_cvtepi32_ps(half ? _mm_unpackhi_epi16(y16, zero) : _mm_unpacklo_epi16(y16, zero));
+      __m128 uf = _mm_cvtepi32_ps(half ? _mm_unpackhi_epi16(u16, zero) : _mm_unpacklo_epi16(u16, zero));
+      __m128 vf = _mm_cvtepi32_ps(half ? _mm_unpackhi_epi16(v16, zero) : _mm_unpacklo_epi16(v16, zero));
+      yf = _mm_mul_ps(cy, _mm_sub_ps(yf, oy));
+      uf = _mm_sub_ps(uf, oc);
+      vf = _mm_sub_ps(vf, oc);
+      r32[half] = _mm_cvtps_epi32(_mm_add_ps(yf, _mm_mul_ps(rv, vf)));
+      g32[half] = _mm_cvtps_epi32(_mm_add_ps(yf, _mm_add_ps(_mm_mul_ps(gu, uf), _mm_mul_ps(gv, vf))));
+      b32[half] = _mm_cvtps_epi32(_mm_add_ps(yf, _mm_mul_ps(bu, uf)));
+    }
+    yuvStoreRGBA_sse2(rgba+4*x, _mm_packs_epi32(r32[0], r32[1]), _mm_packs_epi32(g32[0], g32[1]), _mm_packs_epi32(b32[0], b32[1]));
+  }
+  if (x<w) {
+    yuvrow_c(rgba+4*x, y+x, u+x/2, v+x/2, w-x);
+  }
+}
+#endif
+
+
+#if defined(__SSE2__)
+__attribute__((target("avx2")))
+void yuvrow_avx2(GLubyte* rgba, const GLubyte* y, const GLubyte* u, const GLubyte* v, GLsizei w) { // 16 pixels at a time, 8 lanes of float
+  const __m256 cy = _mm256_set1_ps(1.164f), oy = _mm256_set1_ps(15.9375f), oc = _mm256_set1_ps(127.5f);
+  const __m256 rv = _mm256_set1_ps(1.596f), gu = _mm256_set1_ps(-0.391f), gv = _mm256_set1_ps(-0.813f), bu = _mm256_set1_ps(2.018f);
+  GLsizei x;
+  
+  for(x=0;x+16<=w;x=x+16) {
+    __m128i y8  = _mm_loadu_si128((const __m128i*)(y+x));
+    __m128i uu  = _mm_loadl_epi64((const __m128i*)(u+x/2));
+    __m128i vv  = _mm_loadl_epi64((const __m128i*)(v+x/2));
+    __m128i u8  = _mm_unpacklo_epi8(uu, uu); // each chroma sample twice
+    __m128i v8  = _mm_unpacklo_epi8(vv, vv);
+    __m128i r16[2], g16[2], b16[2];
+    for(int half=0;half<2;half++) {
+      __m256 yf = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(half ? _mm_srli_si128(y8, 8) : y8));
+      __m256 uf = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(half ? _mm_srli_si128(u8, 8) : u8));
+      __m256 vf = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(half ? _mm_srli_si128(v8, 8) : v8));
+      yf = _mm256_mul_ps(cy, _mm256_sub_ps(yf, oy));
+      uf = _mm256_sub_ps(uf, oc);
+      vf = _mm256_sub_ps(vf, oc);
+      __m256i r = _mm256_cvtps_epi32(_mm256_add_ps(yf, _mm256_mul_ps(rv, vf)));
+      __m256i g = _mm256_cvtps_epi32(_mm256_add_ps(yf, _mm256_add_ps(_mm256_mul_ps(gu, uf), _mm256_mul_ps(gv, vf))));
+      __m256i b = _mm256_cvtps_epi32(_mm256_add_ps(yf, _mm256_mul_ps(bu, uf)));
+      r16[half] = _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+      g16[half] = _mm_packs_epi32(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1));
+      b16[half] = _mm_packs_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+    }
+    yuvStoreRGBA_sse2(rgba+4*x,    r16[0], g16[0], b16[0]);
+    yuvStoreRGBA_sse2(rgba+4*x+32, r16[1], g16[1], b16[1]);
+  }
+  if (x<w) {
+    yuvrow_c(rgba+4*x, y+x, u+x/2, v+x/2, w-x);
+  }
+}
+#endif
+
+
+/** Pick the row kernel for this cpu
+ * 
+ * @param name   "avx2", "sse2" or "c" to force one (falls back if the cpu can't), NULL = the best available
+ * 
+ * Add a NEON kernel next to yuvrow_sse2 (under __ARM_NEON) and return it here : until then, ARM gets yuvrow_c.
+ */
+YUVRowKernel yuvRowKernel(const char* name=NULL, const char** kind=NULL) {
+  YUVRowKernel kernel = yuvrow_c;
+  const char*  k      = "c";
+#if defined(__SSE2__)
+  if ((!name || strcmp(name, "avx2")==0) && __builtin_cpu_supports("avx2")) {
+    kernel = yuvrow_avx2;
+    k      = "avx2";
+  }
+  else if (!name || strcmp(name, "c")!=0) {
+    kernel = yuvrow_sse2;
+    k      = "sse2";
+  }
+#endif
+  if (kind) {
+    *kind = k;
+  }
+  return kernel;
+}
+
+
+/** Convert an I420 frame to RGBA, say, straight into mapped PBO memory
+ * 
+ * @param rgba     w*h*4 bytes
+ * @param frame    I420, w x h (even)
+ * @param workers  rows are split between its threads.  NULL = this thread only
+ * @param kernel   row kernel.  NULL = yuvRowKernel()
+ * 
+ */
+void yuvToRGBA(GLubyte* rgba, const GLubyte* frame, GLsizei w, GLsizei h, WorkerPool* workers=NULL, YUVRowKernel kernel=NULL) {
+  TRACE_SCOPE("yuv => rgba");
+  static const YUVRowKernel best = yuvRowKernel();
+  std::size_t    size = std::size_t(w)*h;
+  const GLubyte* y    = frame;
+  const GLubyte* u    = frame+size;
+  const GLubyte* v    = frame+(5*size)/4;
+  int            nslices;
+  
+  if (!kernel) {
+    kernel = best;
+  }
+  nslices = workers ? std::min(workers->getThreads()*2, h/2) : 1; // a couple of slices per thread evens out the load
+  auto slice = [=](int i) {
+    TRACE_SCOPE("yuv => rgba slice");
+    GLsizei row0 = 2*((h/2)*i/nslices);      // even rows : a chroma line serves two luma lines
+    GLsizei row1 = 2*((h/2)*(i+1)/nslices);
+    for(GLsizei row=row0;row<row1;row++) {
+      kernel(rgba+std::size_t(row)*w*4, y+std::size_t(row)*w, u+std::size_t(row/2)*(w/2), v+std::size_t(row/2)*(w/2), w);
+    }
+  };
+  if (nslices<2) {
+    slice(0);
+  }
+  else {
+    workers->run(nslices, slice);
+  }
+}
+
+
+
+MetricHistogram::MetricHistogram(const std::vector<double>& bounds) : bounds(bounds), counts(new std::atomic<uint64_t>[bounds.size()+1]), count(0), sum(0) {
+  std::size_t i;
+  for(i=0;i<=bounds.size();i++) {
+    counts[i].store(0);
+  }
+}
+
+
+void MetricHistogram::observe(double v) {
+  std::size_t i = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin(); // first bound >= v : prometheus' "le"
+  counts[i].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(uint64_t(std::max(0.0, v)*1e9), std::memory_order_relaxed);
+}
+
+
+MetricsRegistry& MetricsRegistry::get() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+
+MetricsRegistry::Metric& MetricsRegistry::find(const std::string& name, const std::string& labels, const std::string& help, Type type) {
+  for(auto it=metrics.begin(); it!=metrics.end(); ++it) {
+    if (it->name==name && it->labels==labels && it->type==type) {
+      return *it;
+    }
+  }
+  metrics.push_back(Metric());
+  Metric& metric = metrics.back();
+  metric.name   = name;
+  metric.labels = labels;
+  metric.help   = help;
+  metric.type   = type;
+  return metric;
+}
+
+
+MetricCounter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+  std::unique_lock<std::mutex> lk(mutex);
+  Metric& metric = find(name, labels, help, METRIC_COUNTER);
+  if (!metric.counter) {
+    metric.counter.reset(new MetricCounter());
+  }
+  return *metric.counter;
+}
+
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+  std::unique_lock<std::mutex> lk(mutex);
+  Metric& metric = find(name, labels, help, METRIC_GAUGE);
+  if (!metric.gauge) {
+    metric.gauge.reset(new MetricGauge());
+  }
+  return *metric.gauge;
+}
+
+
+MetricHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const std::string& labels) {
+  std::unique_lock<std::mutex> lk(mutex);
+  Metric& metric = find(name, labels, help, METRIC_HISTOGRAM);
+  if (!metric.histogram) {
+    metric.histogram.reset(new MetricHistogram(bounds));
+  }
+  return *metric.histogram;
+}
+
+
+const std::vector<double>& MetricsRegistry::timeBuckets() {
+  static const std::vector<double> bounds = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.02, 0.04, 0.1, 0.25, 1};
+  return bounds;
+}
+
+
+std::string MetricsRegistry::label(const char* key, int value) {
+  return std::string(key) + "=\"" + std::to_string(value) + "\"";
+}
+
+
+void MetricsRegistry::write(std::ostream& out) {
+  std::size_t i;
+  uint64_t    cumulative;
+  std::vector<std::string> names; // families in registration order : the samples of a family must be together
+  
+  auto braces = [](const std::string& labels, const std::string& more) -> std::string {
+    std::string all = labels.empty() ? more : (more.empty() ? labels : labels + "," + more);
+    return all.empty() ? "" : "{" + all + "}";
+  };
+  
+  std::unique_lock<std::mutex> lk(mutex);
+  for(auto it=metrics.begin(); it!=metrics.end(); ++it) {
+    if (std::find(names.begin(), names.end(), it->name)==names.end()) {
+      names.push_back(it->name);
+    }
+  }
+  for(auto name=names.begin(); name!=names.end(); ++name) {
+    bool described = false; // HELP & TYPE once per family
+    for(auto it=metrics.begin(); it!=metrics.end(); ++it) {
+      if (it->name!=*name) {
+        continue;
+      }
+      if (!described) {
+        const char* type = (it->type==METRIC_COUNTER) ? "counter" : ((it->type==METRIC_GAUGE) ? "gauge" : "histogram");
+        out << "# HELP " << it->name << " " << it->help << "\n";
+        out << "# TYPE " << it->name << " " << type << "\n";
+        described = true;
+      }
+      switch (it->type) {
+        case(METRIC_COUNTER):
+          out << it->name << braces(it->labels, "") << " " << it->counter->get() << "\n";
+          break;
+        case(METRIC_GAUGE):
+          out << it->name << braces(it->labels, "") << " " << it->gauge->get() << "\n";
+          break;
+        case(METRIC_HISTOGRAM): {
+          MetricHistogram& h = *it->histogram;
+          cumulative = 0;
+          for(i=0;i<=h.bounds.size();i++) {
+            std::ostringstream le;
+            if (i<h.bounds.size()) {
+              le << "le=\"" << h.bounds[i] << "\"";
+            }
+            else {
+              le << "le=\"+Inf\"";
+            }
+            cumulative += h.counts[i].load(std::memory_order_relaxed);
+            out << it->name << "_bucket" << braces(it->labels, le.str()) << " " << cumulative << "\n";
+          }
+          out << it->name << "_sum" << braces(it->labels, "") << " " << h.sum.load(std::memory_order_relaxed)/1e9 << "\n";
+          out << it->name << "_count" << braces(it->labels, "") << " " << h.count.load(std::memory_order_relaxed) << "\n";
+          break;
+        }
+      }
+    }
+  }
+}
+
+
+bool MetricsRegistry::writeFile(const char* fname) {
+  std::string tmp = std::string(fname) + ".tmp";
+  {
+    std::ofstream out(tmp);
+    if (!out) {
+      std::cerr << "MetricsRegistry : writeFile : could not open " << tmp << std::endl;
+      return false;
+    }
+    write(out);
+    if (!out) {
+      return false;
+    }
+  }
+  return rename(tmp.c_str(), fname)==0; // readers see the old file or the new one, never half of it
+}
+
+
+MetricsExporter::MetricsExporter(const std::string& fname, const std::string& socket_path, double interval) : fname(fname), socket_path(socket_path), interval(interval), listen_fd(-1), running(true) {
+  struct sockaddr_un addr;
+  
+  if (!socket_path.empty()) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path)-1);
+    unlink(socket_path.c_str()); // a stale socket of a previous run
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd<0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr))!=0 || listen(listen_fd, 8)!=0) {
+      std::cerr << "MetricsExporter : could not listen on " << socket_path << " : " << strerror(errno) << std::endl;
+      if (listen_fd>=0) {
+        close(listen_fd);
+      }
+      listen_fd = -1;
+    }
+    else {
+      std::cerr << "MetricsExporter : serving metrics on unix socket " << socket_path << std::endl;
+    }
+  }
+  thread = std::thread(&MetricsExporter::loop, this);
+}
+
+
+MetricsExporter::~MetricsExporter() {
+  running = false;
+  thread.join();
+  if (listen_fd>=0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+  if (!fname.empty()) {
+    MetricsRegistry::get().writeFile(fname.c_str());
+  }
+}
+
+
+void MetricsExporter::loop() {
+  int           fd;
+  struct pollfd pfd;
+  std::string   text;
+  auto          next = std::chrono::steady_clock::now();
+  
+  TRACE_THREAD_NAME("metrics");
+  while (running) {
+    if (!fname.empty() && std::chrono::steady_clock::now()>=next) {
+      MetricsRegistry::get().writeFile(fname.c_str());
+      next = next + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+    }
+    if (listen_fd<0) {
+      sleep_for(std::chrono::milliseconds(100)); // short, so that the destructor doesn't wait long
+      continue;
+    }
+    pfd.fd     = listen_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100)<=0) {
+      continue;
+    }
+    fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd<0) {
+      continue;
+    }
+    struct timeval timeout = {1, 0}; // a reader that doesn't read must not stall the exporter
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))<0) {
+      std::cerr << "MetricsExporter : setsockopt(SO_SNDTIMEO) failed (" << strerror(errno) << ") : dropping the connection" << std::endl;
+      close(fd);
+      continue;
+    }
+    std::ostringstream out;
+    MetricsRegistry::get().write(out);
+    text = out.str();
+    for(std::size_t sent=0; sent<text.size();) {
+      ssize_t n = send(fd, text.data()+sent, text.size()-sent, MSG_NOSIGNAL); // no SIGPIPE if the reader went away
+      if (n<=0) {
+        break;
+      }
+      sent += n;
+    }
+    close(fd);
+  }
+}
+
+
+Tracer& Tracer::get() {
+  static Tracer tracer;
+  return tracer;
+}
+
+
+Tracer::Tracer() : enabled(false), t0(std::chrono::steady_clock::now()), capacity(1<<16) {
+}
+
+
+TraceBuffer::TraceBuffer(std::size_t capacity) : events(capacity), count(0), tid(syscall(SYS_gettid)), exited(false) {
+}
+
+
+void Tracer::start(std::size_t capacity) {
+  std::unique_lock<std::mutex> lk(mutex);
+  std::size_t n = 1;
+  while (n<capacity) { // round up to a power of two
+    n = n*2;
+  }
+  this->capacity = n;
+  buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const std::unique_ptr<TraceBuffer>& buffer) {return buffer->exited;}),
+                buffers.end()); // events of the previous trace only
+  for(auto it=buffers.begin(); it!=buffers.end(); ++it) {
+    if ((*it)->events.size()!=n) {
+      (*it)->events.assign(n, TraceEvent{NULL, 0, 0});
+    }
+    (*it)->count.store(0);
+  }
+  t0 = std::chrono::steady_clock::now();
+  enabled.store(true);
+}
+
+
+void Tracer::stop() {
+  enabled.store(false);
+}
+
+
+Tracer::ThreadState& Tracer::threadState() {
+  static thread_local ThreadState state;
+  return state;
+}
+
+
+Tracer::ThreadState::~ThreadState() {
+  if (buffer) {
+    Tracer& tracer = Tracer::get();
+    std::unique_lock<std::mutex> lk(tracer.mutex);
+    buffer->exited = true;
+  }
+}
+
+
+TraceBuffer* Tracer::threadBuffer() {
+  ThreadState& state = threadState();
+  if (!state.buffer && isEnabled()) { // no memory for threads that never record
+    std::unique_lock<std::mutex> lk(mutex);
+    buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer(capacity)));
+    state.buffer = buffers.back().get();
+    if (state.name) {
+      state.buffer->name = state.name;
+    }
+  }
+  return state.buffer;
+}
+
+
+void Tracer::setThreadName(const char* name) {
+  ThreadState& state = threadState();
+  state.name = name;
+  if (state.buffer) {
+    std::unique_lock<std::mutex> lk(mutex);
+    state.buffer->name = name;
+  }
+}
+
+
+uint64_t Tracer::getDropped() {
+  uint64_t dropped = 0;
+  std::unique_lock<std::mutex> lk(mutex);
+  for(auto it=buffers.begin(); it!=buffers.end(); ++it) {
+    uint64_t n = (*it)->count.load(std::memory_order_acquire);
+    dropped += n>(*it)->events.size() ? n-(*it)->events.size() : 0;
+  }
+  return dropped;
+}
+
+
+bool Tracer::write(const char* fname) {
+  uint64_t i, n, first, events;
+  bool     comma;
+  long     pid = getpid();
+  
+  std::ofstream out(fname);
+  if (!out) {
+    std::cerr << "Tracer : write : could not open " << fname << std::endl;
+    return false;
+  }
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+  comma  = false;
+  events = 0;
+  out << std::fixed << std::setprecision(3);
+  std::unique_lock<std::mutex> lk(mutex);
+  for(auto it=buffers.begin(); it!=buffers.end(); ++it) {
+    TraceBuffer& buffer = **it;
+    if (!buffer.name.empty()) {
+      out << (comma ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+          << ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+      comma = true;
+    }
+    n     = buffer.count.load(std::memory_order_acquire);
+    first = n>buffer.events.size() ? n-buffer.events.size() : 0; // the rest has been overwritten
+    for(i=first;i<n;i++) {
+      const TraceEvent& e = buffer.events[i & (buffer.events.size()-1)];
+      out << (comma ? ",\n" : "") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"ts\":" << e.ts/1000.0 << ",\"dur\":" << e.dur/1000.0
+          << ",\"pid\":" << pid << ",\"tid\":" << buffer.tid << "}";
+      comma = true;
+      events++;
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+  std::cerr << "Tracer : wrote " << events << " events of " << buffers.size() << " threads to " << fname << std::endl;
+  return bool(out);
+}
+
+
+Shader::Shader() {
+  /*
+  compile(); // woops.. at constructor time, overwritten virtual methods are NOT called
+  use();
+  findVars();
+  */
+}
+
+Shader::~Shader() {
+  glDeleteProgram(this->program);
+}
+
+
+void Shader::compile() {
+  GLuint id_vertex_shader, id_fragment_shader;
+  const char *source;
+  int length, cc;
+  GLint success;
+  GLchar infoLog[512];
+  
+  std::cout << "Shader: compile: " <<std::endl;
+  std::cout << "Shader: compile: vertex program=" << std::endl << vertex_shader() << std::endl;
+  std::cout << "Shader: compile: fragment program=" << std::endl << fragment_shader() << std::endl;
+  
+  // create and compiler vertex shader
+  source=vertex_shader();
+  id_vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+  length = std::strlen(source);
+  glShaderSource(id_vertex_shader, 1, &source, &length); 
+  glCompileShader(id_vertex_shader);
+  glGetShaderiv(id_vertex_shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(id_vertex_shader, 512, NULL, infoLog);
+    std::cout << "Shader: compile: vertex shader program (len="<<length<<") COMPILATION FAILED!" << std::endl << infoLog << std::endl;
+  }
+
+  // create and compiler fragment shader
+  source=fragment_shader();
+  id_fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+  length = std::strlen(source);
+  glShaderSource(id_fragment_shader, 1, &source, &length);   
+  glCompileShader(id_fragment_shader);
+  glGetShaderiv(id_fragment_shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(id_fragment_shader, 512, NULL, infoLog);
+    std::cout << "Shader: compile: fragment shader program (len="<<length<<") COMPILATION FAILED!" << std::endl << infoLog << std::endl;
+  }
+
+  // Shader Program
+  this->program = glCreateProgram();
+  std::cout << "Shader: compile: program index=" << this->program << "\n";
+  
+  glAttachShader(this->program, id_vertex_shader);
+  glAttachShader(this->program, id_fragment_shader);
+  glLinkProgram(this->program);
+  // Print linking errors if any
+  glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    glGetProgramInfoLog(this->program, 512, NULL, infoLog);
+    std::cout << "Shader: compile: fragment shader LINKING FAILED!" << std::endl << infoLog << std::endl;
+  }
+  // Delete the shaders as they're linked into our program now and no longer necessery
+  glDeleteShader(id_vertex_shader);
+  glDeleteShader(id_fragment_shader);
+}
+
+
+void Shader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "Shader: findVars: Location of the transform matrix: " << transform << std::endl;
+}
+
+
+void Shader::scale(GLfloat fx, GLfloat fy) {
+  GLfloat mat[4][4] = {
+    {fx,               0.0f,             0.0f,   0.0f}, 
+    {0.0f,             fy,               0.0f,   0.0f},
+    {0.0f,             0.0f,             1.0f,   0.0f},
+    {0.0f,             0.0f,             0.0f,   1.0f}
+  };
+  glUniformMatrix4fv(transform, 1, GL_FALSE, mat[0]);
+}
+
+
+void Shader::use() {
+  std::cout << "Shader: use: using program index=" << this->program << std::endl;
+  glUseProgram(this->program);
+}
+
+
+void Shader::validate() {
+  GLint params, maxLength;
+  //The maxLength includes the NULL character
+  // std::vector<GLchar> infoLog(maxLength);
+  
+  std::cout << std::endl << "Shader: validating program index=" << program << std::endl;
+  std::cout              << "Shader: is program              =" << bool(glIsProgram(program)) << std::endl;
+  glValidateProgram(program);
+  glGetProgramiv(program,GL_VALIDATE_STATUS,&params);
+  std::cout              << "Shader: validate status         =" << params << std::endl;
+  glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);  
+  char infoLog[maxLength];
+
+  glGetProgramInfoLog(program, maxLength, &maxLength, &infoLog[0]);
+  std::cout              << "Shader: infoLog length          =" << maxLength << std::endl;
+  std::cout              << "Shader: infoLog                 =" << std::string(infoLog) << std::endl;
+  std::cout << std::endl;
+  
+}
+
+
+YUVShader::YUVShader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUVShader::~YUVShader() {
+}
+
+
+void YUVShader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  std::cout << "YUVShader: findVars: Location of position: " << position << std::endl;
+  std::cout << "YUVShader: findVars: Location of texcoord: " << texcoord << std::endl;
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "YUVShader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texy=glGetUniformLocation(program,"texy");
+  std::cout << "YUVShader: findVars: Location of texy: " << texy << std::endl;
+  
+  texu=glGetUniformLocation(program,"texu");
+  std::cout << "YUVShader: findVars: Location of texu: " << texu << std::endl;
+  
+  texv=glGetUniformLocation(program,"texv");
+  std::cout << "YUVShader: findVars: Location of texv: " << texv << std::endl;
+}
+
+
+
+/*** YUV Shader Program ***/
+
+const char* YUVShader::vertex_shader () { return 
+// shader vertex source code
+// We swap the y-axis by substracing our coordinates from 1.
+// This is done because most images have the top y-axis
+// inversed with OpenGL's top y-axis.
+// TexCoord = texcoord;
+"#version 300 es\n"
+"precision mediump float;\n"
+// "in vec2 scaling;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+// "  gl_Position = vec4(position, 1.0f) * vec4(scaling,1.0f,1.0f);\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* YUVShader::fragment_shader  () { return
+"#version 300 es\n"
+"precision mediump float;\n"
+"in vec3 ourColor;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D texy; // Y \n"
+"uniform sampler2D texu; // U \n"
+"uniform sampler2D texv; // V \n"
+"out vec4 colour;\n"
+" // \n"
+"vec3 yuv2rgb(in vec3 yuv) \n"
+"{ \n"
+"    // YUV offset  \n"
+"    // const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"
+"    const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"  
+"    // RGB coefficients \n"
+"    const vec3 Rcoeff = vec3( 1.164, 0.000,  1.596); \n"
+"    const vec3 Gcoeff = vec3( 1.164, -0.391, -0.813); \n"
+"    const vec3 Bcoeff = vec3( 1.164, 2.018,  0.000); \n"  
+"    vec3 rgb; \n"
+"    yuv = clamp(yuv, 0.0, 1.0); \n"
+"    yuv += offset; \n"
+"    rgb.r = dot(yuv, Rcoeff);  \n"
+"    rgb.g = dot(yuv, Gcoeff); \n"  
+"    rgb.b = dot(yuv, Bcoeff); \n"  
+"    return rgb; \n"
+"} \n"
+" // \n"
+"vec3 get_yuv_from_texture(in vec2 tcoord) \n"
+"{ \n"
+"    vec3 yuv; \n"
+"    yuv.x = texture(texy, tcoord).r; \n"
+"    // Get the U and V values \n"
+"    yuv.y = texture(texu, tcoord).r; \n"
+"    yuv.z = texture(texv, tcoord).r; \n"
+"    return yuv; \n"
+"} \n"
+" // \n"
+"vec4 mytexture2D(in vec2 tcoord) \n"
+"{ \n"
+"    vec3 rgb, yuv; \n"
+"    yuv = get_yuv_from_texture(tcoord); \n"
+"    // Do the color transform \n"
+"    rgb = yuv2rgb(yuv); \n"
+"    return vec4(rgb, 1.0); \n"
+"} \n"
+" // \n"
+"void main()\n"
+"{\n"
+" //      color = texture(ourTexture1, TexCoord); \n"
+"   colour = mytexture2D(TexCoord); \n"
+"}\n";
+}
+
+
+
+YUVBlockShader::YUVBlockShader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUVBlockShader::~YUVBlockShader() {
+}
+
+
+void YUVBlockShader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  std::cout << "YUVBlockShader: findVars: Location of position: " << position << std::endl;
+  std::cout << "YUVBlockShader: findVars: Location of texcoord: " << texcoord << std::endl;
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "YUVBlockShader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texBlock=glGetUniformLocation(program,"texBlock");
+  std::cout << "YUVBlockShader: findVars: Location of texBlock: " << texBlock << std::endl;
+  
+  /*
+  texy=glGetUniformLocation(program,"texy");
+  std::cout << "YUVBlockShader: findVars: Location of texy: " << texy << std::endl;
+  
+  texu=glGetUniformLocation(program,"texu");
+  std::cout << "YUVBlockShader: findVars: Location of texu: " << texu << std::endl;
+  
+  texv=glGetUniformLocation(program,"texv");
+  std::cout << "YUVBlockShader: findVars: Location of texv: " << texv << std::endl;
+  */
+}
+
+
+
+/*** YUV Shader Program ***/
+
+const char* YUVBlockShader::vertex_shader () { return 
+// shader vertex source code
+// We swap the y-axis by substracing our coordinates from 1.
+// This is done because most images have the top y-axis
+// inversed with OpenGL's top y-axis.
+// TexCoord = texcoord;
+"#version 300 es\n"
+"precision mediump float;\n"
+// "in vec2 scaling;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+// "  gl_Position = vec4(position, 1.0f) * vec4(scaling,1.0f,1.0f);\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* YUVBlockShader::fragment_shader  () { return
+"#version 300 es\n"
+"precision mediump float;\n"
+"in vec3 ourColor;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D texBlock; \n" // the bgr texture
+"out vec4 colour;\n"
+" // \n"
+"vec3 yuv2rgb(in vec3 yuv) \n"
+"{ \n"
+"    // YUV offset  \n"
+"    // const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"
+"    const vec3 offset = vec3(-0.0625, -0.5, -0.5); \n"  
+"    // RGB coefficients \n"
+"    const vec3 Rcoeff = vec3( 1.164, 0.000,  1.596); \n"
+"    const vec3 Gcoeff = vec3( 1.164, -0.391, -0.813); \n"
+"    const vec3 Bcoeff = vec3( 1.164, 2.018,  0.000); \n"  
+"    vec3 rgb; \n"
+"    yuv = clamp(yuv, 0.0, 1.0); \n"
+"    yuv += offset; \n"
+"    rgb.r = dot(yuv, Rcoeff);  \n"
+"    rgb.g = dot(yuv, Gcoeff); \n"  
+"    rgb.b = dot(yuv, Bcoeff); \n"  
+"    return rgb; \n"
+"} \n"
+" // \n"
+"vec3 get_yuv_from_texture(in vec2 tcoord) \n"
+"{ \n"
+"    vec3 yuv; \n"
+"    yuv.x = texture(texBlock, tcoord).b; \n" // yuv is carried in bgr
+"    // Get the U and V values \n"
+"    yuv.y = texture(texBlock, tcoord).g; \n"
+"    yuv.z = texture(texBlock, tcoord).r; \n"
+"    return yuv; \n"
+"} \n"
+" // \n"
+"vec4 mytexture2D(in vec2 tcoord) \n"
+"{ \n"
+"    vec3 rgb, yuv; \n"
+"    yuv = get_yuv_from_texture(tcoord); \n"
+"    // Do the color transform \n"
+"    rgb = yuv2rgb(yuv); \n"
+"    return vec4(rgb, 1.0); \n"
+"} \n"
+" // \n"
+"void main()\n"
+"{\n"
+"   // colour = texture(texBlock, TexCoord); \n"
+"   colour = mytexture2D(TexCoord); \n"
+"}\n";
+}
+
+
+// bt.601 video range yuv => rgb, shared by the fragment shaders below
+#define YUV2RGB_GLSL \
+"vec3 yuv2rgb(in vec3 yuv)\n" \
+"{\n" \
+"  const vec3 offset = vec3(-0.0625, -0.5, -0.5);\n" \
+"  const vec3 Rcoeff = vec3( 1.164,  0.000,  1.596);\n" \
+"  const vec3 Gcoeff = vec3( 1.164, -0.391, -0.813);\n" \
+"  const vec3 Bcoeff = vec3( 1.164,  2.018,  0.000);\n" \
+"  vec3 rgb;\n" \
+"  yuv = clamp(yuv, 0.0, 1.0);\n" \
+"  yuv += offset;\n" \
+"  rgb.r = dot(yuv, Rcoeff);\n" \
+"  rgb.g = dot(yuv, Gcoeff);\n" \
+"  rgb.b = dot(yuv, Bcoeff);\n" \
+"  return rgb;\n" \
+"}\n"
+
+
+YUVNV12Shader::YUVNV12Shader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUVNV12Shader::~YUVNV12Shader() {
+}
+
+
+void YUVNV12Shader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "YUVNV12Shader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texy=glGetUniformLocation(program,"texy");
+  std::cout << "YUVNV12Shader: findVars: Location of texy: " << texy << std::endl;
+  
+  texuv=glGetUniformLocation(program,"texuv");
+  std::cout << "YUVNV12Shader: findVars: Location of texuv: " << texuv << std::endl;
+}
+
+
+const char* YUVNV12Shader::vertex_shader () { return 
+"#version 300 es\n"
+"precision mediump float;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* YUVNV12Shader::fragment_shader  () { return
+"#version 300 es\n"
+"precision mediump float;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D texy; // Y \n"
+"uniform sampler2D texuv; // UV \n"
+"out vec4 colour;\n"
+YUV2RGB_GLSL
+"void main()\n"
+"{\n"
+"  vec3 yuv;\n"
+"  yuv.x  = texture(texy, TexCoord).r;\n"
+"  yuv.yz = texture(texuv, TexCoord).rg;\n"
+"  colour = vec4(yuv2rgb(yuv), 1.0);\n"
+"}\n";
+}
+
+
+RGBShader::RGBShader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+RGBShader::~RGBShader() {
+}
+
+
+void RGBShader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "RGBShader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texrgb=glGetUniformLocation(program,"texrgb");
+  std::cout << "RGBShader: findVars: Location of texrgb: " << texrgb << std::endl;
+}
+
+
+const char* RGBShader::vertex_shader () { return 
+"#version 300 es\n"
+"precision mediump float;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* RGBShader::fragment_shader  () { return
+"#version 300 es\n"
+"precision mediump float;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D texrgb;\n"
+"out vec4 colour;\n"
+"void main()\n"
+"{\n"
+"  colour = vec4(texture(texrgb, TexCoord).rgb, 1.0);\n"
+"}\n";
+}
+
+
+YUV16Shader::YUV16Shader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUV16Shader::~YUV16Shader() {
+}
+
+
+void YUV16Shader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "YUV16Shader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texy=glGetUniformLocation(program,"texy");
+  std::cout << "YUV16Shader: findVars: Location of texy: " << texy << std::endl;
+  
+  texu=glGetUniformLocation(program,"texu");
+  std::cout << "YUV16Shader: findVars: Location of texu: " << texu << std::endl;
+  
+  texv=glGetUniformLocation(program,"texv");
+  std::cout << "YUV16Shader: findVars: Location of texv: " << texv << std::endl;
+  
+  scale=glGetUniformLocation(program,"scale");
+  std::cout << "YUV16Shader: findVars: Location of scale: " << scale << std::endl;
+  
+  interleaved=glGetUniformLocation(program,"interleaved");
+  std::cout << "YUV16Shader: findVars: Location of interleaved: " << interleaved << std::endl;
+}
+
+
+const char* YUV16Shader::vertex_shader () { return 
+"#version 300 es\n"
+"precision highp float;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* YUV16Shader::fragment_shader  () { return
+"#version 300 es\n"
+"precision highp float;\n" // mediump (fp16) can't hold 16-bit samples
+"in vec2 TexCoord;\n"
+"uniform sampler2D texy; // Y \n"
+"uniform sampler2D texu; // U, or UV \n"
+"uniform sampler2D texv; // V \n"
+"uniform float scale;\n"
+"uniform int interleaved;\n"
+"out vec4 colour;\n"
+YUV2RGB_GLSL
+"void main()\n"
+"{\n"
+"  vec3 yuv;\n"
+"  yuv.x = texture(texy, TexCoord).r;\n"
+"  if (interleaved == 1) {\n"
+"    yuv.yz = texture(texu, TexCoord).rg;\n"
+"  }\n"
+"  else {\n"
+"    yuv.y = texture(texu, TexCoord).r;\n"
+"    yuv.z = texture(texv, TexCoord).r;\n"
+"  }\n"
+"  colour = vec4(yuv2rgb(yuv * scale), 1.0);\n"
+"}\n";
+}
+
+
+YUYVShader::YUYVShader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUYVShader::~YUYVShader() {
+}
+
+
+void YUYVShader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  
+  transform=glGetUniformLocation(program,"transform");
+  std::cout << "YUYVShader: findVars: Location of the transform matrix: " << transform << std::endl;
+  
+  texyuyv=glGetUniformLocation(program,"texyuyv");
+  std::cout << "YUYVShader: findVars: Location of texyuyv: " << texyuyv << std::endl;
+  
+  uyvy=glGetUniformLocation(program,"uyvy");
+  std::cout << "YUYVShader: findVars: Location of uyvy: " << uyvy << std::endl;
+}
+
+
+const char* YUYVShader::vertex_shader () { return 
+"#version 300 es\n"
+"precision mediump float;\n"
+"uniform mat4 transform;\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"void main()\n"
+"{\n"
+"  gl_Position = transform * vec4(position, 1.0f);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"}\n";
+}
+
+const char* YUYVShader::fragment_shader  () { return
+"#version 300 es\n"
+"precision highp float;\n" // pixel columns of a 4K frame don't fit mediump
+"in vec2 TexCoord;\n"
+"uniform sampler2D texyuyv;\n"
+"uniform int uyvy;\n"
+"out vec4 colour;\n"
+YUV2RGB_GLSL
+"void main()\n"
+"{\n"
+"  ivec2 size = textureSize(texyuyv, 0);\n"         // w/2 x h
+"  ivec2 pix  = ivec2(TexCoord * vec2(2 * size.x, size.y));\n"
+"  pix = clamp(pix, ivec2(0), ivec2(2 * size.x - 1, size.y - 1));\n"
+"  vec4  p    = texelFetch(texyuyv, ivec2(pix.x / 2, pix.y), 0);\n"
+"  bool  odd  = (pix.x & 1) == 1;\n"
+"  vec3 yuv;\n"
+"  if (uyvy == 1) {\n"
+"    yuv = vec3(odd ? p.a : p.g, p.r, p.b);\n"
+"  }\n"
+"  else {\n"
+"    yuv = vec3(odd ? p.b : p.r, p.g, p.a);\n"
+"  }\n"
+"  colour = vec4(yuv2rgb(yuv), 1.0);\n"
+"}\n";
+}
+
+
+YUVTileShader::YUVTileShader() : Shader() {
+  compile();
+  use();
+  findVars();
+}
+
+YUVTileShader::~YUVTileShader() {
+}
+
+
+void YUVTileShader::findVars() {
+  position=0; // this is hard-coded into the shader code (see "location=0")
+  texcoord=1; // this is hard-coded into the shader code (see "location=1")
+  transform=-1; // per tile, in the uniform block
+  
+  texy=glGetUniformLocation(program,"texy");
+  std::cout << "YUVTileShader: findVars: Location of texy: " << texy << std::endl;
+  
+  texu=glGetUniformLocation(program,"texu");
+  std::cout << "YUVTileShader: findVars: Location of texu: " << texu << std::endl;
+  
+  texv=glGetUniformLocation(program,"texv");
+  std::cout << "YUVTileShader: findVars: Location of texv: " << texv << std::endl;
+  
+  params=glGetUniformBlockIndex(program,"FrameParams");
+  std::cout << "YUVTileShader: findVars: Index of the FrameParams block: " << params << std::endl;
+  glUniformBlockBinding(program, params, 0); // binding point 0
+  
+  // sampler units never change
+  glUniform1i(texy, 0);
+  glUniform1i(texu, 1);
+  glUniform1i(texv, 2);
+}
+
+
+// the uniform block, identical in both stages.  C++ side : TileParams & FrameParams
+#define YUV_TILE_PARAMS_GLSL \
+"struct Tile {\n" \
+"  mat4  transform;\n"    /* aspect ratio correction */ \
+"  vec4  rect;\n"         /* x0, y0, x1, y1 in normalized device coordinates */ \
+"  highp ivec4 layer;\n"  /* x : texture array layer.  highp : the default int precision differs between the stages */ \
+"};\n" \
+"layout (std140) uniform FrameParams {\n" \
+"  mat4 colour;\n"        /* yuv => rgb, offsets in the last column */ \
+"  Tile tiles[128];\n" \
+"};\n"
+
+const char* YUVTileShader::vertex_shader () { return 
+"#version 300 es\n"
+"precision mediump float;\n"
+YUV_TILE_PARAMS_GLSL
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec2 texcoord;\n"
+"out vec2 TexCoord;\n"
+"flat out float Layer;\n"
+"void main()\n"
+"{\n"
+"  Tile tile = tiles[gl_InstanceID];\n"
+"  vec4 p = tile.transform * vec4(position, 1.0f);\n"
+"  gl_Position = vec4(mix(tile.rect.xy, tile.rect.zw, (p.xy + 1.0) * 0.5), 0.0, 1.0);\n"
+"  TexCoord = vec2(texcoord.x, 1.0 - texcoord.y);\n"
+"  Layer = float(tile.layer.x);\n"
+"}\n";
+}
+
+const char* YUVTileShader::fragment_shader  () { return
+"#version 300 es\n"
+"precision mediump float;\n"
+"precision mediump sampler2DArray;\n"
+YUV_TILE_PARAMS_GLSL
+"in vec2 TexCoord;\n"
+"flat in float Layer;\n"
+"uniform sampler2DArray texy; // Y \n"
+"uniform sampler2DArray texu; // U \n"
+"uniform sampler2DArray texv; // V \n"
+"out vec4 colour_;\n"
+"void main()\n"
+"{\n"
+"  vec3 tc = vec3(TexCoord, Layer);\n"
+"  vec4 yuv = vec4(texture(texy, tc).r, texture(texu, tc).r, texture(texv, tc).r, 1.0);\n"
+"  colour_ = vec4((colour * clamp(yuv, 0.0, 1.0)).rgb, 1.0);\n"
+"}\n";
+}
+
+
+
+const int    GLStateCache::max_units;
+const GLuint GLStateCache::unknown;
+
+
+GLStateCache::GLStateCache() : enabled(true) {
+  invalidate();
+  resetStats();
+}
+
+
+GLStateCache::~GLStateCache() {
+}
+
+
+void GLStateCache::invalidate() {
+  program     = unknown;
+  vao         = unknown;
+  active_unit = 0;
+  textures.fill(unknown);
+  view        = std::array<GLint, 4>{-1, -1, -1, -1};
+  buffers.clear();
+  uniforms_i.clear();
+  uniforms_m4.clear();
+}
+
+
+void GLStateCache::useProgram(GLuint program) {
+  if (skip(this->program==program)) {
+    return;
+  }
+  glUseProgram(program);
+  this->program = program;
+}
+
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+  if (skip(this->vao==vao)) {
+    return;
+  }
+  glBindVertexArray(vao);
+  this->vao = vao;
+}
+
+
+void GLStateCache::activeTexture(GLenum unit) {
+  if (skip(active_unit==unit)) {
+    return;
+  }
+  glActiveTexture(unit);
+  active_unit = unit;
+}
+
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+  int unit = int(active_unit) - GL_TEXTURE0;
+  bool known = target==GL_TEXTURE_2D && active_unit!=0 && unit<max_units;
+  if (skip(known && textures[unit]==texture)) {
+    return;
+  }
+  glBindTexture(target, texture);
+  if (known) {
+    textures[unit] = texture;
+  }
+}
+
+
+void GLStateCache::bindTextureUnit(int unit, GLuint texture) {
+  activeTexture(GL_TEXTURE0+unit);
+  bindTexture(GL_TEXTURE_2D, texture);
+}
+
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+  auto it = buffers.find(target);
+  if (skip(it!=buffers.end() && it->second==buffer)) {
+    return;
+  }
+  glBindBuffer(target, buffer);
+  buffers[target] = buffer;
+}
+
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+  std::array<GLint, 4> v{x, y, w, h};
+  if (skip(view==v)) {
+    return;
+  }
+  glViewport(x, y, w, h);
+  view = v;
+}
+
+
+void GLStateCache::uniform1i(GLint location, GLint value) {
+  auto key = std::make_pair(program, location);
+  auto it  = uniforms_i.find(key);
+  if (skip(program!=unknown && it!=uniforms_i.end() && it->second==value)) {
+    return;
+  }
+  glUniform1i(location, value);
+  if (program!=unknown) {
+    uniforms_i[key] = value;
+  }
+}
+
+
+void GLStateCache::uniformMatrix4fv(GLint location, const GLfloat* value) {
+  auto key = std::make_pair(program, location);
+  auto it  = uniforms_m4.find(key);
+  if (skip(program!=unknown && it!=uniforms_m4.end() && memcmp(it->second.data(), value, 16*sizeof(GLfloat))==0)) {
+    return;
+  }
+  glUniformMatrix4fv(location, 1, GL_FALSE, value);
+  if (program!=unknown) {
+    std::copy(value, value+16, uniforms_m4[key].begin());
+  }
+}
+
+
+void GLStateCache::printStats(uint64_t frames) {
+  frames = std::max(frames, uint64_t(1));
+  std::cout << "GLStateCache : " << (enabled ? "enabled" : "disabled") << " : " << double(stats.calls)/frames << " state calls per frame, "
+            << double(stats.skipped)/frames << " skipped, " << double(stats.calls-stats.skipped)/frames << " to the driver" << std::endl;
+}
+
+
+OpenGLContext::OpenGLContext() {  
+  // GLXFBConfig *fbConfigs;
+  int numReturned;
+  
+  // initial connection to the xserver
+  this->display_id = XOpenDisplay(NULL);
+  if (this->display_id == NULL) {
+    std::cout << "OpenGLThtead: initGLX: cannot connect to X server" << std::endl;
+  }
+  
+  // glx frame buffer configuration [GLXFBConfig * list of GLX frame buffer configuration parameters] => consistent visual [XVisualInfo] parameters for the X-window
+  this->root_id =DefaultRootWindow(this->display_id); // get the root window of this display
+    
+  /* Request a suitable framebuffer configuration - try for a double buffered configuration first */
+  this->doublebuffer_flag=true;
+  this->fbConfigs = glXChooseFBConfig(this->display_id,DefaultScreen(this->display_id),glx_attr::doubleBufferAttributes,&numReturned);
+  // MEMORY LEAK when running with valgrind, see: http://stackoverflow.com/questions/10065849/memory-leak-using-glxcreatecontext
+  
+  this->att=glx_attr::doubleBufferAttributes;
+  // this->fbConfigs = NULL; // force single buffer
+  
+  if (this->fbConfigs == NULL) {  /* no double buffered configs available */
     this->fbConfigs = glXChooseFBConfig( this->display_id, DefaultScreen(this->display_id),glx_attr::singleBufferAttributes,&numReturned);
     this->doublebuffer_flag=False;
     this->att=glx_attr::singleBufferAttributes;
   }
     
-  if (this->fbConfigs == NULL) {
-    std::cout << "OpenGLContext: initGLX: WARNING! no GLX framebuffer configuration" << std::endl;
-  }
-
-  this->glc=glXCreateNewContext(this->display_id,this->fbConfigs[0],GLX_RGBA_TYPE,NULL,True);
-  if (!this->glc) {
-    std::cout << "OpenGLContext: initGLX: FATAL! Could not create glx context"<<std::endl; 
-    exit(2);
+  if (this->fbConfigs == NULL) {
+    std::cout << "OpenGLContext: initGLX: WARNING! no GLX framebuffer configuration" << std::endl;
+  }
+
+  this->glc=glXCreateNewContext(this->display_id,this->fbConfigs[0],GLX_RGBA_TYPE,NULL,True);
+  if (!this->glc) {
+    std::cout << "OpenGLContext: initGLX: FATAL! Could not create glx context"<<std::endl; 
+    exit(2);
+  }
+}
+
+
+OpenGLContext::~OpenGLContext() {
+  XFree(this->fbConfigs);
+  glXDestroyContext(this->display_id, this->glc);
+  XCloseDisplay(this->display_id);
+}
+
+
+
+void OpenGLContext::makeCurrent(Window window_id) {
+  glXMakeCurrent(this->display_id, window_id, this->glc);
+}
+
+
+void OpenGLContext::loadExtensions() {
+  if (GLEW_ARB_pixel_buffer_object) {
+    std::cerr << "OpenGLContext: loadExtensions: PBO extension already loaded" <<std::endl;
+    return;
+  }
+  else {
+    std::cerr << "OpenGLContext: loadExtensions: Will load PBO extension" <<std::endl;
+  }
+  
+  this->makeCurrent(this->root_id); // a context must be made current before glew works..
+  
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+  if (GLEW_OK != err) {
+  /* Problem: glewInit failed, something is seriously wrong. */
+  std::cerr << "OpenGLContext: loadExtensions: ERROR: " << glewGetErrorString(err) <<std::endl;  
+  }
+  else {
+    if (GLEW_ARB_pixel_buffer_object) {
+      std::cerr << "OpenGLContext: loadExtensions:  PBO extension found! :)"<<std::endl;
+    }
+    else {
+      std::cerr << "OpenGLContext: loadExtensions: WARNING: PBO extension not found! :("<<std::endl;
+    }
+    if (GLEW_ARB_texture_buffer_object) {
+      std::cerr << "OpenGLContext: loadExtensions:  TBO extension found! :)"<<std::endl;
+    }
+    else {
+      std::cerr << "OpenGLContext: loadExtensions: WARNING: TBO extension not found! :("<<std::endl;
+    }
+  }
+}
+
+
+Window OpenGLContext::createWindow() {
+  Window win_id;
+  XSetWindowAttributes swa;
+  
+  // this->vi  =glXChooseVisual(this->display_id, 0, this->att); // "visual parameters" of the X window
+  this->vi =glXGetVisualFromFBConfig( this->display_id, this->fbConfigs[0] ); // another way to do it ..
+  
+  swa.colormap   =XCreateColormap(this->display_id, this->root_id, (this->vi)->visual, AllocNone);
+  swa.event_mask =ExposureMask | KeyPressMask;
+  
+  win_id =XCreateWindow(this->display_id, this->root_id, 0, 0, 600, 600, 0, vi->depth, InputOutput, vi->visual, CWColormap | CWEventMask, &swa);
+  XMapWindow(this->display_id, win_id);
+  XStoreName(this->display_id, win_id, "test window");
+
+  return win_id;
+}
+
+
+void OpenGLContext::reserve(Shader *shader) {
+  unsigned int transform_size, vertices_size, indices_size;
+  
+  transform =std::array<GLfloat,16>{
+    1.0f,             0.0f,             0.0f,   0.0f, 
+    0.0f,             1.0f,             0.0f,   0.0f,
+    0.0f,             0.0f,             1.0f,   0.0f,
+    0.0f,             0.0f,             0.0f,   1.0f
+  };
+  transform_size=sizeof(GLfloat)*transform.size();
+  
+  vertices =std::array<GLfloat,20>{
+    /* Positions          Texture Coords
+       Shader class references:
+       "position"        "texcoord"
+    */
+    1.0f,  1.0f, 0.0f,   1.0f, 1.0f, // Top Right
+    1.0f, -1.0f, 0.0f,   1.0f, 0.0f, // Bottom Right
+   -1.0f, -1.0f, 0.0f,   0.0f, 0.0f, // Bottom Left
+   -1.0f,  1.0f, 0.0f,   0.0f, 1.0f  // Top Left 
+  };
+  vertices_size=sizeof(GLfloat)*vertices.size();
+  
+  indices =std::array<GLuint,6>{  // Note that we start from 0!
+    0, 1, 3, // First Triangle
+    1, 2, 3  // Second Triangle
+  };
+  indices_size=sizeof(GLuint)*indices.size();
+  
+  // std::cout << "SIZEOF: " << sizeof(vertices) << " " << vertices_size << std::endl; // eh.. its the same
+  
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  
+  std::cout << "RenderContext: activate: VAO, VBO, EBO " << VAO << " " << VBO << " " << EBO << std::endl;
+  std::cout << "RenderContext: activate: position, texcoord " << shader->position << " " << shader->texcoord << " " << std::endl;
+  
+  glBindVertexArray(VAO); // VAO works as a "mini program" .. we do all the steps below, when binding the VAO
+  
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  // glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices.data(), GL_STATIC_DRAW);
+  
+  // Position attribute
+  glVertexAttribPointer(shader->position, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0); // this refers to the "Positions" part of vertices
+  // 0: shader prog ref, 3: three elements per vertex
+  glEnableVertexAttribArray(shader->position); // this refers to (location=0) in the shader program
+  // TexCoord attribute
+  glVertexAttribPointer(shader->texcoord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // this refers to "Texture Coords" part of vertices
+  // 1: shader prog ref, 2: two elements per vertex
+  glEnableVertexAttribArray(shader->texcoord); // this refers to (location=1) in the shader program
+  
+  glBindVertexArray(0); // Unbind VAO
+}
+
+
+void OpenGLContext::renderYUVShader(Window window_id, YUVShader* shader, GLuint y_index, GLuint u_index, GLuint v_index) {  
+  // glFlush();
+  // glFinish();
+    
+  if (!glXMakeCurrent(display_id, window_id, glc)) { // choose this x window for manipulation
+    std::cout << "RenderGroup: render: WARNING! could not draw"<<std::endl;
+  }
+  
+  XGetWindowAttributes(display_id, window_id, &(x_window_attr));
+  XWindowAttributes& wa=x_window_attr; // shorthand
+  GLfloat r, dx, dy;
+   
+  std::cout << "RenderGroup: render: window w, h " <<x_window_attr.width<<" "<<x_window_attr.height<<std::endl;
+  
+  glViewport(0, 0, x_window_attr.width, x_window_attr.height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear the screen and the depth buffer
+  
+  shader->use(); // use the shader
+    
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, y_index);
+  glUniform1i(shader->texy, 0); // pass variable to shader
+  
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, u_index);
+  glUniform1i(shader->texu, 1); // pass variable to shader
+  
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, v_index);
+  glUniform1i(shader->texv, 2); // pass variable to shader
+  
+  // calculate dimensions
+  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
+  r=float(wa.height*(1920)) / float(wa.width*(1080));
+  if (r<1.){ // screen wider than image
+    dy=1;
+    dx=r;
+  }
+  else if (r>1.) { // screen taller than image
+    dx=1;
+    dy=1/r;
+  }
+  else {
+    dx=1;
+    dy=1;
+  }
+  
+  std::cout << "RenderContext: bindVars: dx, dy = " << dx <<" "<<dy<<" "<< std::endl;
+  
+  // /* // test..
+  transform[0]=dx;
+  transform[5]=dy;  
+  // */
+  /*
+  transform= {
+    {dx                0.0f,             0.0f,   0.0f}, 
+    {0.0f,             dy                0.0f,   0.0f},
+    {0.0f,             0.0f,             1.0f,   0.0f},
+    {0.0f,             0.0f,             0.0f,   1.0f}
+  };
+  */
+  glUniformMatrix4fv(shader->transform, 1, GL_FALSE, transform.data());
+  
+  glBindVertexArray(VAO);
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  
+  // glFinish();
+  
+  if (doublebuffer_flag) {
+    std::cout << "RenderGroup: render: swapping buffers "<<std::endl;
+    glXSwapBuffers(display_id, window_id);
+  }
+  
+  // glFlush();
+  // glFinish();
+}
+
+
+void OpenGLContext::drawYUVShader(YUVShader* shader, GLuint y_index, GLuint u_index, GLuint v_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  TRACE_SCOPE("draw");
+  
+  state.viewport(x, y, w, h);
+  state.useProgram(shader->getProgram());
+  
+  state.bindTextureUnit(0, y_index);
+  state.uniform1i(shader->texy, 0); // pass variable to shader
+  
+  state.bindTextureUnit(1, u_index);
+  state.uniform1i(shader->texu, 1); // pass variable to shader
+  
+  state.bindTextureUnit(2, v_index);
+  state.uniform1i(shader->texv, 2); // pass variable to shader
+  
+  drawQuad(shader->transform, w, h, img_w, img_h);
+}
+
+void OpenGLContext::drawQuad(GLint transform_location, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  GLfloat r;
+  
+  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
+  r=float(h*img_w) / float(w*img_h);
+  transform[0] = r<1. ? r : 1;
+  transform[5] = r>1. ? 1/r : 1;
+  state.uniformMatrix4fv(transform_location, transform.data());
+  
+  state.bindVertexArray(VAO);
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+void OpenGLContext::drawYUVNV12Shader(YUVNV12Shader* shader, GLuint y_index, GLuint uv_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  TRACE_SCOPE("draw");
+  
+  state.viewport(x, y, w, h);
+  state.useProgram(shader->getProgram());
+  state.bindTextureUnit(0, y_index);
+  state.uniform1i(shader->texy, 0);
+  state.bindTextureUnit(1, uv_index);
+  state.uniform1i(shader->texuv, 1);
+  
+  drawQuad(shader->transform, w, h, img_w, img_h);
+}
+
+
+
+void OpenGLContext::drawRGBShader(RGBShader* shader, GLuint rgb_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  TRACE_SCOPE("draw");
+  
+  state.viewport(x, y, w, h);
+  state.useProgram(shader->getProgram());
+  state.bindTextureUnit(0, rgb_index);
+  state.uniform1i(shader->texrgb, 0); // pass variable to shader
+  
+  drawQuad(shader->transform, w, h, img_w, img_h);
+}
+
+void OpenGLContext::drawYUYVShader(YUYVShader* shader, bool uyvy, GLuint yuyv_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  TRACE_SCOPE("draw");
+  
+  state.viewport(x, y, w, h);
+  state.useProgram(shader->getProgram());
+  state.bindTextureUnit(0, yuyv_index);
+  state.uniform1i(shader->texyuyv, 0);
+  state.uniform1i(shader->uyvy, uyvy ? 1 : 0);
+  
+  drawQuad(shader->transform, w, h, img_w, img_h);
+}
+
+
+void OpenGLContext::drawYUV16Shader(YUV16Shader* shader, GLfloat scale, bool interleaved, GLuint y_index, GLuint u_index, GLuint v_index, GLint x, GLint y, GLsizei w, GLsizei h, GLsizei img_w, GLsizei img_h) {
+  TRACE_SCOPE("draw");
+  
+  state.viewport(x, y, w, h);
+  state.useProgram(shader->getProgram());
+  
+  state.bindTextureUnit(0, y_index);
+  state.uniform1i(shader->texy, 0);
+  state.bindTextureUnit(1, u_index);
+  state.uniform1i(shader->texu, 1);
+  state.bindTextureUnit(2, interleaved ? u_index : v_index);
+  state.uniform1i(shader->texv, 2);
+  state.uniform1i(shader->interleaved, interleaved ? 1 : 0);
+  glUniform1f(shader->scale, scale); // not cached by GLStateCache
+  
+  drawQuad(shader->transform, w, h, img_w, img_h);
+}
+
+
+
+void OpenGLContext::renderYUVBlockShader(Window window_id, YUVBlockShader* shader, GLuint tex_index) {  
+  // glFlush();
+  // glFinish();
+    
+  if (!glXMakeCurrent(display_id, window_id, glc)) { // choose this x window for manipulation
+    std::cout << "RenderGroup: render: WARNING! could not draw"<<std::endl;
+  }
+  
+  XGetWindowAttributes(display_id, window_id, &(x_window_attr));
+  XWindowAttributes& wa=x_window_attr; // shorthand
+  GLfloat r, dx, dy;
+   
+  std::cout << "RenderGroup: render: window w, h " <<x_window_attr.width<<" "<<x_window_attr.height<<std::endl;
+  
+  glViewport(0, 0, x_window_attr.width, x_window_attr.height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear the screen and the depth buffer
+  
+  shader->use(); // use the shader
+    
+  std::cout << "passing tex_index, texBlock : " << tex_index << " " << shader->texBlock << std::endl;
+  
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, tex_index);
+  glUniform1i(shader->texBlock, 0); // pass variable to shader
+  
+  // calculate dimensions
+  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
+  r=float(wa.height*(1920)) / float(wa.width*(1080));
+  if (r<1.){ // screen wider than image
+    dy=1;
+    dx=r;
+  }
+  else if (r>1.) { // screen taller than image
+    dx=1;
+    dy=1/r;
+  }
+  else {
+    dx=1;
+    dy=1;
+  }
+  
+  std::cout << "RenderContext: bindVars: dx, dy = " << dx <<" "<<dy<<" "<< std::endl;
+  
+  // /* // test..
+  transform[0]=dx;
+  transform[5]=dy;  
+  // */
+  /*
+  transform= {
+    {dx                0.0f,             0.0f,   0.0f}, 
+    {0.0f,             dy                0.0f,   0.0f},
+    {0.0f,             0.0f,             1.0f,   0.0f},
+    {0.0f,             0.0f,             0.0f,   1.0f}
+  };
+  */
+  glUniformMatrix4fv(shader->transform, 1, GL_FALSE, transform.data());
+  
+  glBindVertexArray(VAO);
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  
+  // glFinish();
+  
+  if (doublebuffer_flag) {
+    std::cout << "RenderGroup: render: swapping buffers "<<std::endl;
+    glXSwapBuffers(display_id, window_id);
+  }
+  
+  // glFlush();
+  // glFinish();
+}
+
+
+PackPBORing::PackPBORing(GLsizei w, GLsizei h, GLenum format, GLenum type, GLsizei bpp, int depth) : w(w), h(h), size(w*h*bpp), format(format), type(type), pbos(depth), fences(depth, (GLsync)0), head(0), tail(0), pending(0), mapped(false) {
+  glGenBuffers(depth, pbos.data());
+  for(auto it=pbos.begin(); it!=pbos.end(); ++it) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, *it);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ); // reserve size bytes : GPU writes, CPU reads
+    std::cout << "PackPBORing : pbo " << *it << " size " << size << std::endl;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); // unbind
+}
+
+
+PackPBORing::~PackPBORing() {
+  if (mapped) {
+    unmap();
+  }
+  for(auto it=fences.begin(); it!=fences.end(); ++it) {
+    if (*it) {
+      glDeleteSync(*it);
+    }
+  }
+  glDeleteBuffers(pbos.size(), pbos.data());
+}
+
+
+bool PackPBORing::read(GLint x, GLint y) {
+  if (pending>=int(pbos.size())) { // all PBOs are in flight or waiting to be mapped
+    return false;
+  }
+  
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+  glReadPixels(x, y, w, h, format, type, 0); // framebuffer => pbo .. returns immediately
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); // unbind // important!
+  
+  fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush(); // make sure the fence gets to the GPU, otherwise glClientWaitSync might wait forever
+  
+  head = (head+1) % pbos.size();
+  pending++;
+  return true;
+}
+
+
+GLubyte* PackPBORing::map(bool wait) {
+  GLenum   status;
+  GLubyte* payload;
+  
+  if (pending<1) {
+    return NULL;
+  }
+  if (mapped) { // the previous one must be released first
+    std::cout << "PackPBORing : map : WARNING! previous readback not unmapped" << std::endl;
+    return NULL;
+  }
+  
+  status = glClientWaitSync(fences[tail], 0, wait ? GLuint64(1000000000) : 0); // wait at most 1 sec
+  if (status==GL_TIMEOUT_EXPIRED || status==GL_WAIT_FAILED) {
+    return NULL;
+  }
+  glDeleteSync(fences[tail]);
+  fences[tail] = (GLsync)0;
+  
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[tail]);
+  payload = (GLubyte*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); // unbind (the mapping survives)
+  
+  mapped = (payload!=NULL);
+  return payload;
+}
+
+
+void PackPBORing::unmap() {
+  if (!mapped) {
+    return;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[tail]);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER); // release pointer to mapping buffer ** MANDATORY **
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); // unbind
+  
+  mapped = false;
+  tail = (tail+1) % pbos.size();
+  pending--;
+}
+
+
+FramePool::FramePool(std::size_t alignment, PageMode mode) : alignment(alignment), mode(mode), stats{0,0,0,0,0} {
+}
+
+
+FramePool::~FramePool() {
+  for(auto it=used_buffers.begin(); it!=used_buffers.end(); ++it) {
+    deallocate(it->first, it->second);
+  }
+  trim();
+}
+
+
+GLubyte* FramePool::allocate(std::size_t size) {
+  void*    buffer;
+  PageMode m = mode;
+  if (mode!=PAGES_DEFAULT) {
+    return allocStaging(size, m);
+  }
+  if (posix_memalign(&buffer, alignment, size)!=0) {
+    return NULL;
+  }
+  return (GLubyte*)buffer;
+}
+
+
+void FramePool::deallocate(GLubyte* buffer, std::size_t size) {
+  if (mode!=PAGES_DEFAULT) {
+    freeStaging(buffer, size, mode);
+  }
+  else {
+    free(buffer);
+  }
+}
+
+
+std::size_t FramePool::sizeClass(std::size_t size) {
+  std::size_t p, step;
+  
+  if (size<=4096) { // small buffers : next power of two
+    p=64;
+    while (p<size) {
+      p=p*2;
+    }
+    return p;
+  }
+  // large buffers : 4 classes per power of two .. at most 25% wasted
+  p=4096;
+  while (p*2<=size) {
+    p=p*2;
+  }
+  step=p/4;
+  return ((size+step-1)/step)*step;
+}
+
+
+GLubyte* FramePool::get(std::size_t size) {
+  GLubyte*    buffer;
+  std::size_t cls = sizeClass(size);
+  std::unique_lock<std::mutex> lk(mutex);
+  
+  auto it=free_buffers.find(cls);
+  if (it!=free_buffers.end() && !it->second.empty()) { // recycle
+    buffer=it->second.back();
+    it->second.pop_back();
+    stats.reuses++;
+  }
+  else { // from the system
+    buffer=allocate(cls);
+    if (!buffer) {
+      std::cout << "FramePool : get : WARNING! could not allocate " << cls << " bytes" << std::endl;
+      return NULL;
+    }
+    stats.allocs++;
+    stats.bytes_reserved += cls;
+  }
+  used_buffers[buffer]=cls;
+  stats.bytes_in_use += cls;
+  return buffer;
+}
+
+
+void FramePool::release(GLubyte* buffer) {
+  std::unique_lock<std::mutex> lk(mutex);
+  
+  auto it=used_buffers.find(buffer);
+  if (it==used_buffers.end()) {
+    std::cout << "FramePool : release : WARNING! buffer " << (unsigned long)buffer << " not from this pool" << std::endl;
+    return;
+  }
+  free_buffers[it->second].push_back(buffer);
+  stats.releases++;
+  stats.bytes_in_use -= it->second;
+  used_buffers.erase(it);
+}
+
+
+void FramePool::trim() {
+  std::unique_lock<std::mutex> lk(mutex);
+  
+  for(auto it=free_buffers.begin(); it!=free_buffers.end(); ++it) {
+    for(auto it2=it->second.begin(); it2!=it->second.end(); ++it2) {
+      deallocate(*it2, it->first);
+      stats.bytes_reserved -= it->first;
+    }
+    it->second.clear();
+  }
+}
+
+
+FramePoolStats FramePool::getStats() {
+  std::unique_lock<std::mutex> lk(mutex);
+  return stats;
+}
+
+
+void FramePool::printStats() {
+  FramePoolStats st = getStats();
+  std::cout << "FramePool : allocs " << st.allocs << " reuses " << st.reuses << " releases " << st.releases 
+            << " reserved " << st.bytes_reserved << " bytes, in use " << st.bytes_in_use << " bytes" << std::endl;
+}
+
+
+IoUring::IoUring(unsigned entries) : ring_fd(-1), sq_entries(0), to_submit(0), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sq_size(0), cq_size(0) {
+#ifdef HAVE_IO_URING
+  struct io_uring_params params;
+  
+  sqes = (struct io_uring_sqe*)MAP_FAILED;
+  memset(&params, 0, sizeof(params));
+  ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd<0) {
+    std::cout << "IoUring : io_uring_setup failed (" << strerror(errno) << ")" << std::endl;
+    return;
+  }
+  sq_entries = params.sq_entries;
+  sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+  cq_size = params.cq_off.cqes  + params.cq_entries*sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) { // both rings in one mapping
+    sq_size = cq_size = std::max(sq_size, cq_size);
+  }
+  
+  sq_ptr = mmap(NULL, sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ptr = sq_ptr;
+  }
+  else {
+    cq_ptr = mmap(NULL, cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  }
+  sqes = (struct io_uring_sqe*)mmap(NULL, params.sq_entries*sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  
+  if (sq_ptr==MAP_FAILED || cq_ptr==MAP_FAILED || (void*)sqes==MAP_FAILED) {
+    std::cout << "IoUring : could not map the rings" << std::endl;
+    close(ring_fd);
+    ring_fd = -1;
+    return;
+  }
+  
+  sq_head  = (unsigned*)((char*)sq_ptr + params.sq_off.head);
+  sq_tail  = (unsigned*)((char*)sq_ptr + params.sq_off.tail);
+  sq_mask  = (unsigned*)((char*)sq_ptr + params.sq_off.ring_mask);
+  sq_array = (unsigned*)((char*)sq_ptr + params.sq_off.array);
+  cq_head  = (unsigned*)((char*)cq_ptr + params.cq_off.head);
+  cq_tail  = (unsigned*)((char*)cq_ptr + params.cq_off.tail);
+  cq_mask  = (unsigned*)((char*)cq_ptr + params.cq_off.ring_mask);
+  cqes     = (struct io_uring_cqe*)((char*)cq_ptr + params.cq_off.cqes);
+#else
+  std::cout << "IoUring : not compiled in" << std::endl;
+#endif
+}
+
+
+IoUring::~IoUring() {
+#ifdef HAVE_IO_URING
+  if ((void*)sqes!=MAP_FAILED) {
+    munmap(sqes, sq_entries*sizeof(struct io_uring_sqe));
+  }
+  if (cq_ptr!=MAP_FAILED && cq_ptr!=sq_ptr) {
+    munmap(cq_ptr, cq_size);
+  }
+  if (sq_ptr!=MAP_FAILED) {
+    munmap(sq_ptr, sq_size);
+  }
+  if (ring_fd>=0) {
+    close(ring_fd);
+  }
+#endif
+}
+
+
+bool IoUring::registerBuffers(const std::vector<struct iovec>& iovecs) {
+#ifdef HAVE_IO_URING
+  if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size())<0) {
+    std::cout << "IoUring : registerBuffers failed (" << strerror(errno) << ") : using normal reads" << std::endl; // typically RLIMIT_MEMLOCK
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+bool IoUring::prepRead(int fd, GLubyte* buffer, unsigned len, off_t offset, uint64_t user_data, int buf_index) {
+#ifdef HAVE_IO_URING
+  unsigned tail, head, index;
+  struct io_uring_sqe* sqe;
+  
+  tail = *sq_tail; // only we write the tail
+  head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  if (tail-head>=sq_entries) { // ring full
+    return false;
+  }
+  index = tail & *sq_mask;
+  sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = (buf_index>=0) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd        = fd;
+  sqe->addr      = (uint64_t)buffer;
+  sqe->len       = len;
+  sqe->off       = offset;
+  sqe->user_data = user_data;
+  if (buf_index>=0) {
+    sqe->buf_index = buf_index;
+  }
+  sq_array[index] = index;
+  __atomic_store_n(sq_tail, tail+1, __ATOMIC_RELEASE);
+  to_submit++;
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+int IoUring::submit(unsigned wait_nr) {
+#ifdef HAVE_IO_URING
+  int cc;
+  cc = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, wait_nr>0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  if (cc<0) {
+    cc = -errno;
+    if (cc!=-EINTR) {
+      std::cout << "IoUring : io_uring_enter failed (" << strerror(-cc) << ")" << std::endl;
+    }
+    return cc;
+  }
+  to_submit -= cc;
+  return cc;
+#else
+  return -1;
+#endif
+}
+
+
+bool IoUring::peek(uint64_t& user_data, int& res) {
+#ifdef HAVE_IO_URING
+  unsigned head, tail;
+  struct io_uring_cqe* cqe;
+  
+  head = *cq_head; // only we write the head
+  tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  if (head==tail) {
+    return false;
+  }
+  cqe = &cqes[head & *cq_mask];
+  user_data = cqe->user_data;
+  res       = cqe->res;
+  __atomic_store_n(cq_head, head+1, __ATOMIC_RELEASE);
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+FrameIngest::FrameIngest(FramePool* pool, std::size_t framesize, int nslots, bool use_uring, int nthreads) : pool(pool), framesize(framesize), nthreads(nthreads), ring(NULL), fixed(false), running(false), next_stream(0), in_flight(nslots), nread(0), nfailed(0), nretired(0) {
+  int i;
+  std::vector<struct iovec> iovecs;
+  
+  for(i=0;i<nslots;i++) {
+    slots.push_back(pool->get(framesize));
+    free_slots.push_back(i);
+    iovecs.push_back(iovec{slots.back(), framesize});
+  }
+  
+  if (use_uring) {
+    ring = new IoUring(nslots);
+    if (!ring->ok()) {
+      std::cout << "FrameIngest : io_uring not available : falling back to threads" << std::endl;
+      delete ring;
+      ring = NULL;
+    }
+    else {
+      fixed = ring->registerBuffers(iovecs);
+      if (!probeRead()) {
+        std::cout << "FrameIngest : io_uring can't read : falling back to threads" << std::endl;
+        delete ring;
+        ring  = NULL;
+        fixed = false;
+      }
+    }
+  }
+  std::cout << "FrameIngest : " << nslots << " slots of " << framesize << " bytes, using " << backend() << std::endl;
+}
+
+
+FrameIngest::~FrameIngest() {
+  stop();
+  if (ring) {
+    delete ring;
+  }
+  for(auto it=slots.begin(); it!=slots.end(); ++it) {
+    pool->release(*it);
+  }
+  for(auto it=streams.begin(); it!=streams.end(); ++it) {
+    close(it->fd);
+  }
+}
+
+
+int FrameIngest::addStream(const char* fname) {
+  struct stat st;
+  Stream stream;
+  
+  stream.fd = open(fname, O_RDONLY);
+  if (stream.fd<0) {
+    std::cout << "FrameIngest : addStream : could not open " << fname << std::endl;
+    return -1;
+  }
+  if (fstat(stream.fd, &st)!=0) {
+    std::cout << "FrameIngest : addStream : could not stat " << fname << " (" << strerror(errno) << ")" << std::endl;
+    close(stream.fd);
+    return -1;
+  }
+  stream.nframes = st.st_size / framesize;
+  stream.next    = 0;
+  stream.failed  = false;
+  if (stream.nframes<1) {
+    std::cout << "FrameIngest : addStream : " << fname << " has no complete frames" << std::endl;
+    close(stream.fd);
+    return -1;
+  }
+  posix_fadvise(stream.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  streams.push_back(stream);
+  return streams.size()-1;
+}
+
+
+void FrameIngest::nextRead(int slot) {
+  Stream& stream = streams[next_stream];
+  IngestFrame& frame = in_flight[slot];
+  
+  frame.stream = next_stream;
+  frame.index  = stream.next;
+  frame.slot   = slot;
+  frame.data   = slots[slot];
+  frame.size   = framesize;
+}
+
+
+void FrameIngest::advanceRead() {
+  Stream& stream = streams[next_stream];
+  stream.next  = (stream.next+1) % stream.nframes; // replay in a loop
+  next_stream  = (next_stream+1) % streams.size(); // round-robin
+}
+
+
+bool FrameIngest::skipFailed() {
+  for(std::size_t i=0; i<streams.size(); i++) {
+    if (!streams[next_stream].failed) {
+      return true;
+    }
+    next_stream = (next_stream+1) % streams.size();
+  }
+  return false;
+}
+
+
+void FrameIngest::retire(int stream) {
+  if (!streams[stream].failed) {
+    std::cout << "FrameIngest : stream " << stream << " : a read failed, not reading from it anymore" << std::endl;
+    streams[stream].failed = true;
+    nretired++;
+  }
+}
+
+
+bool FrameIngest::probeRead() {
+  int      fd, res;
+  uint64_t user_data;
+  bool     ok = false;
+  
+  if (slots.empty()) {
+    return true;
+  }
+  fd = open("/dev/zero", O_RDONLY);
+  if (fd<0) { // can't tell
+    return true;
+  }
+  if (ring->prepRead(fd, slots[0], 1, 0, 0, fixed ? 0 : -1) && ring->submit(1)>=0) { // one byte, the way uringLoop reads
+    ok = ring->peek(user_data, res) && res==1;
+  }
+  close(fd);
+  return ok;
+}
+
+
+void FrameIngest::uringLoop() {
+  int      slot, res, pending, cc, errors;
+  uint64_t user_data;
+  
+  TRACE_THREAD_NAME("ingest");
+  pending = 0;
+  errors  = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      if (!running) {
+        break;
+      }
+      if (pending==0 && !skipFailed()) {
+        std::cout << "FrameIngest : all streams failed" << std::endl;
+        break;
+      }
+      while (!free_slots.empty() && skipFailed()) { // keep reads outstanding into all free slots
+        slot = free_slots.back();
+        nextRead(slot);
+        IngestFrame& frame = in_flight[slot];
+        if (!ring->prepRead(streams[frame.stream].fd, frame.data, framesize, frame.index*framesize, slot, fixed ? slot : -1)) {
+          break; // submission ring full : that frame is read next time
+        }
+        advanceRead();
+        free_slots.pop_back();
+        pending++;
+      }
+      if (pending==0) { // everything is waiting for upload
+        cond.wait(lk, [this]{return !running || !free_slots.empty();});
+        continue;
+      }
+    }
+    
+    {
+      TRACE_SCOPE("read");
+      cc = ring->submit(1); // submit & wait for at least one completion
+    }
+    if (cc<0 && cc!=-EINTR) { // back off, give up if it persists
+      if (++errors>=10) {
+        std::cout << "FrameIngest : io_uring keeps failing : stopping" << std::endl;
+        break;
+      }
+      sleep_for(std::chrono::milliseconds(10*errors));
+    }
+    else if (cc>=0) {
+      errors = 0;
+    }
+    
+    std::unique_lock<std::mutex> lk(mutex);
+    while (ring->peek(user_data, res)) {
+      slot = user_data;
+      pending--;
+      if (res==int(framesize)) {
+        ready.push_back(in_flight[slot]);
+        nread++;
+      }
+      else {
+        if (res<=0) { // an error, or eof : the file shrank
+          retire(in_flight[slot].stream);
+        }
+        free_slots.push_back(slot);
+        nfailed++;
+      }
+    }
+    cond.notify_all();
+  }
+  
+  while (pending>0) { // the kernel might still write into the slots : wait for them
+    cc = ring->submit(1);
+    if (cc<0 && cc!=-EINTR) { // can't wait anymore : closing the ring cancels them
+      break;
+    }
+    while (ring->peek(user_data, res)) {
+      pending--;
+    }
+  }
+}
+
+
+void FrameIngest::threadLoop() {
+  int         slot;
+  std::size_t n;
+  
+  TRACE_THREAD_NAME("ingest");
+  while (true) {
+    std::unique_lock<std::mutex> lk(mutex);
+    cond.wait(lk, [this]{return !running || !free_slots.empty();});
+    if (!running || !skipFailed()) {
+      break;
+    }
+    slot = free_slots.back();
+    free_slots.pop_back();
+    nextRead(slot);
+    advanceRead();
+    IngestFrame frame = in_flight[slot];
+    lk.unlock();
+    
+    {
+      TRACE_SCOPE("read");
+      n = preadbytes(streams[frame.stream].fd, frame.data, framesize, frame.index*framesize);
+    }
+    
+    lk.lock();
+    if (n==framesize) {
+      ready.push_back(frame);
+      nread++;
+    }
+    else { // preadbytes only stops short on eof or an error : the file shrank or went bad
+      retire(frame.stream);
+      free_slots.push_back(slot);
+      nfailed++;
+    }
+    cond.notify_all();
+  }
+}
+
+
+void FrameIngest::start() {
+  int i;
+  if (running || streams.empty()) {
+    return;
+  }
+  running = true;
+  if (ring) {
+    threads.push_back(std::thread(&FrameIngest::uringLoop, this));
+  }
+  else {
+    for(i=0;i<nthreads;i++) {
+      threads.push_back(std::thread(&FrameIngest::threadLoop, this));
+    }
+  }
+}
+
+
+void FrameIngest::stop() {
+  {
+    std::unique_lock<std::mutex> lk(mutex);
+    running = false;
+    cond.notify_all();
+  }
+  for(auto it=threads.begin(); it!=threads.end(); ++it) {
+    it->join();
+  }
+  threads.clear();
+}
+
+
+bool FrameIngest::pop(IngestFrame& frame, int timeout_ms) {
+  std::unique_lock<std::mutex> lk(mutex);
+  cond.wait_for(lk, std::chrono::milliseconds(timeout_ms), [this]{return !ready.empty() || !running;});
+  if (ready.empty()) {
+    return false;
+  }
+  frame = ready.front();
+  ready.pop_front();
+  return true;
+}
+
+
+void FrameIngest::release(const IngestFrame& frame) {
+  std::unique_lock<std::mutex> lk(mutex);
+  free_slots.push_back(frame.slot);
+  cond.notify_all();
+}
+
+
+ShmFrameRing::ShmFrameRing(const char* name, bool create, uint32_t nslots, uint32_t slotsize) : name(name ? name : ""), owner(create), fd(-1), mapsize(0), region(NULL), header(NULL) {
+  struct stat st;
+  std::size_t pagesize = sysconf(_SC_PAGESIZE);
+  void*       ptr;
+  
+  if (!name) {
+    fd = memfd_create("upload_pbo_ring", MFD_CLOEXEC);
+  }
+  else if (create) {
+    fd = shm_open(name, O_RDWR|O_CREAT|O_TRUNC, 0600);
+  }
+  else {
+    fd = shm_open(name, O_RDWR, 0);
+  }
+  if (fd<0) {
+    std::cout << "ShmFrameRing : could not open shared memory " << this->name << " (" << strerror(errno) << ")" << std::endl;
+    return;
+  }
+  
+  if (create) {
+    slotstride = ((sizeof(ShmFrameInfo)+slotsize+pagesize-1)/pagesize)*pagesize;
+    mapsize    = slotstride*(1+nslots); // first "slot" is the header
+    if (ftruncate(fd, mapsize)!=0) {
+      std::cout << "ShmFrameRing : ftruncate failed (" << strerror(errno) << ")" << std::endl;
+      return;
+    }
+  }
+  else {
+    if (fstat(fd, &st)!=0) {
+      std::cout << "ShmFrameRing : fstat failed (" << strerror(errno) << ")" << std::endl;
+      return;
+    }
+    if (std::size_t(st.st_size)<pagesize) { // not even the header
+      std::cout << "ShmFrameRing : " << this->name << " is not a frame ring" << std::endl;
+      return;
+    }
+    mapsize = st.st_size;
+  }
+  
+  ptr = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ptr==MAP_FAILED) {
+    std::cout << "ShmFrameRing : mmap failed (" << strerror(errno) << ")" << std::endl;
+    return;
+  }
+  region = (GLubyte*)ptr;
+  
+  if (create) {
+    header = new(region) ShmRingHeader(); // placement new : the atomics get constructed
+    header->magic     = 0x52505055; // "UPPR"
+    header->version   = 1;
+    header->nslots    = nslots;
+    header->slotsize  = slotsize;
+    header->write_seq = 0;
+    header->read_seq  = 0;
+    header->closed    = 0;
+  }
+  else {
+    header = (ShmRingHeader*)region;
+    if (header->magic!=0x52505055 || header->version!=1) {
+      std::cout << "ShmFrameRing : " << this->name << " is not a frame ring" << std::endl;
+      header = NULL;
+      return;
+    }
+    // the header comes from another process : the slots it describes must fit into what we mapped
+    slotstride = ((sizeof(ShmFrameInfo)+std::size_t(header->slotsize)+pagesize-1)/pagesize)*pagesize;
+    if (header->nslots==0 || slotstride>mapsize || header->nslots>mapsize/slotstride-1) {
+      std::cout << "ShmFrameRing : " << this->name << " : " << header->nslots << " slots of " << header->slotsize << " bytes don't fit into "
+                << mapsize << " bytes" << std::endl;
+      header = NULL;
+      return;
+    }
+  }
+  std::cout << "ShmFrameRing : " << (this->name.empty() ? "memfd" : this->name) << " : " << header->nslots << " slots of " << header->slotsize << " bytes" << std::endl;
+}
+
+
+ShmFrameRing::~ShmFrameRing() {
+  if (region) {
+    munmap(region, mapsize);
+  }
+  if (fd>=0) {
+    ::close(fd);
+  }
+  if (owner && !name.empty()) {
+    shm_unlink(name.c_str());
+  }
+}
+
+
+GLubyte* ShmFrameRing::beginWrite(int timeout_ms) {
+  uint32_t r, w;
+  
+  w = header->write_seq.load(std::memory_order_relaxed); // only we write it
+  while (true) {
+    r = header->read_seq.load(std::memory_order_acquire);
+    if (w-r < header->nslots) {
+      break;
+    }
+    if (futexWait(&header->read_seq, r, timeout_ms)!=0 && errno==ETIMEDOUT) { // ring full : wait for the consumer
+      return NULL;
+    }
+  }
+  return slotData(w);
+}
+
+
+void ShmFrameRing::commitWrite(const ShmFrameInfo& info) {
+  uint32_t w = header->write_seq.load(std::memory_order_relaxed);
+  
+  *slotInfo(w)     = info;
+  slotInfo(w)->seq = w;
+  header->write_seq.store(w+1, std::memory_order_release);
+  futexWake(&header->write_seq);
+}
+
+
+void ShmFrameRing::close() {
+  header->closed.store(1, std::memory_order_release);
+  futexWake(&header->write_seq);
+}
+
+
+ShmReadStatus ShmFrameRing::beginRead(ShmFrameInfo& info, GLubyte*& data, int timeout_ms, std::size_t max_size) {
+  uint32_t r, w;
+  
+  data = NULL;
+  r = header->read_seq.load(std::memory_order_relaxed); // only we write it
+  while (true) {
+    w = header->write_seq.load(std::memory_order_acquire);
+    if (w!=r) {
+      break;
+    }
+    if (header->closed.load(std::memory_order_acquire)) {
+      return SHM_READ_CLOSED;
+    }
+    if (futexWait(&header->write_seq, w, timeout_ms)!=0 && errno==ETIMEDOUT) { // ring empty : wait for the producer
+      return SHM_READ_TIMEOUT;
+    }
+  }
+  info = *slotInfo(r); // a copy : the producer can't change it under us after the check
+  if (max_size==0 || max_size>header->slotsize) {
+    max_size = header->slotsize;
+  }
+  if (info.size>max_size) {
+    std::cout << "ShmFrameRing : beginRead : frame " << info.seq << " of " << info.size << " bytes, max " << max_size << " : rejected" << std::endl;
+    endRead();
+    return SHM_READ_REJECTED;
+  }
+  data = slotData(r);
+  return SHM_READ_OK;
+}
+
+
+void ShmFrameRing::endRead() {
+  header->read_seq.fetch_add(1, std::memory_order_release);
+  futexWake(&header->read_seq);
+}
+
+
+DmaBufImporter::DmaBufImporter(Display* display_id) : egl_display(EGL_NO_DISPLAY), egl_context(EGL_NO_CONTEXT), egl_surface(EGL_NO_SURFACE), can_import(false), eglCreateImageKHR(NULL), eglDestroyImageKHR(NULL), glEGLImageTargetTexture2DOES(NULL) {
+  EGLint      major, minor, n;
+  EGLConfig   config;
+  const char* extensions;
+  
+  const EGLint config_attr[] = {
+    EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE,        8,
+    EGL_GREEN_SIZE,      8,
+    EGL_BLUE_SIZE,       8,
+    EGL_NONE
+  };
+  const EGLint pbuffer_attr[] = {
+    EGL_WIDTH,  16,
+    EGL_HEIGHT, 16,
+    EGL_NONE
+  };
+  
+  egl_display = eglGetDisplay((EGLNativeDisplayType)display_id);
+  if (egl_display==EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor)) {
+    std::cout << "DmaBufImporter : could not initialize EGL" << std::endl;
+    return;
+  }
+  std::cout << "DmaBufImporter : EGL " << major << "." << minor << std::endl;
+  
+  extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+  can_import = extensions && strstr(extensions, "EGL_EXT_image_dma_buf_import");
+  if (!can_import) {
+    std::cout << "DmaBufImporter : WARNING! no EGL_EXT_image_dma_buf_import : will copy" << std::endl;
+  }
+  
+  eglBindAPI(EGL_OPENGL_API);
+  if (!eglChooseConfig(egl_display, config_attr, &config, 1, &n) || n<1) {
+    std::cout << "DmaBufImporter : no EGL config" << std::endl;
+    return;
+  }
+  egl_surface = eglCreatePbufferSurface(egl_display, config, pbuffer_attr);
+  egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, NULL);
+  if (egl_context==EGL_NO_CONTEXT) {
+    std::cout << "DmaBufImporter : could not create EGL context" << std::endl;
+    return;
+  }
+  makeCurrent();
+  
+  eglCreateImageKHR           = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+  eglDestroyImageKHR          = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+  glEGLImageTargetTexture2DOES = (EGLImageTargetTexture2DOESProc)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+  if (!eglCreateImageKHR || !eglDestroyImageKHR || !glEGLImageTargetTexture2DOES) {
+    std::cout << "DmaBufImporter : WARNING! EGLImage functions not found : will copy" << std::endl;
+    can_import = false;
+  }
+}
+
+
+DmaBufImporter::~DmaBufImporter() {
+  if (egl_display==EGL_NO_DISPLAY) {
+    return;
+  }
+  releaseFrame();
+  eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (egl_context!=EGL_NO_CONTEXT) {
+    eglDestroyContext(egl_display, egl_context);
+  }
+  if (egl_surface!=EGL_NO_SURFACE) {
+    eglDestroySurface(egl_display, egl_surface);
+  }
+  eglTerminate(egl_display);
+}
+
+
+void DmaBufImporter::makeCurrent() {
+  eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context);
+}
+
+
+bool DmaBufImporter::importPlane(int fd, uint32_t fourcc, GLsizei w, GLsizei h, GLsizei offset, GLsizei stride, GLuint tex) {
+  EGLImageKHR image;
+  
+  const EGLint attr[] = {
+    EGL_WIDTH,                     w,
+    EGL_HEIGHT,                    h,
+    EGL_LINUX_DRM_FOURCC_EXT,      EGLint(fourcc),
+    EGL_DMA_BUF_PLANE0_FD_EXT,     fd,
+    EGL_DMA_BUF_PLANE0_OFFSET_EXT, offset,
+    EGL_DMA_BUF_PLANE0_PITCH_EXT,  stride,
+    EGL_NONE
+  };
+  
+  image = eglCreateImageKHR(egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attr);
+  if (image==EGL_NO_IMAGE_KHR) {
+    std::cout << "DmaBufImporter : eglCreateImageKHR failed : " << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+  images.push_back(image);
+  
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image); // the texture is now backed by the dma-buf
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  return (glGetError()==GL_NO_ERROR);
+}
+
+
+void DmaBufImporter::copyPlane(const GLubyte* data, GLenum format, GLsizei w, GLsizei h, GLsizei stride, GLsizei bpp, GLuint tex) {
+  GLenum internal_format = (format==GL_RED) ? GL_R8 : ((format==GL_RG) ? GL_RG8 : GL_RGBA8);
+  
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glPixelStorei(GL_UNPACK_ALIGNMENT,  1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, stride/bpp);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, data);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT,  4);
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+}
+
+
+bool DmaBufImporter::importFrame(int fd, PixelFormat format, GLsizei w, GLsizei h, const GLsizei* offsets, const GLsizei* strides, const GLuint* texs, bool copy) {
+  int         i, nplanes;
+  bool        imported;
+  struct stat st;
+  GLubyte*    data;
+  
+  // per plane : fourcc, gl format, width, height, bytes per pixel
+  uint32_t fourccs[3];
+  GLenum   formats[3];
+  GLsizei  ws[3], hs[3], bpps[3];
+  
+  switch (format) {
+    case(PIXFMT_I420):
+      nplanes=3;
+      for(i=0;i<3;i++) {
+        fourccs[i]=DRM_FORMAT_R8; formats[i]=GL_RED; bpps[i]=1;
+        ws[i] = (i==0) ? w : w/2;
+        hs[i] = (i==0) ? h : h/2;
+      }
+      break;
+    case(PIXFMT_NV12):
+      nplanes=2;
+      fourccs[0]=DRM_FORMAT_R8;   formats[0]=GL_RED; bpps[0]=1; ws[0]=w;   hs[0]=h;
+      fourccs[1]=DRM_FORMAT_GR88; formats[1]=GL_RG;  bpps[1]=2; ws[1]=w/2; hs[1]=h/2;
+      break;
+    case(PIXFMT_BGRA):
+      nplanes=1;
+      fourccs[0]=DRM_FORMAT_ARGB8888; formats[0]=GL_BGRA; bpps[0]=4; ws[0]=w; hs[0]=h;
+      break;
+    default:
+      return false;
+  }
+  
+  releaseFrame();
+  imported = can_import && !copy;
+  for(i=0; i<nplanes && imported; i++) {
+    imported = importPlane(fd, fourccs[i], ws[i], hs[i], offsets[i], strides[i], texs[i]);
+  }
+  if (imported) {
+    return true;
+  }
+  
+  // fallback : map the buffer and upload
+  releaseFrame();
+  fstat(fd, &st);
+  data = (GLubyte*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if ((void*)data==MAP_FAILED) {
+    std::cout << "DmaBufImporter : could not map dma-buf (" << strerror(errno) << ")" << std::endl;
+    return false;
+  }
+  for(i=0;i<nplanes;i++) {
+    copyPlane(data+offsets[i], formats[i], ws[i], hs[i], strides[i], bpps[i], texs[i]);
+  }
+  munmap(data, st.st_size);
+  return false;
+}
+
+
+void DmaBufImporter::releaseFrame() {
+  for(auto it=images.begin(); it!=images.end(); ++it) {
+    eglDestroyImageKHR(egl_display, *it);
+  }
+  images.clear();
+}
+
+
+Y4MReader::Y4MReader(const char* fname, GLsizei raw_w, GLsizei raw_h, PageMode mode) : map(NULL), mapsize(0), mode(mode), y4m(false), width(raw_w), height(raw_h), fps_num(0), fps_den(0), aspect_num(1), aspect_den(1), interlacing('p'), colourspace("420jpeg"), bitdepth(8), framesize(0) {
+  std::size_t pos, end, cw, ch, lw;
+  
+  map = mapFile(fname, mapsize, mode);
+  if (!map) {
+    return;
+  }
+  
+  pos = 0;
+  y4m = (mapsize>10 && memcmp(map, "YUV4MPEG2 ", 10)==0);
+  if (y4m && !parseHeader(pos)) {
+    std::cout << "Y4MReader : " << fname << " : bad header" << std::endl;
+    return;
+  }
+  if (width<1 || height<1) {
+    std::cout << "Y4MReader : " << fname << " : no dimensions" << std::endl;
+    return;
+  }
+  
+  // plane sizes from the chroma subsampling
+  lw = std::size_t(width)*height;
+  if (colourspace.compare(0,3,"420")==0) {
+    cw = (width+1)/2;  ch = (height+1)/2;
+  }
+  else if (colourspace.compare(0,3,"422")==0) {
+    cw = (width+1)/2;  ch = height;
+  }
+  else if (colourspace.compare(0,3,"444")==0) {
+    cw = width;        ch = height;
+  }
+  else if (colourspace.compare(0,4,"mono")==0) {
+    cw = 0;            ch = 0;
+  }
+  else {
+    std::cout << "Y4MReader : " << fname << " : unsupported colourspace " << colourspace << std::endl;
+    return;
+  }
+  framesize = (lw + 2*cw*ch) * (bitdepth>8 ? 2 : 1);
+  
+  // index the frames
+  while (pos<mapsize) {
+    if (y4m) {
+      if (mapsize-pos<6 || memcmp(map+pos, "FRAME", 5)!=0) {
+        break;
+      }
+      end = pos+5;
+      while (end<mapsize && map[end]!='\n') {
+        end++;
+      }
+      params.push_back(std::string((char*)map+pos+5, end-pos-5));
+      params.back().erase(0, params.back().find_first_not_of(' '));
+      pos = end+1;
+    }
+    else {
+      params.push_back(std::string());
+    }
+    if (pos+framesize>mapsize) { // truncated
+      params.pop_back();
+      break;
+    }
+    offsets.push_back(pos);
+    pos += framesize;
+  }
+}
+
+
+Y4MReader::~Y4MReader() {
+  if (map) {
+    unmapFile(map, mapsize, mode);
+  }
+}
+
+
+bool Y4MReader::parseHeader(std::size_t& pos) {
+  std::size_t end;
+  std::string header, token;
+  
+  end = 0;
+  while (end<mapsize && map[end]!='\n') {
+    end++;
+  }
+  if (end>=mapsize) {
+    return false;
+  }
+  header = std::string((char*)map+10, end-10);
+  pos = end+1;
+  
+  width  = 0;
+  height = 0;
+  std::istringstream tokens(header);
+  while (tokens >> token) {
+    switch (token[0]) {
+      case('W'):
+        width = atoi(token.c_str()+1);
+        break;
+      case('H'):
+        height = atoi(token.c_str()+1);
+        break;
+      case('F'):
+        sscanf(token.c_str()+1, "%d:%d", &fps_num, &fps_den);
+        break;
+      case('A'):
+        sscanf(token.c_str()+1, "%d:%d", &aspect_num, &aspect_den);
+        break;
+      case('I'):
+        interlacing = (token.size()>1) ? token[1] : 'p';
+        break;
+      case('C'):
+        colourspace = token.substr(1);
+        if (colourspace.size()>4 && colourspace[3]=='p' && isdigit(colourspace[4])) { // say, 420p10
+          bitdepth = atoi(colourspace.c_str()+4);
+        }
+        else if (colourspace.compare(0,4,"mono")==0 && colourspace.size()>4) { // say, mono16
+          bitdepth = atoi(colourspace.c_str()+4);
+        }
+        break;
+      default: // X (extensions) etc.
+        break;
+    }
+  }
+  return true;
+}
+
+
+Y4MFrame Y4MReader::frame(int i) {
+  return Y4MFrame{map+offsets[i], framesize, params[i]};
+}
+
+
+void Y4MReader::print() {
+  std::cout << "Y4MReader : " << (y4m ? "y4m" : "raw") << " " << width << "x" << height << " colourspace " << colourspace << " (" << bitdepth << " bit)"
+            << " fps " << getFps() << " interlacing " << interlacing << " aspect " << aspect_num << ":" << aspect_den
+            << " frames " << getFrameCount() << " of " << framesize << " bytes" << std::endl;
+}
+
+
+FrameGenerator::FrameGenerator(PixelFormat format, GLsizei w, GLsizei h, double fps, uint32_t seed) : format(format), w(w), h(h), fps(fps), count(0), t0(std::chrono::steady_clock::now()) {
+  int i;
+  std::size_t size = std::size_t(w)*h;
+  
+  for(i=0;i<4;i++) {
+    noise[i] = seed*2654435761u + i*40503u + 1; // xorshift state must not be zero
+  }
+  
+  // pattern : how each byte of a pixel depends on x.  fixed : bytes that don't move (value from pattern*0 + fixed)
+  const GLubyte luma[1]    = {1};
+  const GLubyte u[1]       = {2};
+  const GLubyte v[1]       = {255};
+  const GLubyte uv[2]      = {2, 255};
+  const GLubyte bgra[4]    = {1, 2, 255, 0};
+  const GLubyte bgra_a[4]  = {0, 0, 0, 255};
+  const GLubyte yuyv[4]    = {1, 2, 1, 255};
+  const GLubyte uyvy[4]    = {2, 1, 255, 1};
+  
+  switch (format) {
+    case(PIXFMT_I420):
+      addPlane(0,          w,   h,   1,  luma, 1, NULL);
+      addPlane(size,       w/2, h/2, 2,  u,    1, NULL);
+      addPlane((5*size)/4, w/2, h/2, -1, v,    1, NULL);
+      break;
+    case(PIXFMT_NV12):
+      addPlane(0,          w,   h,   1,  luma, 1, NULL);
+      addPlane(size,       w,   h/2, 2,  uv,   2, NULL);
+      break;
+    case(PIXFMT_BGRA):
+      addPlane(0,          w*4, h,   1,  bgra, 4, bgra_a);
+      break;
+    case(PIXFMT_YUYV):
+      addPlane(0,          w*2, h,   1,  yuyv, 4, NULL);
+      break;
+    case(PIXFMT_UYVY):
+      addPlane(0,          w*2, h,   1,  uyvy, 4, NULL);
+      break;
+    case(PIXFMT_P010):
+    case(PIXFMT_I420P10):
+      addPlane(0,          w,   h,   1,  luma, 1, NULL);
+      addPlane(size,       w/2, h/2, 2,  u,    1, NULL);
+      addPlane((5*size)/4, w/2, h/2, -1, v,    1, NULL);
+      narrow.resize(frameSize(PIXFMT_I420, w, h));
+      break;
+    default:
+      std::cout << "FrameGenerator : unsupported format " << pixelFormatName(format) << std::endl;
+  }
+}
+
+
+FrameGenerator::~FrameGenerator() {
+}
+
+
+void FrameGenerator::addPlane(std::size_t offset, GLsizei linesize, GLsizei lines, int speed, const GLubyte* pattern, int bpp, const GLubyte* fixed) {
+  GLsizei i;
+  Plane   plane;
+  
+  plane.offset   = offset;
+  plane.linesize = linesize;
+  plane.lines    = lines;
+  plane.speed    = speed;
+  plane.ramp.resize(linesize);
+  plane.addmask.resize(linesize);
+  plane.noisemask.resize(linesize);
+  for(i=0;i<linesize;i++) {
+    if (fixed && fixed[i%bpp]) { // say, alpha
+      plane.ramp[i]      = fixed[i%bpp];
+      plane.addmask[i]   = 0;
+      plane.noisemask[i] = 0;
+    }
+    else {
+      plane.ramp[i]      = GLubyte((i/bpp)*pattern[i%bpp]);
+      plane.addmask[i]   = 0xff;
+      plane.noisemask[i] = 0x07; // 3 bits of noise
+    }
+  }
+  planes.push_back(plane);
+}
+
+
+void FrameGenerator::fillPlane(GLubyte* dst, const Plane& plane, uint64_t index) {
+  GLsizei  x, y;
+  GLubyte  k;
+  GLubyte* line;
+  
+#if defined(__SSE2__)
+  __m128i state = _mm_loadu_si128((const __m128i*)noise);
+#endif
+  for(y=0;y<plane.lines;y++) {
+    k    = GLubyte(y + plane.speed*int64_t(index)); // diagonal gradient, moving with the frame number
+    line = dst + std::size_t(y)*plane.linesize;
+    x    = 0;
+#if defined(__SSE2__)
+    __m128i kv = _mm_set1_epi8(char(k));
+    for(;x+16<=plane.linesize;x=x+16) {
+      // xorshift32 in four lanes
+      state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+      state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+      state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+      __m128i ramp  = _mm_loadu_si128((const __m128i*)&plane.ramp[x]);
+      __m128i amask = _mm_loadu_si128((const __m128i*)&plane.addmask[x]);
+      __m128i nmask = _mm_loadu_si128((const __m128i*)&plane.noisemask[x]);
+      __m128i pix   = _mm_add_epi8(ramp, _mm_and_si128(kv, amask));
+      pix           = _mm_add_epi8(pix,  _mm_and_si128(state, nmask));
+      _mm_storeu_si128((__m128i*)(line+x), pix);
+    }
+#endif
+    for(;x<plane.linesize;x++) { // leftovers
+      noise[0] ^= noise[0]<<13; noise[0] ^= noise[0]>>17; noise[0] ^= noise[0]<<5;
+      line[x] = plane.ramp[x] + (k & plane.addmask[x]) + (GLubyte(noise[0]) & plane.noisemask[x]);
+    }
+  }
+#if defined(__SSE2__)
+  _mm_storeu_si128((__m128i*)noise, state);
+#endif
+}
+
+GLsizei FrameGenerator::stampBpp(PixelFormat format) {
+  switch (format) {
+    case(PIXFMT_BGRA):
+      return 4;
+    case(PIXFMT_YUYV):
+    case(PIXFMT_UYVY):
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+
+std::size_t FrameGenerator::stampOffset(PixelFormat format) {
+  return (format==PIXFMT_UYVY) ? 1 : 0;
+}
+
+
+
+void FrameGenerator::generate(GLubyte* dst, uint64_t index) {
+  int      bit, i;
+  GLsizei  bpp, linesize;
+  GLubyte  value;
+  GLubyte* frame = narrow.empty() ? dst : narrow.data();
+  
+  for(auto it=planes.begin(); it!=planes.end(); ++it) {
+    fillPlane(frame + it->offset, *it, index);
+  }
+  
+  // stamp the frame number : 32 blocks of 8x8, in luma / blue
+  bpp      = stampBpp(format);
+  linesize = planes[0].linesize;
+  frame    = frame + stampOffset(format);
+  for(bit=0; bit<32 && (bit+1)*8<=w; bit++) {
+    value = ((uint32_t(index)>>bit) & 1) ? 255 : 0;
+    for(i=0; i<8 && i<h; i++) {
+      for(int j=0;j<8;j++) {
+        frame[i*linesize + (bit*8+j)*bpp] = value;
+      }
+    }
+  }
+  
+  if (!narrow.empty()) {
+    i420ToYUV16((uint16_t*)dst, narrow.data(), format, w, h);
+  }
+}
+
+
+uint64_t FrameGenerator::next(GLubyte* dst) {
+  generate(dst, count);
+  return count++;
+}
+
+
+void FrameGenerator::wait() {
+  if (fps<=0) {
+    return;
+  }
+  std::this_thread::sleep_until(t0 + std::chrono::duration<double>(count/fps));
+}
+
+
+uint32_t FrameGenerator::readCounter(const GLubyte* data, PixelFormat format, GLsizei w) {
+  int      bit;
+  uint32_t index = 0;
+  GLsizei  bpp      = stampBpp(format);
+  GLsizei  linesize = w*bpp;
+  
+  if (format==PIXFMT_P010 || format==PIXFMT_I420P10) { // 16-bit words : 0 or the top of the 10-bit range
+    const uint16_t* words = (const uint16_t*)data;
+    uint16_t        half  = (format==PIXFMT_P010) ? 0x8000 : 0x200;
+    for(bit=0; bit<32 && (bit+1)*8<=w; bit++) {
+      if (words[4*w + bit*8+4]>=half) {
+        index |= (1u<<bit);
+      }
+    }
+    return index;
+  }
+  data = data + stampOffset(format);
+  for(bit=0; bit<32 && (bit+1)*8<=w; bit++) {
+    if (data[4*linesize + (bit*8+4)*bpp]>127) { // center of the block
+      index |= (1u<<bit);
+    }
+  }
+  return index;
+}
+
+
+WorkerPool::WorkerPool(int nthreads) : njobs(0), next(0), done(0), running(true) {
+  int i;
+  for(i=1;i<nthreads;i++) { // the caller is one of the threads
+    threads.push_back(std::thread(&WorkerPool::loop, this));
+  }
+}
+
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lk(mutex);
+    running = false;
+    cond.notify_all();
+  }
+  for(auto it=threads.begin(); it!=threads.end(); ++it) {
+    it->join();
+  }
+}
+
+
+bool WorkerPool::work(std::unique_lock<std::mutex>& lk) {
+  int i;
+  if (next>=njobs) {
+    return false;
+  }
+  i = next++;
+  lk.unlock();
+  job(i);
+  lk.lock();
+  done++;
+  if (done==njobs) {
+    done_cond.notify_all();
+  }
+  return true;
+}
+
+
+void WorkerPool::loop() {
+  TRACE_THREAD_NAME("worker");
+  std::unique_lock<std::mutex> lk(mutex);
+  while (true) {
+    cond.wait(lk, [this]{return !running || next<njobs;});
+    if (!running) {
+      break;
+    }
+    work(lk);
+  }
+}
+
+
+void WorkerPool::run(int njobs, std::function<void(int)> job) {
+  std::unique_lock<std::mutex> lk(mutex);
+  this->job   = job;
+  this->njobs = njobs;
+  next        = 0;
+  done        = 0;
+  cond.notify_all();
+  while (work(lk)) { // lend a hand
+  }
+  done_cond.wait(lk, [this]{return done>=this->njobs;});
+  this->njobs = 0;
+}
+
+
+UploadScheduler::UploadScheduler(std::size_t budget, FramePool* pool) : budget(budget), pool(pool), ticks(0) {
+}
+
+
+UploadScheduler::~UploadScheduler() {
+  for(auto it=streams.begin(); it!=streams.end(); ++it) {
+    if (it->data && pool) {
+      pool->release(it->data);
+    }
+  }
+}
+
+
+int UploadScheduler::addStream() {
+  Stream stream;
+  stream.visible     = true;
+  stream.area        = 0;
+  stream.weight      = 1;
+  stream.data        = NULL;
+  stream.size        = 0;
+  stream.age         = 0;
+  stream.stats       = UploadStreamStats{0, 0, 0, 0, 0, 0, 0, 0};
+  stream.latency_sum = 0;
+  
+  MetricsRegistry& registry = MetricsRegistry::get();
+  std::string      label    = MetricsRegistry::label("stream", streams.size());
+  stream.metric_uploaded = &registry.counter("upload_frames_total", "Frames uploaded", label);
+  stream.metric_bytes    = &registry.counter("upload_bytes_total", "Bytes uploaded", label);
+  stream.metric_hidden   = &registry.counter("upload_frames_dropped_total", "Frames not uploaded", label + ",reason=\"hidden\"");
+  stream.metric_replaced = &registry.counter("upload_frames_dropped_total", "Frames not uploaded", label + ",reason=\"replaced\"");
+  stream.metric_deferred = &registry.counter("upload_frames_deferred_total", "Times a pending frame didn't fit into the upload budget", label);
+  streams.push_back(stream);
+  return streams.size()-1;
+}
+
+
+void UploadScheduler::setTile(int stream, bool visible, GLsizei w, GLsizei h) {
+  Stream& s = streams[stream];
+  s.visible = visible && w>0 && h>0;
+  s.area    = double(w)*h;
+  if (!s.visible && s.data) {
+    s.stats.dropped_hidden++;
+    s.metric_hidden->add();
+    s.age = 0;
+    drop(s);
+  }
+}
+
+
+void UploadScheduler::setWeight(int stream, double weight) {
+  streams[stream].weight = weight;
+}
+
+
+void UploadScheduler::drop(Stream& stream) {
+  if (pool) {
+    pool->release(stream.data);
+  }
+  stream.data = NULL;
+}
+
+
+void UploadScheduler::push(int stream, GLubyte* data, std::size_t size) {
+  Stream& s = streams[stream];
+  s.stats.pushed++;
+  if (s.data) { // latest frame wins
+    s.stats.dropped_replaced++;
+    s.metric_replaced->add();
+    drop(s);
+  }
+  if (!s.visible) {
+    s.stats.dropped_hidden++;
+    s.metric_hidden->add();
+    if (pool) {
+      pool->release(data);
+    }
+    return;
+  }
+  s.data = data;
+  s.size = size;
+  s.t    = std::chrono::steady_clock::now();
+}
+
+
+std::size_t UploadScheduler::tick(const UploadFunction& upload) {
+  std::size_t spent = 0;
+  double      ms;
+  int         i;
+  
+  ticks++;
+  order.clear();
+  for(i=0;i<int(streams.size());i++) {
+    if (streams[i].data) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [this](int a, int b) {return score(streams[a])>score(streams[b]);});
+  
+  for(auto it=order.begin(); it!=order.end(); ++it) {
+    Stream& s = streams[*it];
+    if (spent>0 && spent+s.size>budget) { // doesn't fit : next time, with a higher priority.  Smaller frames further down may still fit
+      s.age++;
+      s.stats.deferred++;
+      s.metric_deferred->add();
+      continue;
+    }
+    upload(*it, s.data, s.size);
+    spent += s.size;
+    ms = std::chrono::duration<double>(std::chrono::steady_clock::now()-s.t).count()*1000;
+    s.stats.uploaded++;
+    s.stats.bytes       += s.size;
+    s.metric_uploaded->add();
+    s.metric_bytes->add(s.size);
+    s.stats.latency_max  = std::max(s.stats.latency_max, ms);
+    s.latency_sum       += ms;
+    s.age                = 0;
+    drop(s);
+  }
+  return spent;
+}
+
+
+UploadStreamStats UploadScheduler::getStats(int stream) {
+  UploadStreamStats stats = streams[stream].stats;
+  stats.latency_avg = stats.uploaded ? streams[stream].latency_sum/stats.uploaded : 0;
+  return stats;
+}
+
+
+void UploadScheduler::printStats() {
+  int i;
+  std::cout << "UploadScheduler : printStats : " << ticks << " ticks, budget " << budget/1024 << " kB per tick" << std::endl;
+  for(i=0;i<int(streams.size());i++) {
+    UploadStreamStats stats = getStats(i);
+    std::cout << "UploadScheduler : stream " << i << (streams[i].visible ? "" : " (hidden)") << " area " << streams[i].area
+              << " : pushed " << stats.pushed << " uploaded " << stats.uploaded << " dropped hidden " << stats.dropped_hidden
+              << " dropped replaced " << stats.dropped_replaced << " deferred " << stats.deferred << " latency avg " << stats.latency_avg
+              << " max " << stats.latency_max << " ms" << std::endl;
+  }
+}
+
+
+FramePacer::FramePacer(Display* display, GLXDrawable drawable, int interval) : egl(false), display(display), drawable(drawable), egl_display(EGL_NO_DISPLAY), egl_surface(EGL_NO_SURFACE), interval(interval) {
+  const char* extensions = glXQueryExtensionsString(display, DefaultScreen(display));
+  
+  swap_control  = "none";
+  getSyncValues = NULL;
+  getMscRate    = NULL;
+  
+  // an advertised extension can still resolve to NULL : fall through to the next one then
+  GLXSwapIntervalEXTProc  swapIntervalEXT  = NULL;
+  GLXSwapIntervalMESAProc swapIntervalMESA = NULL;
+  GLXSwapIntervalSGIProc  swapIntervalSGI  = NULL;
+  if (hasExtension(extensions, "GLX_EXT_swap_control")) {
+    swapIntervalEXT = (GLXSwapIntervalEXTProc)glXGetProcAddress((const GLubyte*)"glXSwapIntervalEXT");
+  }
+  if (hasExtension(extensions, "GLX_MESA_swap_control")) {
+    swapIntervalMESA = (GLXSwapIntervalMESAProc)glXGetProcAddress((const GLubyte*)"glXSwapIntervalMESA");
+  }
+  if (hasExtension(extensions, "GLX_SGI_swap_control") && interval>0) { // can't switch vsync off
+    swapIntervalSGI = (GLXSwapIntervalSGIProc)glXGetProcAddress((const GLubyte*)"glXSwapIntervalSGI");
+  }
+  
+  if (swapIntervalEXT) {
+    swapIntervalEXT(display, drawable, interval);
+    swap_control = "GLX_EXT_swap_control";
+  }
+  else if (swapIntervalMESA) {
+    swapIntervalMESA(interval);
+    swap_control = "GLX_MESA_swap_control";
+  }
+  else if (swapIntervalSGI) {
+    swapIntervalSGI(interval);
+    swap_control = "GLX_SGI_swap_control";
+  }
+  
+  if (hasExtension(extensions, "GLX_OML_sync_control")) {
+    getSyncValues = (GLXGetSyncValuesOMLProc)glXGetProcAddress((const GLubyte*)"glXGetSyncValuesOML");
+    getMscRate    = (GLXGetMscRateOMLProc)glXGetProcAddress((const GLubyte*)"glXGetMscRateOML");
+    if (!getSyncValues || !getMscRate) {
+      getSyncValues = NULL;
+      getMscRate    = NULL;
+    }
+  }
+  init();
+}
+
+
+FramePacer::FramePacer(EGLDisplay display, EGLSurface surface, int interval) : egl(true), display(NULL), drawable(0), egl_display(display), egl_surface(surface), interval(interval) {
+  swap_control  = eglSwapInterval(display, interval) ? "eglSwapInterval" : "none";
+  getSyncValues = NULL; // no msc counters in plain egl
+  getMscRate    = NULL;
+  init();
+}
+
+
+FramePacer::~FramePacer() {
+}
+
+
+bool FramePacer::hasExtension(const char* extensions, const char* name) { // whole words only : GLX_EXT_swap_control is a prefix of GLX_EXT_swap_control_tear
+  const char* p = extensions;
+  std::size_t n = strlen(name);
+  while (p && (p = strstr(p, name))) {
+    if ((p==extensions || p[-1]==' ') && (p[n]==' ' || p[n]==0)) {
+      return true;
+    }
+    p += n;
+  }
+  return false;
+}
+
+
+void FramePacer::init() {
+  int32_t numerator, denominator;
+  int64_t ust, sbc;
+  
+  period       = 1.0/60;
+  period_known = false;
+  margin       = 0.002;
+  work         = 0.004;
+  jit          = true;
+  last_msc     = -1;
+  frames       = 0;
+  missed       = 0;
+  last_present = std::chrono::steady_clock::now();
+  
+  MetricsRegistry& registry = MetricsRegistry::get();
+  metric_frames   = &registry.counter("render_frames_total", "Frames presented");
+  metric_missed   = &registry.counter("render_missed_vblanks_total", "Vblanks without a new frame");
+  metric_interval = &registry.histogram("render_frame_interval_seconds", "Time between presents", MetricsRegistry::timeBuckets());
+  metric_latency  = &registry.histogram("render_latency_seconds", "Capture / decode of a stream's frame to its present", MetricsRegistry::timeBuckets());
+  
+  if (getMscRate && getMscRate(display, drawable, &numerator, &denominator) && numerator>0 && denominator>0) {
+    period       = double(denominator)/numerator;
+    period_known = true;
+  }
+  if (getSyncValues && !getSyncValues(display, drawable, &ust, &last_msc, &sbc)) {
+    last_msc = -1;
+  }
+  std::cout << "FramePacer : swap control " << swap_control << ", OML sync control " << (getSyncValues ? "yes" : "no")
+            << ", refresh " << 1/period << " Hz" << (period_known ? "" : " (estimated)") << std::endl;
+}
+
+
+void FramePacer::beginFrame() {
+  if (jit && interval>0 && frames>0) {
+    auto deadline = last_present + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval*period - work - margin));
+    if (deadline>std::chrono::steady_clock::now()) {
+      std::this_thread::sleep_until(deadline);
+    }
+  }
+  frame_start = std::chrono::steady_clock::now();
+  inputs.clear();
+}
+
+
+void FramePacer::addInput(int stream, std::chrono::steady_clock::time_point t) {
+  inputs.push_back(std::make_pair(stream, t));
+}
+
+
+void FramePacer::endFrame() {
+  int64_t  ust, msc, sbc;
+  double   dt, ms;
+  uint64_t missed0 = missed;
+  
+  auto swap_start = std::chrono::steady_clock::now();
+  work = 0.9*work + 0.1*std::chrono::duration<double>(swap_start-frame_start).count(); // upload + render time, smoothed
+  
+  {
+    TRACE_SCOPE("swap");
+    if (egl) {
+      eglSwapBuffers(egl_display, egl_surface);
+    }
+    else {
+      glXSwapBuffers(display, drawable);
+    }
+    glFinish(); // returns once the swap has been done, i.e. at the vblank when vsync is on
+  }
+  auto present = std::chrono::steady_clock::now();
+  
+  // missed vblanks
+  dt = std::chrono::duration<double>(present-last_present).count();
+  if (getSyncValues && getSyncValues(display, drawable, &ust, &msc, &sbc)) {
+    if (last_msc>=0 && frames>0 && interval>0 && msc-last_msc>interval) {
+      missed += (msc-last_msc-interval)/interval;
+    }
+    last_msc = msc;
+  }
+  else if (frames>0 && interval>0) {
+    if (dt>1.5*interval*period) {
+      missed += uint64_t(dt/(interval*period)+0.5)-1;
+    }
+    else if (!period_known) {
+      period = 0.95*period + 0.05*(dt/interval);
+    }
+  }
+  
+  // input => display latencies
+  for(auto it=inputs.begin(); it!=inputs.end(); ++it) {
+    PresentStats& stats = stream_stats[it->first];
+    ms = std::chrono::duration<double>(present-it->second).count()*1000;
+    stats.frames++;
+    stats.latency_max = std::max(stats.latency_max, ms);
+    latency_sums[it->first] += ms;
+    metric_latency->observe(ms/1000);
+  }
+  inputs.clear();
+  
+  if (frames>0) {
+    metric_interval->observe(dt);
+  }
+  metric_missed->add(missed-missed0);
+  metric_frames->add();
+  last_present = present;
+  frames++;
+}
+
+
+PresentStats FramePacer::getStats() {
+  return PresentStats{frames, missed, 0, 0};
+}
+
+
+PresentStats FramePacer::getStats(int stream) {
+  PresentStats stats = stream_stats[stream];
+  stats.latency_avg = stats.frames ? latency_sums[stream]/stats.frames : 0;
+  return stats;
+}
+
+
+void FramePacer::printStats() {
+  std::cout << "FramePacer : " << frames << " frames, " << missed << " missed vblanks, refresh " << 1/period << " Hz, upload + render "
+            << work*1000 << " ms" << std::endl;
+  for(auto it=stream_stats.begin(); it!=stream_stats.end(); ++it) {
+    PresentStats stats = getStats(it->first);
+    std::cout << "FramePacer : stream " << it->first << " : " << stats.frames << " frames displayed, input to display latency avg "
+              << stats.latency_avg << " max " << stats.latency_max << " ms" << std::endl;
+  }
+}
+
+
+WindowManager::WindowManager(OpenGLContext* ctx) : ctx(ctx), current(0), context_switches(0), frames(0) {
+  metric_frames = &MetricsRegistry::get().counter("render_window_passes_total", "Render passes over all windows, each ending with a swap of every window");
+}
+
+
+WindowManager::~WindowManager() {
+  for(auto it=windows.begin(); it!=windows.end(); ++it) {
+    XDestroyWindow(ctx->getDisplay(), it->id);
+  }
+}
+
+
+int WindowManager::addWindow(const char* name) {
+  ManagedWindow     window;
+  XWindowAttributes wa;
+  
+  window.id = ctx->createWindow();
+  XSelectInput(ctx->getDisplay(), window.id, ExposureMask | KeyPressMask | StructureNotifyMask); // + geometry changes
+  if (name) {
+    XStoreName(ctx->getDisplay(), window.id, name);
+  }
+  XGetWindowAttributes(ctx->getDisplay(), window.id, &wa); // once : from here on, ConfigureNotify keeps it up to date
+  window.width  = wa.width;
+  window.height = wa.height;
+  window.dirty  = true;
+  windows.push_back(window);
+  return windows.size()-1;
+}
+
+
+void WindowManager::setStream(int stream, const StreamTextures& textures) {
+  StreamTextures& old = streams[stream];
+  bool resized = old.w!=textures.w || old.h!=textures.h;
+  old = textures;
+  if (resized) { // aspect ratios change
+    for(auto it=windows.begin(); it!=windows.end(); ++it) {
+      it->dirty = true;
+    }
+  }
+}
+
+
+void WindowManager::assign(int window, int stream, GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+  Tile tile;
+  tile.stream = stream;
+  tile.x      = x;
+  tile.y      = y;
+  tile.w      = w;
+  tile.h      = h;
+  windows[window].tiles.push_back(tile);
+  windows[window].dirty = true;
+}
+
+
+void WindowManager::assignGrid(int window, const std::vector<int>& streams) {
+  int i, cols, rows;
+  
+  clear(window);
+  if (streams.empty()) {
+    return;
+  }
+  cols = int(std::ceil(std::sqrt(double(streams.size()))));
+  rows = (streams.size()+cols-1)/cols;
+  for(i=0;i<int(streams.size());i++) { // row 0 at the top
+    assign(window, streams[i], GLfloat(i%cols)/cols, GLfloat(rows-1-i/cols)/rows, 1.0f/cols, 1.0f/rows);
+  }
+}
+
+
+void WindowManager::clear(int window) {
+  windows[window].tiles.clear();
+  windows[window].dirty = true;
+}
+
+
+void WindowManager::layout(ManagedWindow& window) {
+  GLfloat r;
+  for(auto it=window.tiles.begin(); it!=window.tiles.end(); ++it) {
+    const StreamTextures& textures = streams[it->stream];
+    it->vx = GLint(it->x*window.width);
+    it->vy = GLint(it->y*window.height);
+    it->vw = std::max(1, GLint((it->x+it->w)*window.width)  - it->vx);
+    it->vh = std::max(1, GLint((it->y+it->h)*window.height) - it->vy);
+    // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
+    r = (textures.w>0 && textures.h>0) ? float(it->vh*textures.w) / float(it->vw*textures.h) : 1;
+    it->transform = std::array<GLfloat,16>{
+      r<1 ? r : 1.0f, 0.0f,             0.0f,   0.0f, 
+      0.0f,           r>1 ? 1/r : 1.0f, 0.0f,   0.0f,
+      0.0f,           0.0f,             1.0f,   0.0f,
+      0.0f,           0.0f,             0.0f,   1.0f
+    };
+  }
+  window.dirty = false;
+}
+
+
+void WindowManager::processEvents() {
+  XEvent event;
+  while (XPending(ctx->getDisplay())) {
+    XNextEvent(ctx->getDisplay(), &event);
+    if (event.type!=ConfigureNotify) {
+      continue;
+    }
+    for(auto it=windows.begin(); it!=windows.end(); ++it) {
+      if (it->id==event.xconfigure.window && (it->width!=event.xconfigure.width || it->height!=event.xconfigure.height)) {
+        it->width  = event.xconfigure.width;
+        it->height = event.xconfigure.height;
+        it->dirty  = true;
+      }
+    }
+  }
+}
+
+
+void WindowManager::render(YUVShader* shader) {
+  GLStateCache& state = ctx->getState();
+  
+  for(auto it=windows.begin(); it!=windows.end(); ++it) {
+    TRACE_SCOPE("draw window");
+    if (current!=it->id) {
+      ctx->makeCurrent(it->id);
+      current = it->id;
+      context_switches++;
+    }
+    if (it->dirty) {
+      layout(*it);
+    }
+    state.viewport(0, 0, it->width, it->height);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    state.useProgram(shader->getProgram());
+    state.uniform1i(shader->texy, 0); // sampler units
+    state.uniform1i(shader->texu, 1);
+    state.uniform1i(shader->texv, 2);
+    state.bindVertexArray(ctx->getVAO());
+    
+    for(auto tile=it->tiles.begin(); tile!=it->tiles.end(); ++tile) {
+      auto stream = streams.find(tile->stream);
+      if (stream==streams.end()) {
+        continue;
+      }
+      state.viewport(tile->vx, tile->vy, tile->vw, tile->vh);
+      state.bindTextureUnit(0, stream->second.y_tex);
+      state.bindTextureUnit(1, stream->second.u_tex);
+      state.bindTextureUnit(2, stream->second.v_tex);
+      state.uniformMatrix4fv(shader->transform, tile->transform.data());
+      glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
+  }
+  TRACE_SCOPE("swap");
+  for(auto it=windows.begin(); it!=windows.end(); ++it) { // swap last, so that the windows don't wait for each others' vblanks in between
+    glXSwapBuffers(ctx->getDisplay(), it->id);
+  }
+  metric_frames->add();
+  frames++;
+}
+
+
+const int TileRenderer::nregions;
+
+
+TileRenderer::TileRenderer(OpenGLContext* ctx, GLsizei w, GLsizei h, int layers) : ctx(ctx), w(w), h(h), layers(layers), mapped(NULL), region(0), ntiles(0) {
+  GLint alignment;
+  int   i;
+  const GLsizei dims[3][2] = {{w, h}, {w/2, h/2}, {w/2, h/2}};
+  
+  shader = new YUVTileShader();
+  
+  // planes in texture arrays : a layer per stream
+  glGenTextures(3, arrays);
+  for(i=0;i<3;i++) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, dims[i][0], dims[i][1], layers, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0); // unbind
+  
+  // bt.601 limited range, as in YUVShader : rgb = M * (yuv + offset) = M * yuv + M * offset
+  const GLfloat M[3][3] = {
+    {1.164f,  0.000f,  1.596f},
+    {1.164f, -0.391f, -0.813f},
+    {1.164f,  2.018f,  0.000f}
+  };
+  const GLfloat offset[3] = {-0.0625f, -0.5f, -0.5f};
+  memset(&params, 0, sizeof(params));
+  for(int r=0;r<3;r++) {
+    for(int c=0;c<3;c++) {
+      params.colour[4*c+r] = M[r][c];   // column major
+      params.colour[12+r] += M[r][c]*offset[c];
+    }
+  }
+  params.colour[15] = 1;
+  
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  alignment   = std::max(alignment, 16);
+  region_size = ((sizeof(FrameParams)+alignment-1)/alignment)*alignment;
+  fences.fill((GLsync)0);
+  
+  glGenBuffers(1, &ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  if (GLEW_ARB_buffer_storage) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, nregions*region_size, 0, flags);
+    mapped = (GLubyte*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, nregions*region_size, flags);
+  }
+  if (!mapped) {
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParams), 0, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0); // unbind
+  ctx->getState().invalidate(); // raw gl calls above
+  
+  std::cout << "TileRenderer : " << layers << " layers of " << w << "x" << h << ", uniform buffer " << (mapped ? "persistent mapped" : "glBufferSubData")
+            << ", " << sizeof(FrameParams) << " bytes per frame" << std::endl;
+}
+
+
+TileRenderer::~TileRenderer() {
+  for(auto it=fences.begin(); it!=fences.end(); ++it) {
+    if (*it) {
+      glDeleteSync(*it);
+    }
+  }
+  if (mapped) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &ubo);
+  glDeleteTextures(3, arrays);
+  ctx->getState().invalidate(); // names may be reused
+  delete shader;
+}
+
+
+void TileRenderer::uploadLayer(int layer, const GLubyte* frame) {
+  std::size_t size = std::size_t(w)*h;
+  const GLubyte* planes[3]   = {frame, frame+size, frame+(5*size)/4};
+  const GLsizei  dims[3][2]  = {{w, h}, {w/2, h/2}, {w/2, h/2}};
+  int   i;
+  GLint alignment;
+  
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment); // the caller's, restored below
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for(i=0;i<3;i++) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, dims[i][0], dims[i][1], 1, GL_RED, GL_UNSIGNED_BYTE, planes[i]);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0); // unbind
+  glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+
+void TileRenderer::clearTiles() {
+  ntiles = 0;
+}
+
+
+bool TileRenderer::addTile(int layer, GLint x, GLint y, GLsizei tw, GLsizei th, GLsizei win_w, GLsizei win_h) {
+  GLfloat r;
+  if (ntiles>=YUVTileShader::max_tiles || layer<0 || layer>=layers) {
+    return false;
+  }
+  TileParams& tile = params.tiles[ntiles++];
+  
+  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
+  r = float(th*w) / float(tw*h);
+  memset(tile.transform, 0, sizeof(tile.transform));
+  tile.transform[0]  = r<1 ? r : 1;
+  tile.transform[5]  = r>1 ? 1/r : 1;
+  tile.transform[10] = 1;
+  tile.transform[15] = 1;
+  
+  tile.rect[0] = 2*GLfloat(x)/win_w - 1;
+  tile.rect[1] = 2*GLfloat(y)/win_h - 1;
+  tile.rect[2] = 2*GLfloat(x+tw)/win_w - 1;
+  tile.rect[3] = 2*GLfloat(y+th)/win_h - 1;
+  tile.layer[0] = layer;
+  return true;
+}
+
+
+void TileRenderer::render() {
+  TRACE_SCOPE("draw tiles");
+  GLStateCache& state = ctx->getState();
+  std::size_t   size  = offsetof(FrameParams, tiles) + ntiles*sizeof(TileParams); // only what's used
+  
+  if (ntiles==0) {
+    return;
+  }
+  if (mapped) {
+    if (fences[region]) { // the gpu might still read this region : normally done long ago
+      glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+      glDeleteSync(fences[region]);
+      fences[region] = (GLsync)0;
+    }
+    memcpy(mapped + region*region_size, &params, size);
+    state.bindBuffer(GL_UNIFORM_BUFFER, ubo); // glBindBufferRange sets the generic binding too : keep the cache right
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, ubo, region*region_size, sizeof(FrameParams));
+  }
+  else {
+    state.bindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &params);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
+  }
+  
+  state.useProgram(shader->getProgram());
+  for(int i=0;i<3;i++) {
+    state.activeTexture(GL_TEXTURE0+i);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]); // not cached : 2d arrays
+  }
+  state.bindVertexArray(ctx->getVAO());
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, ntiles);
+  
+  if (mapped) {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region+1) % nregions;
+  }
+}
+
+
+const char* downscaleModeName(DownscaleMode mode) {
+  switch (mode) {
+    case(DOWNSCALE_NONE):
+      return "none";
+    case(DOWNSCALE_MIPMAP):
+      return "mipmap";
+    case(DOWNSCALE_GPU_BOX):
+      return "gpu box";
+    case(DOWNSCALE_CPU):
+      return "cpu";
+  }
+  return "?";
+}
+
+
+StreamDownscaler::StreamDownscaler(OpenGLContext* ctx, GLsizei w, GLsizei h, DownscaleMode mode, int max_level) : ctx(ctx), w(w), h(h), mode(mode), max_level(max_level), level(0), bytes(0) {
+  GLStateCache& state = ctx->getState();
+  int l, i, levels;
+  
+  levels = (mode==DOWNSCALE_GPU_BOX || mode==DOWNSCALE_CPU) ? max_level+1 : 1; // textures of their own per level
+  texs.resize(levels);
+  for(l=0;l<levels;l++) {
+    glGenTextures(3, texs[l].data());
+    for(i=0;i<3;i++) {
+      state.bindTexture(GL_TEXTURE_2D, texs[l][i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      if (mode==DOWNSCALE_MIPMAP) { // the whole chain, so that the texture is complete whatever the max level
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        for(int m=0;m<=max_level;m++) {
+          glTexImage2D(GL_TEXTURE_2D, m, GL_R8, std::max(1, planeWidth(i, m)), std::max(1, planeHeight(i, m)), 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+        }
+      }
+      else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planeWidth(i, l), planeHeight(i, l), 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+      }
+    }
+  }
+  state.bindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  if (mode==DOWNSCALE_GPU_BOX) {
+    fbos.resize(levels);
+    for(l=0;l<levels;l++) {
+      for(i=0;i<3;i++) {
+        getFBO(fbos[l][i], texs[l][i]);
+      }
+    }
+  }
+}
+
+
+StreamDownscaler::~StreamDownscaler() {
+  for(auto it=fbos.begin(); it!=fbos.end(); ++it) {
+    glDeleteFramebuffers(3, it->data());
+  }
+  for(auto it=texs.begin(); it!=texs.end(); ++it) {
+    glDeleteTextures(3, it->data());
+  }
+  ctx->getState().invalidate(); // names may be reused
+}
+
+
+int StreamDownscaler::chooseLevel(GLsizei w, GLsizei h, GLsizei tile_w, GLsizei tile_h, int max_level) {
+  int l = 0;
+  while (l<max_level && (w>>(l+1))>=tile_w && (h>>(l+1))>=tile_h) { // halving still leaves at least one texel per pixel
+    l++;
+  }
+  return l;
+}
+
+
+void StreamDownscaler::uploadPlanes(int level, const GLubyte* frame) {
+  GLStateCache& state = ctx->getState();
+  std::size_t offset = 0;
+  int i;
+  
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for(i=0;i<3;i++) {
+    state.bindTexture(GL_TEXTURE_2D, texs[level][i]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planeWidth(i, level), planeHeight(i, level), GL_RED, GL_UNSIGNED_BYTE, frame+offset);
+    offset += std::size_t(planeWidth(i, level))*planeHeight(i, level);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  bytes += offset;
+}
+
+
+void StreamDownscaler::upload(const GLubyte* frame, GLsizei tile_w, GLsizei tile_h) {
+  GLStateCache& state = ctx->getState();
+  int i, l;
+  
+  level = mode==DOWNSCALE_NONE ? 0 : chooseLevel(w, h, tile_w, tile_h, max_level);
+  
+  switch (mode) {
+    case(DOWNSCALE_NONE):
+      uploadPlanes(0, frame);
+      break;
+      
+    case(DOWNSCALE_MIPMAP):
+      uploadPlanes(0, frame);
+      for(i=0;i<3;i++) {
+        state.bindTexture(GL_TEXTURE_2D, texs[0][i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level); // sample & generate only what's needed
+        if (level>0) {
+          glGenerateMipmap(GL_TEXTURE_2D);
+        }
+      }
+      break;
+      
+    case(DOWNSCALE_GPU_BOX):
+      uploadPlanes(0, frame);
+      for(l=1;l<=level;l++) { // halve level by level : 2:1 linear filtering samples exactly between 2x2 texels
+        for(i=0;i<3;i++) {
+          glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[l-1][i]);
+          glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[l][i]);
+          glBlitFramebuffer(0, 0, 2*planeWidth(i, l), 2*planeHeight(i, l), 0, 0, planeWidth(i, l), planeHeight(i, l), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+      }
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, 0); // unbind
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      break;
+      
+    case(DOWNSCALE_CPU):
+      if (level==0) {
+        uploadPlanes(0, frame);
+        break;
+      }
+      {
+        const GLubyte* src = frame;
+        for(l=1;l<=level;l++) {
+          std::vector<GLubyte>& dst = scratch[l%2];
+          std::size_t src_offset = 0, dst_offset = 0;
+          dst.resize(frameSize(PIXFMT_I420, w>>l, h>>l)+16);
+          for(i=0;i<3;i++) {
+            downscale2x2(dst.data()+dst_offset, src+src_offset, planeWidth(i, l-1), planeHeight(i, l-1));
+            src_offset += std::size_t(planeWidth(i, l-1))*planeHeight(i, l-1);
+            dst_offset += std::size_t(planeWidth(i, l))*planeHeight(i, l);
+          }
+          src = dst.data();
+        }
+        uploadPlanes(level, src);
+      }
+      break;
+  }
+}
+
+
+StreamTextures StreamDownscaler::getTextures() {
+  int l = (mode==DOWNSCALE_GPU_BOX || mode==DOWNSCALE_CPU) ? level : 0; // mipmaps are in the level 0 textures
+  return StreamTextures{texs[l][0], texs[l][1], texs[l][2], w, h};   // aspect ratio of the full frame
+}
+
+
+const char* convertPathName(ConvertPath path) {
+  return path==CONVERT_CPU ? "cpu" : "gpu";
+}
+
+
+ConvertRenderer::ConvertRenderer(OpenGLContext* ctx, GLsizei w, GLsizei h, WorkerPool* workers) : ctx(ctx), w(w), h(h), workers(workers), gpu_ms(0), cpu_ms(0) {
+  GLubyte* payload;
+  GLuint*  texs[4] = {&y_tex, &u_tex, &v_tex, &rgb_tex};
+  const GLsizei dims[4][2] = {{w, h}, {w/2, h/2}, {w/2, h/2}, {w, h}};
+  int i;
+  
+  yuv_shader = new YUVShader();
+  rgb_shader = new RGBShader();
+  
+  for(i=0;i<4;i++) {
+    glGenTextures(1, texs[i]);
+    glBindTexture(GL_TEXTURE_2D, *texs[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (i<3) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, dims[i][0], dims[i][1], 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    }
+    else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, dims[i][0], dims[i][1], 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  getPBO(rgb_pbo, w*h*4, payload);
+  ctx->getState().invalidate(); // raw gl calls above
+}
+
+
+ConvertRenderer::~ConvertRenderer() {
+  GLuint texs[4] = {y_tex, u_tex, v_tex, rgb_tex};
+  glDeleteTextures(4, texs);
+  glDeleteBuffers(1, &rgb_pbo);
+  ctx->getState().invalidate(); // names may be reused
+  delete yuv_shader;
+  delete rgb_shader;
+}
+
+
+void ConvertRenderer::render(ConvertPath path, const GLubyte* frame, GLint x, GLint y, GLsizei vw, GLsizei vh) {
+  GLStateCache& state = ctx->getState();
+  std::size_t   size  = std::size_t(w)*h;
+  GLubyte*      payload;
+  
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (path==CONVERT_GPU) {
+    state.bindTexture(GL_TEXTURE_2D, y_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, frame);
+    state.bindTexture(GL_TEXTURE_2D, u_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, frame+size);
+    state.bindTexture(GL_TEXTURE_2D, v_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, frame+(5*size)/4);
+    ctx->drawYUVShader(yuv_shader, y_tex, u_tex, v_tex, x, y, vw, vh, w, h);
+  }
+  else {
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, rgb_pbo);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size*4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    yuvToRGBA(payload, frame, w, h, workers); // straight into the pbo
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    state.bindTexture(GL_TEXTURE_2D, rgb_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    ctx->drawRGBShader(rgb_shader, rgb_tex, x, y, vw, vh, w, h);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+
+ConvertPath ConvertRenderer::choose(const GLubyte* frame, int n) {
+  GLuint target, fbo;
+  int    i, p;
+  double ms[2];
+  const ConvertPath paths[2] = {CONVERT_GPU, CONVERT_CPU};
+  
+  // offscreen, at the frame size : window size & vsync stay out of it
+  glGenTextures(1, &target);
+  glBindTexture(GL_TEXTURE_2D, target);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  ctx->getState().invalidate();
+  getFBO(fbo, target);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  
+  for(p=0;p<2;p++) {
+    render(paths[p], frame, 0, 0, w, h); // warm up
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for(i=0;i<n;i++) {
+      render(paths[p], frame, 0, 0, w, h);
+      glFinish();
+    }
+    ms[p] = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count()*1000/n;
+  }
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, 0); // unbind
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &target);
+  ctx->getState().invalidate();
+  
+  gpu_ms = ms[0];
+  cpu_ms = ms[1];
+  std::cout << "ConvertRenderer : choose : " << glGetString(GL_RENDERER) << " : " << w << "x" << h << " gpu conversion " << gpu_ms
+            << " ms, cpu conversion " << cpu_ms << " ms (" << (workers ? workers->getThreads() : 1) << " threads)" << std::endl;
+  return cpu_ms<gpu_ms ? CONVERT_CPU : CONVERT_GPU;
+}
+
+
+void test_1() { // just create a window
+  Window w;
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  w=ctx.createWindow();
+  ctx.makeCurrent(w);
+  
+  sleep_for(3s);
+}
+
+
+void test_2() {
+  Window  win;
+  GLuint  pbo_index, tex_index;
+  GLubyte *payload;
+  GLint   format, internal_format; 
+  GLsizei w, h, size;
+  int     i;
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  /* format              : format of the texture .. OpenGL might and will convert this to internal format
+   *                       for example, for glTexImage2D : https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
+   *                       "GL_RED : each element is a single red component. The GL converts it to floating point and assembles it into an RGBA element by .."
+   * 
+   * internal_format     : 
+   * 
+   * 
+   */
+  
+  // see allowed format/internal format here:
+  // https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
+  
+  // *** Slow as hell ***  .. this one works with my shader program .. There I use separate LUMA and CHROMA textures
+  // format          =GL_RED; 
+  // internal_format =GL_RED;
+  
+  // *** Slow as a snail in sahara ***
+  // format          =GL_RED;
+  // internal_format =GL_R8;
+  
+  // *** This is absolutely fast & beautiful ! ***
+  // *** .. but, we only want to upload data with single component to the GPU, not RGBA ..!
+  format             =GL_RGBA; // 0.008971 ms
+  // internal_format    =GL_RGBA;
+  internal_format    =GL_RGBA8; // we must use sized formats since 3.2+ ?
+  
+  // format             =GL_BGRA; // 0.003769 ms .. but internal format can't be GL_BGRA doesn't make sense
+  // internal_format    =GL_BGRA;
+  
+  // how to transfer this to the shader program .. ?
+  // * create a single GL_BGRA "texture" .. eh, where the data has been dumped somehow..
+  // * say, let's put: Y=>B, U=>G, V=>R, A=0
+  // * .. shader program must do some coreography to pull this one off
+  
+  w               =1920;
+  h               =1080;
+  size            =w*h;  // size of a LUMA HD frame
+  
+  // let's reserve a PBO
+  glGenBuffers(1, &pbo_index);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW); // reserve n_payload bytes to index/handle pbo_id
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind (not mandatory)
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index); // rebind (not mandatory)
+  
+  payload = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  
+  std::cout << "pbo " << pbo_index << " at " << (long unsigned int)payload << std::endl;
+  
+  // let's reserve a texture
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(1, &tex_index);
+  
+  std::cout << "texture " << tex_index << std::endl;
+  
+  glBindTexture(GL_TEXTURE_2D, tex_index);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); // no upload, just reserve 
+  /* https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml : "GL_RED : each element is a single red component. The GL converts it to floating point and assembles it into an RGBA element by attaching 0 for green" 
+   * 
+   * 
+   */
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  for(i=0;i<10;i++) {
+    // "copy" data to pbo
+    start = std::chrono::system_clock::now();
+    memset(payload,0,size);
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    std::cout << "memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  }
+  
+  std::cout << std::endl;
+  
+  for(i=0;i<10;i++) {
+    start = std::chrono::system_clock::now();
+    // copy from pbo to texture
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index);
+    glBindTexture(GL_TEXTURE_2D, tex_index); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glFinish();
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    std::cout << "pbo => texture took " << dt.count()*1000 << " ms" << std::endl;
+  }
+}
+
+
+void test_3() {
+  Window  win;
+  GLuint  tbo_index, tex_index;
+  GLubyte *payload;
+  GLint   format, internal_format; 
+  GLsizei w, h, size;
+  int     i;
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  w               =1920;
+  h               =1080;
+  size            =w*h;  // size of a LUMA HD frame
+  
+  glEnable(GL_TEXTURE_2D);
+  
+  // let's reserve a TBO
+  glGenBuffers(1, &tbo_index); // a buffer
+  glBindBuffer(GL_TEXTURE_BUFFER, tbo_index); // .. what is it
+  glBufferData(GL_TEXTURE_BUFFER, size, 0, GL_STREAM_DRAW); // .. how much
+  
+  // generate a texture
+  glGenTextures(1, &tex_index);
+  std::cout << "texture " << tex_index << std::endl;
+  
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, tbo_index);
+  std::cout << "tbo " << tbo_index << std::endl;
+  glBindBuffer(GL_TEXTURE_BUFFER, 0); // unbind
+  
+  
+  // let's try to get dma to the texture buffer
+  glBindBuffer(GL_TEXTURE_BUFFER, tbo_index); // bind
+  payload = (GLubyte*)glMapBuffer(GL_TEXTURE_BUFFER, GL_WRITE_ONLY); // ** TODO: doesn't work
+  glUnmapBuffer(GL_TEXTURE_BUFFER); // release pointer to mapping buffer
+  glBindBuffer(GL_TEXTURE_BUFFER, 0); // unbind
+  
+  std::cout << "tbo " << tbo_index << " at " << (long unsigned int)payload << std::endl;
+  
+  if (!payload) {
+    std::cout << "Could not get tbo memory access!" << std::endl;
+    exit(2);
+  }
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  for(i=0;i<10;i++) {
+    // "copy" data to tbo
+    start = std::chrono::system_clock::now();
+    memset(payload,0,size);
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    std::cout << "memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  }
+  
+  std::cout << std::endl;
+  
+  for(i=0;i<10;i++) {
+    start = std::chrono::system_clock::now();
+    // copy from pbo to texture
+    glBindTexture(GL_TEXTURE_BUFFER, tex_index);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, tbo_index);
+    // glUniform1i(u_tbo_tex, 0); // u_tbo_tex would be from the shader program..
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glFinish();
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    std::cout << "pbo => texture took " << dt.count()*1000 << " ms" << std::endl;
+  }
+}
+
+
+void test_4(const char* fname) { // fname : a y4m file or a headerless 1280x720 I420 file
+  Window  win;
+  GLuint  y_pbo, u_pbo, v_pbo;
+  GLuint  y_tex, u_tex, v_tex;
+  GLubyte *y_payload, *u_payload, *v_payload;
+  GLubyte *image, *y_image, *u_image, *v_image;
+  GLint   format, internal_format; 
+  GLsizei w, h, size, yuvsize;
+  int     i;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  format          =GL_RED; 
+  internal_format =GL_RED;
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  YUVShader *shader = new YUVShader();
+  
+  ctx.reserve(shader); // reserve stuff .. and communicate with the shader about the whereabouts of that stuff
+  
+  FramePool pool(64); // cpu-side frames come from here
+  
+  Y4MReader reader(fname, 1280, 720); // y4m files have their own dimensions
+  reader.print();
+  if (!reader.ok() || !reader.isI420()) {
+    std::cerr << "need an 8-bit 4:2:0 file of even width and height" << std::endl;
+    return;
+  }
+  
+  w               =reader.getWidth();
+  h               =reader.getHeight();
+  
+  size            =w*h;  // single plane size
+  yuvsize         =(3*size)/2; // all planes in yuv
+  
+  image   = reader.frame(0).data; // zero-copy
+  y_image = pool.get(size);
+  u_image = pool.get(size/4);
+  v_image = pool.get(size/4);
+  
+  // rgb : w*h*3
+  // yuv planes : 1 + 2*(1/4) = 1+1/2 = 3/2 = (3/2) * w*h 
+  
+  // the image
+  std::cout << "frame is " << reader.getFrameSize() << " bytes" << std::endl;
+  std::cout << "should be " << yuvsize << " bytes" << std::endl;
+  
+  memcpy(y_image, image,              size  );
+  memcpy(u_image, &image[size],       size/4);
+  memcpy(v_image, &image[(5*size)/4], size/4); // 4/4 + 1/4 = 5/4
+  // return;
+  
+  // let's reserve PBOs
+  getPBO(y_pbo,size,   y_payload);
+  getPBO(u_pbo,size/4, u_payload);
+  getPBO(v_pbo,size/4, v_payload);
+  
+  // let's create yuv textures
+  glEnable(GL_TEXTURE_2D);
+  
+  glGenTextures(1, &y_tex);
+  glBindTexture(GL_TEXTURE_2D, y_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); 
+  
+  glGenTextures(1, &u_tex);
+  glBindTexture(GL_TEXTURE_2D, u_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w/2, h/2, 0, format, GL_UNSIGNED_BYTE, 0); 
+  
+  glGenTextures(1, &v_tex);
+  glBindTexture(GL_TEXTURE_2D, v_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w/2, h/2, 0, format, GL_UNSIGNED_BYTE, 0); 
+  
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  // ok
+  
+  // upload
+  //memcpy(y_payload, image,            size  );
+  //memcpy(u_payload, image+size,       size/4);
+  //memcpy(v_payload, image+(5*size)/4, size/4); // 4/4 + 1/4 = 5/4
+  
+  memcpy(y_payload, y_image,  size  );
+  memcpy(u_payload, u_image,  size/4);
+  memcpy(v_payload, v_image,  size/4); // 4/4 + 1/4 = 5/4
+  
+  sleep_for(1s); // give it time to upload
+  
+  for(i=0;i<10;i++) {
+    start = std::chrono::system_clock::now();
+  
+    // y
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, y_pbo);
+    glBindTexture(GL_TEXTURE_2D, y_tex); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0); 
+    
+    // u
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u_pbo);
+    glBindTexture(GL_TEXTURE_2D, u_tex); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0);  
+    
+    // v
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, v_pbo);
+    glBindTexture(GL_TEXTURE_2D, v_tex); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0); 
+    
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    
+    glFlush();
+    glFinish();
+  
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    std::cout << "pbo => tex took " << dt.count()*1000 << " ms" << std::endl;
+  }
+    
+  ctx.renderYUVShader(win, shader, y_tex, u_tex, v_tex);
+  
+  sleep_for(5s);
+  
+  pool.release(y_image);
+  pool.release(u_image);
+  pool.release(v_image);
+  pool.printStats();
+}
+
+
+void test_5(const char* fname) { // fname : a y4m file or a headerless 1280x720 I420 file
+  Window  win;
+  // GLuint  y_pbo, u_pbo, v_pbo;
+  // GLuint  y_tex, u_tex, v_tex;
+  GLuint  pbo, tex;
+  GLuint  nv12_pbo, y_tex, uv_tex;
+  // GLubyte *y_payload, *u_payload, *v_payload;
+  GLubyte    *payload, *dummypayload, *nv12_payload;
+  GLubyte *image, *y_image, *u_image, *v_image;
+  GLint   format, internal_format; 
+  GLsizei w, h, size, yuvsize, texsize, stridesize;
+  // int     i, j;
+  GLsizei   i,j;
+  GLuint    byteformat;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  // one of these ..
+  format          =GL_BGRA;
+  // format          =GL_RGBA;
+  
+  // internal_format =GL_RGBA;
+  internal_format =GL_RGBA8;
+  
+  byteformat =GL_UNSIGNED_INT_8_8_8_8_REV;
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  YUVBlockShader *shader = new YUVBlockShader();
+  
+  ctx.reserve(shader); // reserve stuff .. and communicate with the shader about the whereabouts of that stuff
+  
+  FramePool pool(64); // cpu-side frames come from here
+  
+  Y4MReader reader(fname, 1280, 720); // y4m files have their own dimensions
+  reader.print();
+  if (!reader.ok() || !reader.isI420()) {
+    std::cerr << "need an 8-bit 4:2:0 file of even width and height" << std::endl;
+    return;
+  }
+  
+  w               =reader.getWidth();
+  h               =reader.getHeight();
+  
+  size            =w*h;  // single plane size
+  yuvsize         =(3*size)/2; // all planes in yuv
+  stridesize      =w*4; /// one BGRA line
+  texsize         =size*4; // BGRA
+  
+  image   = reader.frame(0).data; // zero-copy
+  y_image = pool.get(size);
+  u_image = pool.get(size/4);
+  v_image = pool.get(size/4);
+  
+  // rgb : w*h*3
+  // yuv planes : 1 + 2*(1/4) = 1+1/2 = 3/2 = (3/2) * w*h 
+  
+  // the image
+  std::cout << "frame is " << reader.getFrameSize() << " bytes" << std::endl;
+  std::cout << "should be " << yuvsize << " bytes" << std::endl;
+  
+  memcpy(y_image, image,              size  );
+  memcpy(u_image, &image[size],       size/4);
+  memcpy(v_image, &image[(5*size)/4], size/4); // 4/4 + 1/4 = 5/4
+  
+  // return;
+  
+  // let's reserve PBOs
+  // getPBO(y_pbo,size,   y_payload);
+  // getPBO(u_pbo,size/4, u_payload);
+  // getPBO(v_pbo,size/4, v_payload);
+  
+  getPBO(pbo,texsize,payload);
+  // let's create a dummy payload for comparison
+  dummypayload = pool.get(texsize);
+  
+  // let's create the texture
+  glEnable(GL_TEXTURE_2D);
+  
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, byteformat, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  //memset(payload,0,texsize);
+  //memcpy(y_payload, y_image,  size  );
+  //memcpy(u_payload, u_image,  size/4);
+  //memcpy(v_payload, v_image,  size/4); // 4/4 + 1/4 = 5/4
+  
+  start = std::chrono::system_clock::now();
+  for(i=0;i<h;i++) { // i == luma pixel index
+    for(j=0;j<stridesize;j=j+4) { // 0, 4, 8, .. // j/4 == luma pixel index
+      dummypayload[i*(stridesize)+j  ] =y_image[i*w    +j/4];     // b
+      dummypayload[i*(stridesize)+j+1] =u_image[(i/2)*(w/2)+j/8]; // g
+      dummypayload[i*(stridesize)+j+2] =v_image[(i/2)*(w/2)+j/8]; // r
+      dummypayload[i*(stridesize)+j+3] =255;                      // a
+    }
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  std::cout << "memory manipulation took " << dt.count()*1000 << " ms" << std::endl; // 66 ms 
+  
+  start = std::chrono::system_clock::now();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo); // getPBO left it unmapped
+  payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  streamcopy(payload,dummypayload,texsize); // hd-ready : 4 ms with memcpy
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  std::cout << "memory upload took " << dt.count()*1000 << " ms (" << streamcopyKind() << " streaming stores)" << std::endl;
+  
+  /*
+  start = std::chrono::system_clock::now();
+  for(i=0;i<h;i++) { // i == luma pixel index
+    for(j=0;j<stridesize;j=j+4) { // 0, 4, 8, .. // j/4 == luma pixel index
+      payload[i*(stridesize)+j  ] =y_image[i*w    +j/4];     // b
+      payload[i*(stridesize)+j+1] =u_image[(i/2)*(w/2)+j/8]; // g
+      payload[i*(stridesize)+j+2] =v_image[(i/2)*(w/2)+j/8]; // r
+      payload[i*(stridesize)+j+3] =255;                      // a
+    }
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  std::cout << "direct memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  */
+  
+  /*
+  std::cout << "MAX " << (i*w)/4+j/8 << std::endl;
+  
+  for(i=0;i<=10;i++) {
+    std::cout << "u> " << int(u_image[i]) << std::endl;
+  }
+  
+  std::cout << std::endl;
+  
+  for(i=0;i<=10;i++) {
+    std::cout << "v> " << int(v_image[i]) << std::endl;
+  }
+  
+  std::cout << std::endl;
+  
+  for(i=0;i<100;i++) {
+    std::cout << "> " << int(payload[i]) << std::endl;
+  }
+  */
+  
+  sleep_for(0.5s); // give it time to upload
+  
+  for(i=0;i<10;i++) {
+    start = std::chrono::system_clock::now();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBindTexture(GL_TEXTURE_2D, tex); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, byteformat, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    
+    glFlush();
+    glFinish();
+    end = std::chrono::system_clock::now();
+    
+    dt = end-start;
+    std::cout << "pbo => tex took " << dt.count()*1000 << " ms" << std::endl;
+  }
+    
+  ctx.renderYUVBlockShader(win, shader, tex);
+  
+  sleep_for(5s);
+  
+  // the block texture above replicates chroma : 4 bytes per pixel, 2.67x the I420 frame.  NV12 keeps the 4:2:0 density :
+  // Y into an R8 texture, U & V interleaved into an RG8 texture, both from the same PBO
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_NV12, w, h);
+  YUVNV12Shader *nv12_shader = new YUVNV12Shader();
+  
+  getPBO(nv12_pbo,yuvsize,nv12_payload);
+  
+  glGenTextures(1, &y_tex);
+  glBindTexture(GL_TEXTURE_2D, y_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, planes[0].internal_format, planes[0].w, planes[0].h, 0, planes[0].format, planes[0].type, 0); 
+  glGenTextures(1, &uv_tex);
+  glBindTexture(GL_TEXTURE_2D, uv_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, planes[1].internal_format, planes[1].w, planes[1].h, 0, planes[1].format, planes[1].type, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  start = std::chrono::system_clock::now();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, nv12_pbo);
+  nv12_payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, yuvsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  packNV12(nv12_payload, image, w, h); // straight into the pbo
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  std::cout << "nv12 packing into the pbo took " << dt.count()*1000 << " ms : " << yuvsize << " bytes instead of " << texsize << std::endl;
+  
+  for(i=0;i<10;i++) {
+    start = std::chrono::system_clock::now();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, nv12_pbo);
+    glBindTexture(GL_TEXTURE_2D, y_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[0].w, planes[0].h, planes[0].format, planes[0].type, (GLvoid*)planes[0].offset);
+    glBindTexture(GL_TEXTURE_2D, uv_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[1].w, planes[1].h, planes[1].format, planes[1].type, (GLvoid*)planes[1].offset);
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    
+    glFlush();
+    glFinish();
+    end = std::chrono::system_clock::now();
+    
+    dt = end-start;
+    std::cout << "nv12 pbo => tex took " << dt.count()*1000 << " ms" << std::endl;
+  }
+  
+  XWindowAttributes wa;
+  XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+  ctx.getState().invalidate(); // raw gl calls above
+  glClear(GL_COLOR_BUFFER_BIT);
+  ctx.drawYUVNV12Shader(nv12_shader, y_tex, uv_tex, 0, 0, wa.width, wa.height, w, h);
+  glXSwapBuffers(ctx.getDisplay(), win);
+  
+  sleep_for(5s);
+  
+  glDeleteTextures(1, &y_tex);
+  glDeleteTextures(1, &uv_tex);
+  glDeleteBuffers(1, &nv12_pbo);
+  delete nv12_shader;
+  pool.release(y_image);
+  pool.release(u_image);
+  pool.release(v_image);
+  pool.release(dummypayload);
+  pool.printStats();
+}
+
+
+
+void test_6() { // upload & download bandwidth : unpack PBO => texture => FBO => pack PBO ring => cpu
+  Window  win;
+  GLuint  pbo, tex, fbo;
+  GLubyte *payload, *readback, *image;
+  GLint   format, internal_format; 
+  GLsizei w, h, texsize;
+  int     i, n, depth, nread;
+  double  upload_ms, download_ms, sync_ms;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  format          =GL_RGBA;
+  internal_format =GL_RGBA8;
+  
+  w               =1920;
+  h               =1080;
+  texsize         =w*h*4; // RGBA
+  
+  n               =20; // number of frames
+  depth           =3;  // readbacks are available 3 frames later
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  getPBO(pbo,texsize,payload); // returns unmapped : map it to fill it
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  memset(payload,128,texsize);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  
+  FramePool pool(64);
+  image = pool.get(texsize); // where the readback frames are copied to, say, for an encoder
+  
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  getFBO(fbo,tex);
+  
+  PackPBORing ring = PackPBORing(w, h, format, GL_UNSIGNED_BYTE, 4, depth);
+  
+  sleep_for(0.5s); // give it time to upload
+  
+  upload_ms   =0;
+  download_ms =0;
+  nread       =0;
+  
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  
+  for(i=0;i<n+depth;i++) {
+    if (i<n) {
+      start = std::chrono::system_clock::now();
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+      glBindTexture(GL_TEXTURE_2D, tex); // this is the texture we will manipulate
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+      glBindTexture(GL_TEXTURE_2D, 0); // unbind
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+      glFinish();
+      end = std::chrono::system_clock::now();
+      dt = end-start;
+      upload_ms += dt.count()*1000;
+    }
+    
+    start = std::chrono::system_clock::now();
+    if (i<n) {
+      ring.read(); // texture => pack pbo .. asynchronous
+    }
+    if (i>=depth-1) { // the oldest readback should be ready by now
+      readback = ring.map(true);
+      if (readback) {
+        memcpy(image, readback, texsize);
+        ring.unmap();
+        nread++;
+      }
+    }
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    download_ms += dt.count()*1000;
+    std::cout << "frame " << i << " readbacks in flight " << ring.getPending() << std::endl;
+  }
+  
+  // for comparison : synchronous glReadPixels into cpu memory
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    glReadPixels(0, 0, w, h, format, GL_UNSIGNED_BYTE, image);
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  sync_ms = dt.count()*1000;
+  
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  
+  std::cout << std::endl;
+  std::cout << "frames uploaded " << n << " read back " << nread << std::endl;
+  std::cout << "upload   : " << upload_ms/n   << " ms per frame, " << (double(texsize)*n/1e6)/(upload_ms/1000)       << " MB/s" << std::endl;
+  if (nread>0) {
+    std::cout << "download : " << download_ms/nread << " ms per frame, " << (double(texsize)*nread/1e6)/(download_ms/1000) << " MB/s (pack pbo ring, depth " << depth << ")" << std::endl;
+  }
+  else {
+    std::cout << "download : no frames read back (pack pbo ring, depth " << depth << ")" << std::endl;
+  }
+  std::cout << "download : " << sync_ms/n     << " ms per frame, " << (double(texsize)*n/1e6)/(sync_ms/1000)         << " MB/s (synchronous glReadPixels)" << std::endl;
+  
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &tex);
+  glDeleteBuffers(1, &pbo);
+  pool.release(image);
+}
+
+
+
+void test_7() { // partial texture updates : upload only the tiles that changed since the previous frame
+  Window  win;
+  GLuint  pbo, tex;
+  GLubyte *payload, *prev, *cur;
+  GLint   format, internal_format; 
+  GLsizei w, h, texsize, tile, npix, nbytes;
+  int     i, n, k, bx, by;
+  double  diff_ms, full_ms, dirty_ms;
+  std::vector<Rect> rects;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  format          =GL_RGBA;
+  internal_format =GL_RGBA8;
+  
+  w               =1920;
+  h               =1080;
+  texsize         =w*h*4; // RGBA
+  tile            =64;
+  n               =10;
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  getPBO(pbo,texsize,payload);
+  
+  FramePool pool(64);
+  prev = pool.get(texsize);
+  cur  = pool.get(texsize);
+  memset(prev,64,texsize); // a static scene ..
+  
+  auto mapPBO = [&](GLbitfield access) -> GLubyte* { // getPBO leaves it unmapped
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    return (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texsize, access);
+  };
+  auto unmapPBO = []() {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  };
+  payload = mapPBO(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  memcpy(payload,prev,texsize);
+  unmapPBO();
+  
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  sleep_for(0.5s); // give it time to upload
+  
+  diff_ms  =0;
+  full_ms  =0;
+  dirty_ms =0;
+  
+  for(i=0;i<n;i++) {
+    // .. with a small object moving around
+    memcpy(cur,prev,texsize);
+    bx = (100+i*37) % (w-200);
+    by = (100+i*23) % (h-200);
+    for(k=by;k<by+200;k++) {
+      memset(cur + k*w*4 + bx*4, 200+i, 200*4);
+    }
+    
+    start = std::chrono::system_clock::now();
+    npix = findDirtyRects(prev, cur, w, h, 4, tile, rects);
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    diff_ms += dt.count()*1000;
+    
+    // full frame
+    start = std::chrono::system_clock::now();
+    payload = mapPBO(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    memcpy(payload,cur,texsize);
+    unmapPBO();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBindTexture(GL_TEXTURE_2D, tex); // this is the texture we will manipulate
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    glFinish();
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    full_ms += dt.count()*1000;
+    
+    // only dirty rectangles
+    start = std::chrono::system_clock::now();
+    payload = mapPBO(GL_MAP_WRITE_BIT); // no invalidate : the rest of the pbo must keep the previous frame
+    copyRects(payload, cur, w, 4, rects);
+    unmapPBO();
+    nbytes = uploadRects(pbo, tex, w, 4, format, GL_UNSIGNED_BYTE, rects);
+    glFinish();
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    dirty_ms += dt.count()*1000;
+    
+    std::cout << "frame " << i << " : " << rects.size() << " dirty rects, " << npix << " pixels, " << nbytes << " / " << texsize << " bytes uploaded" << std::endl;
+    
+    std::swap(prev,cur);
+  }
+  
+  std::cout << std::endl;
+  std::cout << "tile diff         took " << diff_ms/n  << " ms per frame" << std::endl;
+  std::cout << "full upload       took " << full_ms/n  << " ms per frame" << std::endl;
+  std::cout << "dirty rect upload took " << dirty_ms/n << " ms per frame" << std::endl;
+  
+  glDeleteTextures(1, &tex);
+  glDeleteBuffers(1, &pbo);
+  pool.release(prev);
+  pool.release(cur);
+}
+
+
+
+void test_8() { // memcpy bandwidth of a 4K RGBA staging buffer : normal pages vs. huge pages
+  GLubyte     *src, *dst;
+  std::size_t texsize, filesize;
+  GLsizei     w, h;
+  int         i, n;
+  double      ms, base_ms;
+  PageMode    mode, src_mode, dst_mode;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  w       =3840;
+  h       =2160;
+  texsize =w*h*4; // RGBA : 33 MB
+  n       =20;
+  base_ms =0;
+  
+  const PageMode modes[] = {PAGES_DEFAULT, PAGES_THP, PAGES_HUGETLB};
+  
+  for(auto it=std::begin(modes); it!=std::end(modes); ++it) {
+    mode     =*it;
+    src_mode =mode;
+    dst_mode =mode;
+    src = allocStaging(texsize, src_mode); // src_mode, dst_mode : what we actually got
+    dst = allocStaging(texsize, dst_mode);
+    if (!src || !dst) {
+      std::cout << "could not allocate staging buffers for mode " << pageModeName(mode) << std::endl;
+      continue;
+    }
+    memset(src, 1, texsize); // touch all pages
+    memset(dst, 0, texsize);
+    
+    start = std::chrono::system_clock::now();
+    for(i=0;i<n;i++) {
+      memcpy(dst, src, texsize); // as in memcpy(payload, dummypayload, texsize)
+    }
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    ms = dt.count()*1000/n;
+    if (mode==PAGES_DEFAULT) {
+      base_ms = ms;
+    }
+    
+    std::cout << "pages " << std::setw(8) << pageModeName(mode) << " (got " << std::setw(8) << pageModeName(dst_mode) << ") : memcpy took " 
+              << ms << " ms, " << (double(texsize)/1e9)/(ms/1000) << " GB/s, speedup " << base_ms/ms << std::endl;
+    
+    freeStaging(src, texsize, mode);
+    freeStaging(dst, texsize, mode);
+  }
+  
+  // file-mapped frames
+  std::cout << std::endl;
+  for(auto it=std::begin(modes); it!=std::end(modes); ++it) {
+    mode     =*it;
+    src = mapFile("1.yuv", filesize, mode);
+    if (!src) {
+      std::cout << "could not map 1.yuv" << std::endl;
+      break;
+    }
+    dst_mode = PAGES_DEFAULT;
+    dst = allocStaging(filesize, dst_mode);
+    
+    start = std::chrono::system_clock::now();
+    for(i=0;i<n;i++) {
+      memcpy(dst, src, filesize);
+    }
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    ms = dt.count()*1000/n;
+    
+    std::cout << "1.yuv mapped with pages " << std::setw(8) << pageModeName(*it) << " : memcpy took " << ms << " ms, " << (double(filesize)/1e9)/(ms/1000) << " GB/s" << std::endl;
+    
+    freeStaging(dst, filesize, PAGES_DEFAULT);
+    unmapFile(src, filesize, *it);
   }
 }
 
 
-OpenGLContext::~OpenGLContext() {
-  XFree(this->fbConfigs);
-  glXDestroyContext(this->display_id, this->glc);
-  XCloseDisplay(this->display_id);
-}
-
-
-
-void OpenGLContext::makeCurrent(Window window_id) {
-  glXMakeCurrent(this->display_id, window_id, this->glc);
-}
-
 
-void OpenGLContext::loadExtensions() {
-  if (GLEW_ARB_pixel_buffer_object) {
-    std::cout << "OpenGLContext: loadExtensions: PBO extension already loaded" <<std::endl;
-    return;
+void test_9() { // memcpy vs. non-temporal streaming stores, into cached heap memory and into mapped PBO memory
+  Window  win;
+  GLuint  pbo;
+  GLubyte *src, *dst, *payload;
+  GLsizei w, h, texsize;
+  int     i, n;
+  double  memcpy_ms, stream_ms;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  w       =1920;
+  h       =1080;
+  texsize =w*h*4; // RGBA
+  n       =20;
+  
+  std::cout << "streamcopy uses " << streamcopyKind() << std::endl << std::endl;
+  
+  FramePool pool(64);
+  src = pool.get(texsize);
+  dst = pool.get(texsize);
+  memset(src, 1, texsize);
+  memset(dst, 0, texsize);
+  
+  // heap => heap
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    memcpy(dst, src, texsize);
   }
-  else {
-    std::cout << "OpenGLContext: loadExtensions: Will load PBO extension" <<std::endl;
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  memcpy_ms = dt.count()*1000/n;
+  
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    streamcopy(dst, src, texsize);
   }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  stream_ms = dt.count()*1000/n;
   
-  this->makeCurrent(this->root_id); // a context must be made current before glew works..
+  std::cout << "heap => heap : memcpy " << memcpy_ms << " ms, streamcopy " << stream_ms << " ms => " << (stream_ms<memcpy_ms ? "streamcopy" : "memcpy") << " wins" << std::endl;
   
-  glewExperimental = GL_TRUE;
-  GLenum err = glewInit();
-  if (GLEW_OK != err) {
-  /* Problem: glewInit failed, something is seriously wrong. */
-  std::cout << "OpenGLContext: loadExtensions: ERROR: " << glewGetErrorString(err) <<std::endl;  
-  }
-  else {
-    if (GLEW_ARB_pixel_buffer_object) {
-      std::cout << "OpenGLContext: loadExtensions:  PBO extension found! :)"<<std::endl;
+  // heap => mapped PBO
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  getPBO(pbo,texsize,payload);
+  
+  memcpy_ms =0;
+  stream_ms =0;
+  for(i=0;i<2*n;i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!payload) {
+      std::cout << "could not map pbo" << std::endl;
+      break;
+    }
+    start = std::chrono::system_clock::now();
+    if (i%2==0) { // alternate, so that both see the same driver state
+      memcpy(payload, src, texsize);
     }
     else {
-      std::cout << "OpenGLContext: loadExtensions: WARNING: PBO extension not found! :("<<std::endl;
+      streamcopy(payload, src, texsize);
     }
-    if (GLEW_ARB_texture_buffer_object) {
-      std::cout << "OpenGLContext: loadExtensions:  TBO extension found! :)"<<std::endl;
+    end = std::chrono::system_clock::now();
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+    dt = end-start;
+    if (i%2==0) {
+      memcpy_ms += dt.count()*1000/n;
     }
     else {
-      std::cout << "OpenGLContext: loadExtensions: WARNING: TBO extension not found! :("<<std::endl;
+      stream_ms += dt.count()*1000/n;
     }
   }
-}
-
-
-Window OpenGLContext::createWindow() {
-  Window win_id;
-  XSetWindowAttributes swa;
-  
-  // this->vi  =glXChooseVisual(this->display_id, 0, this->att); // "visual parameters" of the X window
-  this->vi =glXGetVisualFromFBConfig( this->display_id, this->fbConfigs[0] ); // another way to do it ..
   
-  swa.colormap   =XCreateColormap(this->display_id, this->root_id, (this->vi)->visual, AllocNone);
-  swa.event_mask =ExposureMask | KeyPressMask;
+  std::cout << "heap => pbo  : memcpy " << memcpy_ms << " ms, streamcopy " << stream_ms << " ms => " << (stream_ms<memcpy_ms ? "streamcopy" : "memcpy") << " wins" << std::endl;
   
-  win_id =XCreateWindow(this->display_id, this->root_id, 0, 0, 600, 600, 0, vi->depth, InputOutput, vi->visual, CWColormap | CWEventMask, &swa);
-  XMapWindow(this->display_id, win_id);
-  XStoreName(this->display_id, win_id, "test window");
-
-  return win_id;
+  glDeleteBuffers(1, &pbo);
+  pool.release(src);
+  pool.release(dst);
 }
 
 
-void OpenGLContext::reserve(Shader *shader) {
-  unsigned int transform_size, vertices_size, indices_size;
+
+void test_10() { // frame from file to PBOs : ifstream + memcpys vs. pread straight into mapped PBO memory
+  Window  win;
+  GLuint  y_pbo, u_pbo, v_pbo;
+  GLubyte *y_payload, *u_payload, *v_payload;
+  GLubyte *image, *y_image, *u_image, *v_image;
+  GLsizei w, h, size, yuvsize;
+  int     i, n, fd;
+  double  ms;
+  std::size_t nbytes;
+  struct stat st;
   
-  transform =std::array<GLfloat,16>{
-    1.0f,             0.0f,             0.0f,   0.0f, 
-    0.0f,             1.0f,             0.0f,   0.0f,
-    0.0f,             0.0f,             1.0f,   0.0f,
-    0.0f,             0.0f,             0.0f,   1.0f
-  };
-  transform_size=sizeof(GLfloat)*transform.size();
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  vertices =std::array<GLfloat,20>{
-    /* Positions          Texture Coords
-       Shader class references:
-       "position"        "texcoord"
-    */
-    1.0f,  1.0f, 0.0f,   1.0f, 1.0f, // Top Right
-    1.0f, -1.0f, 0.0f,   1.0f, 0.0f, // Bottom Right
-   -1.0f, -1.0f, 0.0f,   0.0f, 0.0f, // Bottom Left
-   -1.0f,  1.0f, 0.0f,   0.0f, 1.0f  // Top Left 
-  };
-  vertices_size=sizeof(GLfloat)*vertices.size();
+  w       =1280;
+  h       =720;
+  size    =w*h;  // single plane size
+  yuvsize =(3*size)/2; // all planes in yuv
+  n       =50;
   
-  indices =std::array<GLuint,6>{  // Note that we start from 0!
-    0, 1, 3, // First Triangle
-    1, 2, 3  // Second Triangle
-  };
-  indices_size=sizeof(GLuint)*indices.size();
+  OpenGLContext ctx = OpenGLContext();
   
-  // std::cout << "SIZEOF: " << sizeof(vertices) << " " << vertices_size << std::endl; // eh.. its the same
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  getPBO(y_pbo,size,   y_payload);
+  getPBO(u_pbo,size/4, u_payload);
+  getPBO(v_pbo,size/4, v_payload);
   
-  std::cout << "RenderContext: activate: VAO, VBO, EBO " << VAO << " " << VBO << " " << EBO << std::endl;
-  std::cout << "RenderContext: activate: position, texcoord " << shader->position << " " << shader->texcoord << " " << std::endl;
+  fd = open("1.yuv", O_RDONLY);
+  if (fd<0 || fstat(fd, &st)<0 || st.st_size<yuvsize) {
+    std::cout << "need a 1280x720 I420 frame in 1.yuv" << std::endl;
+    if (fd>=0) {
+      close(fd);
+    }
+    glDeleteBuffers(1, &y_pbo);
+    glDeleteBuffers(1, &u_pbo);
+    glDeleteBuffers(1, &v_pbo);
+    return;
+  }
+  std::ifstream file("1.yuv", std::ios::in|std::ios::binary);
   
-  glBindVertexArray(VAO); // VAO works as a "mini program" .. we do all the steps below, when binding the VAO
+  FramePool pool(64);
+  image   = pool.get(yuvsize);
+  y_image = pool.get(size);
+  u_image = pool.get(size/4);
+  v_image = pool.get(size/4);
   
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  // glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices.data(), GL_STATIC_DRAW);
-  glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices.data(), GL_STATIC_DRAW);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices.data(), GL_STATIC_DRAW);
+  auto mapPBO = [](GLuint pbo, GLsizei size) -> GLubyte* { // write-only mapping, discarding the previous contents
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    return (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  };
+  auto unmapPBO = [](GLuint pbo) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  };
   
-  // Position attribute
-  glVertexAttribPointer(shader->position, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0); // this refers to the "Positions" part of vertices
-  // 0: shader prog ref, 3: three elements per vertex
-  glEnableVertexAttribArray(shader->position); // this refers to (location=0) in the shader program
-  // TexCoord attribute
-  glVertexAttribPointer(shader->texcoord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // this refers to "Texture Coords" part of vertices
-  // 1: shader prog ref, 2: two elements per vertex
-  glEnableVertexAttribArray(shader->texcoord); // this refers to (location=1) in the shader program
+  // as in test_4 : file => heap => planes => pbos
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    file.seekg(0, std::ios::beg); // one frame, not the whole file : image holds yuvsize bytes
+    file.read((char*)image, yuvsize);
+    memcpy(y_image, image,              size  );
+    memcpy(u_image, &image[size],       size/4);
+    memcpy(v_image, &image[(5*size)/4], size/4);
+    y_payload = mapPBO(y_pbo, size);
+    memcpy(y_payload, y_image, size);
+    unmapPBO(y_pbo);
+    u_payload = mapPBO(u_pbo, size/4);
+    memcpy(u_payload, u_image, size/4);
+    unmapPBO(u_pbo);
+    v_payload = mapPBO(v_pbo, size/4);
+    memcpy(v_payload, v_image, size/4);
+    unmapPBO(v_pbo);
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << "ifstream => heap => pbo took " << ms << " ms per frame, " << (double(yuvsize)/1e6)/(ms/1000) << " MB/s" << std::endl;
   
-  glBindVertexArray(0); // Unbind VAO
+  // file => pbos
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    nbytes = 0;
+    y_payload = mapPBO(y_pbo, size);
+    nbytes += preadbytes(fd, y_payload, size, 0);
+    unmapPBO(y_pbo);
+    u_payload = mapPBO(u_pbo, size/4);
+    nbytes += preadbytes(fd, u_payload, size/4, size);
+    unmapPBO(u_pbo);
+    v_payload = mapPBO(v_pbo, size/4);
+    nbytes += preadbytes(fd, v_payload, size/4, (5*size)/4);
+    unmapPBO(v_pbo);
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  close(fd);
+  std::cout << "pread => pbo took " << ms << " ms per frame, " << (double(yuvsize)/1e6)/(ms/1000) << " MB/s (" << nbytes << " bytes per frame)" << std::endl;
+  
+  glDeleteBuffers(1, &y_pbo);
+  glDeleteBuffers(1, &u_pbo);
+  glDeleteBuffers(1, &v_pbo);
+  pool.release(image);
+  pool.release(y_image);
+  pool.release(u_image);
+  pool.release(v_image);
 }
 
 
-void OpenGLContext::renderYUVShader(Window window_id, YUVShader* shader, GLuint y_index, GLuint u_index, GLuint v_index) {  
-  // glFlush();
-  // glFinish();
-    
-  if (!glXMakeCurrent(display_id, window_id, glc)) { // choose this x window for manipulation
-    std::cout << "RenderGroup: render: WARNING! could not draw"<<std::endl;
-  }
-  
-  XGetWindowAttributes(display_id, window_id, &(x_window_attr));
-  XWindowAttributes& wa=x_window_attr; // shorthand
-  GLfloat r, dx, dy;
-   
-  std::cout << "RenderGroup: render: window w, h " <<x_window_attr.width<<" "<<x_window_attr.height<<std::endl;
+
+void test_11() { // replay many raw streams concurrently : io_uring (or reader threads) => frame pool => pbos => textures
+  Window  win;
+  GLubyte *payload;
+  GLsizei w, h, size, yuvsize;
+  int     i, k, nstreams, nframes;
+  double  ms;
+  IngestFrame frame;
   
-  glViewport(0, 0, x_window_attr.width, x_window_attr.height);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear the screen and the depth buffer
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  shader->use(); // use the shader
-    
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, y_index);
-  glUniform1i(shader->texy, 0); // pass variable to shader
+  w        =1280;
+  h        =720;
+  size     =w*h;  // single plane size
+  yuvsize  =(3*size)/2; // all planes in yuv
+  nstreams =16;
   
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, u_index);
-  glUniform1i(shader->texu, 1); // pass variable to shader
+  OpenGLContext ctx = OpenGLContext();
   
-  glActiveTexture(GL_TEXTURE2);
-  glBindTexture(GL_TEXTURE_2D, v_index);
-  glUniform1i(shader->texv, 2); // pass variable to shader
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  // calculate dimensions
-  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
-  r=float(wa.height*(1920)) / float(wa.width*(1080));
-  if (r<1.){ // screen wider than image
-    dy=1;
-    dx=r;
-  }
-  else if (r>1.) { // screen taller than image
-    dx=1;
-    dy=1/r;
-  }
-  else {
-    dx=1;
-    dy=1;
+  // per stream : one pbo for all planes, one texture per plane
+  std::vector<GLuint> pbos(nstreams), texs(3*nstreams);
+  glGenBuffers(nstreams, pbos.data());
+  for(i=0;i<nstreams;i++) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, yuvsize, 0, GL_STREAM_DRAW);
   }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   
-  std::cout << "RenderContext: bindVars: dx, dy = " << dx <<" "<<dy<<" "<< std::endl;
-  
-  // /* // test..
-  transform[0]=dx;
-  transform[5]=dy;  
-  // */
-  /*
-  transform= {
-    {dx                0.0f,             0.0f,   0.0f}, 
-    {0.0f,             dy                0.0f,   0.0f},
-    {0.0f,             0.0f,             1.0f,   0.0f},
-    {0.0f,             0.0f,             0.0f,   1.0f}
-  };
-  */
-  glUniformMatrix4fv(shader->transform, 1, GL_FALSE, transform.data());
-  
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
-  
-  // glFinish();
-  
-  if (doublebuffer_flag) {
-    std::cout << "RenderGroup: render: swapping buffers "<<std::endl;
-    glXSwapBuffers(display_id, window_id);
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(3*nstreams, texs.data());
+  for(i=0;i<3*nstreams;i++) {
+    glBindTexture(GL_TEXTURE_2D, texs[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (i%3==0) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+    }
+    else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+    }
   }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
   
-  // glFlush();
-  // glFinish();
-}
-
-
-void OpenGLContext::renderYUVBlockShader(Window window_id, YUVBlockShader* shader, GLuint tex_index) {  
-  // glFlush();
-  // glFinish();
+  FramePool pool(4096);
+  
+  for(k=0;k<2;k++) { // io_uring, then threads
+    FrameIngest ingest(&pool, yuvsize, 32, k==0, 4);
+    for(i=0;i<nstreams;i++) {
+      ingest.addStream("1.yuv"); // replay the same recording many times
+    }
+    ingest.start();
     
-  if (!glXMakeCurrent(display_id, window_id, glc)) { // choose this x window for manipulation
-    std::cout << "RenderGroup: render: WARNING! could not draw"<<std::endl;
+    nframes = 0;
+    start = std::chrono::system_clock::now();
+    end   = start;
+    while (std::chrono::duration<double>(end-start).count()<3) {
+      if (!ingest.pop(frame)) {
+        std::cout << "ingest timeout" << std::endl;
+        break;
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[frame.stream]);
+      payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, yuvsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      streamcopy(payload, frame.data, yuvsize);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      ingest.release(frame); // frame buffer back to the ingest engine
+      
+      glBindTexture(GL_TEXTURE_2D, texs[3*frame.stream]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, 0);
+      glBindTexture(GL_TEXTURE_2D, texs[3*frame.stream+1]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)size);
+      glBindTexture(GL_TEXTURE_2D, texs[3*frame.stream+2]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)((5*size)/4));
+      glBindTexture(GL_TEXTURE_2D, 0); // unbind
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+      
+      nframes++;
+      if (nframes%nstreams==0) {
+        glFinish();
+      }
+      end = std::chrono::system_clock::now();
+    }
+    glFinish();
+    ingest.stop();
+    
+    dt = end-start;
+    ms = dt.count()*1000;
+    std::cout << ingest.backend() << " : " << nframes << " frames from " << nstreams << " streams in " << ms << " ms : "
+              << nframes/(ms/1000) << " fps, " << (double(yuvsize)*nframes/1e6)/(ms/1000) << " MB/s, read failures " << ingest.nfailed << std::endl;
   }
+  pool.printStats();
   
-  XGetWindowAttributes(display_id, window_id, &(x_window_attr));
-  XWindowAttributes& wa=x_window_attr; // shorthand
-  GLfloat r, dx, dy;
-   
-  std::cout << "RenderGroup: render: window w, h " <<x_window_attr.width<<" "<<x_window_attr.height<<std::endl;
-  
-  glViewport(0, 0, x_window_attr.width, x_window_attr.height);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // clear the screen and the depth buffer
+  glDeleteBuffers(nstreams, pbos.data());
+  glDeleteTextures(3*nstreams, texs.data());
+}
+
+
+
+void test_12() { // frames from an external "decoder" process through a shared memory ring => pbo => textures
+  Window  win;
+  GLuint  pbo, y_tex, u_tex, v_tex;
+  GLubyte *payload, *data;
+  GLsizei w, h, size, yuvsize;
+  int     i, n, nframes, rejected;
+  pid_t   pid, parent;
+  bool    reaped;
+  double  ms, latency_ms, max_latency_ms;
+  ShmFrameInfo  info;
+  ShmReadStatus status;
   
-  shader->use(); // use the shader
-    
-  std::cout << "passing tex_index, texBlock : " << tex_index << " " << shader->texBlock << std::endl;
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, tex_index);
-  glUniform1i(shader->texBlock, 0); // pass variable to shader
+  w       =1280;
+  h       =720;
+  size    =w*h;  // single plane size
+  yuvsize =(3*size)/2; // all planes in yuv
+  n       =500;
   
-  // calculate dimensions
-  // (screeny/screenx) / (iy/ix)  =  screeny*ix / screenx*iy
-  r=float(wa.height*(1920)) / float(wa.width*(1080));
-  if (r<1.){ // screen wider than image
-    dy=1;
-    dx=r;
+  ShmFrameRing ring("/upload_pbo_test", true, 4, yuvsize);
+  if (!ring.ok()) {
+    return;
   }
-  else if (r>1.) { // screen taller than image
-    dx=1;
-    dy=1/r;
+  
+  parent = getpid();
+  pid = fork();
+  if (pid<0) {
+    std::cout << "test_12 : fork failed : " << strerror(errno) << std::endl;
+    return;
   }
-  else {
-    dx=1;
-    dy=1;
+  if (pid==0) { // child : the decoder.  Attaches to the ring by name, like an unrelated process would
+    ShmFrameRing ring("/upload_pbo_test", false);
+    int fd = open("1.yuv", O_RDONLY);
+    for(i=0;i<n;i++) {
+      while (!(data = ring.beginWrite()) && getppid()==parent) { // ring full : the parent may still be setting up gl
+      }
+      if (!data) { // the parent is gone
+        break;
+      }
+      preadbytes(fd, data, yuvsize, 0); // "decode" straight into shared memory
+      data[0] = i; // frame counter in the first pixel
+      ring.commitWrite(ShmFrameInfo{0, monotonicNs(), PIXFMT_I420, uint32_t(w), uint32_t(h), uint32_t(w), uint32_t(yuvsize)});
+    }
+    ring.close();
+    ::close(fd);
+    _exit(0);
   }
   
-  std::cout << "RenderContext: bindVars: dx, dy = " << dx <<" "<<dy<<" "<< std::endl;
+  OpenGLContext ctx = OpenGLContext();
   
-  // /* // test..
-  transform[0]=dx;
-  transform[5]=dy;  
-  // */
-  /*
-  transform= {
-    {dx                0.0f,             0.0f,   0.0f}, 
-    {0.0f,             dy                0.0f,   0.0f},
-    {0.0f,             0.0f,             1.0f,   0.0f},
-    {0.0f,             0.0f,             0.0f,   1.0f}
-  };
-  */
-  glUniformMatrix4fv(shader->transform, 1, GL_FALSE, transform.data());
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  getPBO(pbo,yuvsize,payload);
   
-  // glFinish();
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(1, &y_tex);
+  glGenTextures(1, &u_tex);
+  glGenTextures(1, &v_tex);
+  glBindTexture(GL_TEXTURE_2D, y_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, u_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, v_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
   
-  if (doublebuffer_flag) {
-    std::cout << "RenderGroup: render: swapping buffers "<<std::endl;
-    glXSwapBuffers(display_id, window_id);
+  nframes        =0;
+  rejected       =0;
+  reaped         =false;
+  latency_ms     =0;
+  max_latency_ms =0;
+  start = std::chrono::system_clock::now();
+  while (true) {
+    status = ring.beginRead(info, data, 1000, yuvsize);
+    if (status==SHM_READ_CLOSED) {
+      break;
+    }
+    if (status==SHM_READ_TIMEOUT) { // a slow producer, or one that died without closing the ring
+      if (waitpid(pid, NULL, WNOHANG)==pid) {
+        reaped = true;
+        break;
+      }
+      continue;
+    }
+    if (status==SHM_READ_REJECTED) {
+      rejected++;
+      continue;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, yuvsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    streamcopy(payload, data, info.size); // the only copy : shared memory => pbo
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    ring.endRead();
+    
+    glBindTexture(GL_TEXTURE_2D, y_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, u_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)size);
+    glBindTexture(GL_TEXTURE_2D, v_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)((5*size)/4));
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    glFinish();
+    
+    ms = (monotonicNs()-info.pts)/1e6; // decoder output => texture
+    latency_ms += ms;
+    max_latency_ms = std::max(max_latency_ms, ms);
+    nframes++;
+  }
+  end = std::chrono::system_clock::now();
+  if (!reaped) {
+    waitpid(pid, NULL, 0);
   }
   
-  // glFlush();
-  // glFinish();
+  dt = end-start;
+  ms = dt.count()*1000;
+  std::cout << nframes << " frames through shared memory (" << rejected << " rejected) in " << ms << " ms : " << nframes/(ms/1000) << " fps, "
+            << (double(yuvsize)*nframes/1e6)/(ms/1000) << " MB/s" << std::endl;
+  std::cout << "decoder => texture latency : mean " << latency_ms/std::max(nframes,1) << " ms, max " << max_latency_ms << " ms" << std::endl;
 }
 
 
-void test_1() { // just create a window
-  Window w;
-  OpenGLContext ctx = OpenGLContext();
+
+void test_13() { // dma-buf frames => textures : EGLImage import vs. copy
+  GLuint  texs[3], check_tex, fbo;
+  GLubyte *image, *data, line[64];
+  GLsizei w, h, size, yuvsize, mapsize;
+  int     i, n, fd, memfd, dmafd;
+  bool    imported;
+  double  ms;
+  GLenum  err;
   
-  ctx.loadExtensions();
-  w=ctx.createWindow();
-  ctx.makeCurrent(w);
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  sleep_for(3s);
+  w       =1280;
+  h       =720;
+  size    =w*h;  // single plane size
+  yuvsize =(3*size)/2; // all planes in yuv
+  mapsize =((yuvsize+4095)/4096)*4096; // udmabuf wants whole pages
+  n       =100;
+  
+  const GLsizei offsets[3] = {0, size, (5*size)/4};
+  const GLsizei strides[3] = {w, w/2, w/2};
+  
+  FramePool pool(64);
+  image = pool.get(yuvsize);
+  fd = open("1.yuv", O_RDONLY);
+  if (fd<0 || preadbytes(fd, image, yuvsize, 0)!=std::size_t(yuvsize)) {
+    std::cout << "need a 1280x720 I420 frame in 1.yuv" << std::endl;
+    if (fd>=0) {
+      close(fd);
+    }
+    pool.release(image);
+    return;
+  }
+  close(fd);
+  
+  // a decoder would give us this : an I420 frame in a dma-buf.  Here it's a memfd, wrapped by udmabuf
+  memfd = memfd_create("upload_pbo_dmabuf", MFD_ALLOW_SEALING);
+  if (memfd<0 || ftruncate(memfd, mapsize)<0) {
+    std::cout << "memfd_create failed (" << strerror(errno) << ")" << std::endl;
+    if (memfd>=0) {
+      close(memfd);
+    }
+    pool.release(image);
+    return;
+  }
+  data = (GLubyte*)mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (data==MAP_FAILED) {
+    std::cout << "mmap of the memfd failed (" << strerror(errno) << ")" << std::endl;
+    close(memfd);
+    pool.release(image);
+    return;
+  }
+  memcpy(data, image, yuvsize);
+  munmap(data, mapsize);
+  fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK);
+  
+  dmafd = getUdmaBuf(memfd, mapsize);
+  if (dmafd<0) {
+    std::cout << "no dma-buf : the importer will copy from the memfd" << std::endl;
+    dmafd = memfd;
+  }
+  auto closeFds = [&]() {
+    if (dmafd!=memfd) {
+      close(dmafd);
+    }
+    close(memfd);
+  };
+  
+  OpenGLContext ctx = OpenGLContext(); // just for the X display
+  DmaBufImporter importer(ctx.getDisplay());
+  if (!importer.ok()) {
+    closeFds();
+    pool.release(image);
+    return;
+  }
+  glewExperimental = GL_TRUE;
+  err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  if (err==GLEW_ERROR_NO_GLX_DISPLAY) { // glx-only glew with an egl context : the gl entry points are loaded all the same
+    err = GLEW_OK;
+  }
+#endif
+  if (err!=GLEW_OK) {
+    std::cout << "glewInit failed : " << glewGetErrorString(err) << std::endl;
+    closeFds();
+    pool.release(image);
+    return;
+  }
+  
+  glGenTextures(3, texs);
+  
+  for(i=0;i<2;i++) { // import, then forced copy
+    start = std::chrono::system_clock::now();
+    for(int k=0;k<n;k++) {
+      imported = importer.importFrame(dmafd, PIXFMT_I420, w, h, offsets, strides, texs, i==1);
+      glFinish();
+    }
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    ms = dt.count()*1000/n;
+    std::cout << (imported ? "dma-buf import" : "copy") << " took " << ms << " ms per frame" << std::endl;
+  }
+  
+  // check : read back the start of the luma texture
+  importer.importFrame(dmafd, PIXFMT_I420, w, h, offsets, strides, texs);
+  check_tex = texs[0];
+  getFBO(fbo, check_tex);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, 64, 1, GL_RED, GL_UNSIGNED_BYTE, line);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  std::cout << "luma texture matches the dma-buf : " << (memcmp(line, image, 64)==0 ? "yes" : "NO") << std::endl;
+  
+  glDeleteFramebuffers(1, &fbo);
+  importer.releaseFrame();
+  glDeleteTextures(3, texs);
+  closeFds();
+  pool.release(image);
 }
 
 
-void test_2() {
+
+void test_14(const char* fname) { // play all frames of a y4m (or raw 1280x720 I420) file : mapping => pbo => textures, no intermediate copies
   Window  win;
-  GLuint  pbo_index, tex_index;
+  GLuint  pbo, y_tex, u_tex, v_tex;
   GLubyte *payload;
-  GLint   format, internal_format; 
-  GLsizei w, h, size;
-  int     i;
+  GLsizei w, h, size, yuvsize;
+  int     i, n;
+  double  ms;
+  Y4MFrame frame;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  Y4MReader reader(fname, 1280, 720);
+  reader.print();
+  if (!reader.ok() || !reader.isI420()) {
+    std::cerr << "need an 8-bit 4:2:0 file of even width and height" << std::endl;
+    return;
+  }
+  
+  w       =reader.getWidth();
+  h       =reader.getHeight();
+  size    =w*h;  // single plane size
+  yuvsize =reader.getFrameSize();
+  n       =reader.getFrameCount();
   
   OpenGLContext ctx = OpenGLContext();
   
@@ -933,112 +8176,275 @@ void test_2() {
   win=ctx.createWindow();
   ctx.makeCurrent(win);
   
-  /* format              : format of the texture .. OpenGL might and will convert this to internal format
-   *                       for example, for glTexImage2D : https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
-   *                       "GL_RED : each element is a single red component. The GL converts it to floating point and assembles it into an RGBA element by .."
-   * 
-   * internal_format     : 
-   * 
-   * 
-   */
-  
-  // see allowed format/internal format here:
-  // https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml
-  
-  // *** Slow as hell ***  .. this one works with my shader program .. There I use separate LUMA and CHROMA textures
-  // format          =GL_RED; 
-  // internal_format =GL_RED;
-  
-  // *** Slow as a snail in sahara ***
-  // format          =GL_RED;
-  // internal_format =GL_R8;
-  
-  // *** This is absolutely fast & beautiful ! ***
-  // *** .. but, we only want to upload data with single component to the GPU, not RGBA ..!
-  format             =GL_RGBA; // 0.008971 ms
-  // internal_format    =GL_RGBA;
-  internal_format    =GL_RGBA8; // we must use sized formats since 3.2+ ?
+  getPBO(pbo,yuvsize,payload);
   
-  // format             =GL_BGRA; // 0.003769 ms .. but internal format can't be GL_BGRA doesn't make sense
-  // internal_format    =GL_BGRA;
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(1, &y_tex);
+  glGenTextures(1, &u_tex);
+  glGenTextures(1, &v_tex);
+  glBindTexture(GL_TEXTURE_2D, y_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, u_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, v_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
   
-  // how to transfer this to the shader program .. ?
-  // * create a single GL_BGRA "texture" .. eh, where the data has been dumped somehow..
-  // * say, let's put: Y=>B, U=>G, V=>R, A=0
-  // * .. shader program must do some coreography to pull this one off
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // odd chroma widths
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    frame = reader.frame(i);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, yuvsize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    streamcopy(payload, frame.data, frame.size); // file mapping => pbo
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    
+    glBindTexture(GL_TEXTURE_2D, y_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, u_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)size);
+    glBindTexture(GL_TEXTURE_2D, v_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, GL_RED, GL_UNSIGNED_BYTE, (GLvoid*)(std::size_t)((5*size)/4));
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    glFinish();
+    if (!frame.params.empty()) {
+      std::cout << "frame " << i << " parameters : " << frame.params << std::endl;
+    }
+  }
+  end = std::chrono::system_clock::now();
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
   
-  w               =1920;
-  h               =1080;
-  size            =w*h;  // size of a LUMA HD frame
+  dt = end-start;
+  ms = dt.count()*1000;
+  std::cout << n << " frames in " << ms << " ms : " << n/(ms/1000) << " fps (stream nominal " << reader.getFps() << " fps), "
+            << (double(yuvsize)*n/1e6)/(ms/1000) << " MB/s" << std::endl;
+}
+
+
+
+void test_15() { // synthetic frames : generator throughput per format & resolution, then upload of changing frames with a counter check
+  Window  win;
+  GLuint  pbo, y_tex, fbo;
+  GLubyte *payload, *frame, line[8*1280];
+  GLsizei w, h;
+  int     i, n, errors;
+  double  ms;
+  uint32_t counter;
   
-  // let's reserve a PBO
-  glGenBuffers(1, &pbo_index);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW); // reserve n_payload bytes to index/handle pbo_id
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind (not mandatory)
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index); // rebind (not mandatory)
+  FramePool pool(64);
+  n = 50;
+  
+  const PixelFormat formats[] = {PIXFMT_I420, PIXFMT_NV12, PIXFMT_BGRA};
+  const GLsizei     sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  
+  for(auto it=std::begin(sizes); it!=std::end(sizes); ++it) {
+    for(auto it2=std::begin(formats); it2!=std::end(formats); ++it2) {
+      FrameGenerator generator(*it2, (*it)[0], (*it)[1]);
+      frame = pool.get(generator.getFrameSize());
+      start = std::chrono::system_clock::now();
+      for(i=0;i<n;i++) {
+        generator.next(frame);
+      }
+      end = std::chrono::system_clock::now();
+      dt = end-start;
+      ms = dt.count()*1000/n;
+      std::cout << "generate " << pixelFormatName(*it2) << " " << (*it)[0] << "x" << (*it)[1] << " : " << ms << " ms per frame, "
+                << 1000/ms << " fps, " << (double(generator.getFrameSize())/1e9)/(ms/1000) << " GB/s" << std::endl;
+      pool.release(frame);
+    }
+  }
+  std::cout << std::endl;
   
-  payload = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  // upload changing I420 frames & check the counter on the gpu side
+  w = 1280;
+  h = 720;
+  FrameGenerator generator(PIXFMT_I420, w, h);
+  frame = pool.get(generator.getFrameSize());
   
-  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release pointer to mapping buffer
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+  OpenGLContext ctx = OpenGLContext();
   
-  std::cout << "pbo " << pbo_index << " at " << (long unsigned int)payload << std::endl;
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  // let's reserve a texture
+  getPBO(pbo,w*h,payload);
   glEnable(GL_TEXTURE_2D);
-  glGenTextures(1, &tex_index);
+  glGenTextures(1, &y_tex);
+  glBindTexture(GL_TEXTURE_2D, y_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, 0); 
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  getFBO(fbo, y_tex);
   
-  std::cout << "texture " << tex_index << std::endl;
+  errors = 0;
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    generator.next(frame);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, w*h, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    streamcopy(payload, frame, w*h); // luma only
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindTexture(GL_TEXTURE_2D, y_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+    
+    // read back the first lines of the texture : has the right frame arrived?
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, 8, GL_RED, GL_UNSIGNED_BYTE, line);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    counter = FrameGenerator::readCounter(line, PIXFMT_I420, w);
+    if (counter!=uint32_t(i)) {
+      errors++;
+    }
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << "generate => pbo => texture => readback : " << ms << " ms per frame, counter errors " << errors << " / " << n << std::endl;
   
-  glBindTexture(GL_TEXTURE_2D, tex_index);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); // no upload, just reserve 
-  /* https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml : "GL_RED : each element is a single red component. The GL converts it to floating point and assembles it into an RGBA element by attaching 0 for green" 
-   * 
-   * 
-   */
-  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  glDeleteFramebuffers(1, &fbo);
+  pool.release(frame);
+}
+
+
+
+void test_16() { // many streams under an upload budget : the scheduler picks which tiles get their frames each vsync
+  Window      win;
+  GLubyte     *payload, *frame;
+  GLsizei     w, h;
+  std::size_t framesize;
+  int         i, k, n, nstreams, ticks;
+  double      ms;
   
   auto start = std::chrono::system_clock::now();
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> dt;
   
-  for(i=0;i<10;i++) {
-    // "copy" data to pbo
-    start = std::chrono::system_clock::now();
-    memset(payload,0,size);
-    end = std::chrono::system_clock::now();
-    dt = end-start;
-    std::cout << "memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  w        = 1280;
+  h        = 720;
+  nstreams = 16;
+  n        = 300;
+  framesize = frameSize(PIXFMT_I420, w, h);
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_I420, w, h);
+  
+  FramePool pool(64);
+  std::vector<FrameGenerator*> generators;
+  for(k=0;k<nstreams;k++) {
+    generators.push_back(new FrameGenerator(PIXFMT_I420, w, h, 0, k+1));
+  }
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  // a texture per plane & a pbo per stream
+  std::vector<GLuint> texs(3*nstreams), pbos(nstreams);
+  glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(texs.size(), texs.data());
+  glGenBuffers(pbos.size(), pbos.data());
+  for(k=0;k<nstreams;k++) {
+    for(i=0;i<3;i++) {
+      glBindTexture(GL_TEXTURE_2D, texs[3*k+i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planes[i].w, planes[i].h, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[k]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, framesize, 0, GL_STREAM_DRAW);
   }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
   
-  std::cout << std::endl;
+  auto upload = [&](int stream, const GLubyte* data, std::size_t size) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[stream]);
+    payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    streamcopy(payload, data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    for(int j=0;j<3;j++) {
+      glBindTexture(GL_TEXTURE_2D, texs[3*stream+j]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[j].w, planes[j].h, GL_RED, GL_UNSIGNED_BYTE, (GLubyte*)0+planes[j].offset);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+  };
   
-  for(i=0;i<10;i++) {
+  // layout : stream 0 big, 1..11 small tiles, the rest hidden (say, another page of the grid)
+  const std::size_t budgets[] = {std::size_t(nstreams)*framesize, 4*framesize, 2*framesize};
+  for(auto it=std::begin(budgets); it!=std::end(budgets); ++it) {
+    UploadScheduler scheduler(*it, &pool);
+    for(k=0;k<nstreams;k++) {
+      scheduler.addStream();
+      if (k==0) {
+        scheduler.setTile(k, true, 1280, 720);
+      }
+      else if (k<12) {
+        scheduler.setTile(k, true, 320, 180);
+      }
+      else {
+        scheduler.setTile(k, false, 0, 0);
+      }
+    }
+    
+    ticks = 0;
     start = std::chrono::system_clock::now();
-    // copy from pbo to texture
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_index);
-    glBindTexture(GL_TEXTURE_2D, tex_index); // this is the texture we will manipulate
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    for(i=0;i<n;i++) {
+      for(k=0;k<nstreams;k++) { // every stream decodes a frame per vsync
+        frame = pool.get(framesize);
+        generators[k]->next(frame);
+        scheduler.push(k, frame, framesize);
+      }
+      scheduler.tick(upload);
+      glXSwapBuffers(ctx.getDisplay(), win);
+      ticks++;
+    }
     glFinish();
     end = std::chrono::system_clock::now();
     dt = end-start;
-    std::cout << "pbo => texture took " << dt.count()*1000 << " ms" << std::endl;
+    ms = dt.count()*1000/ticks;
+    std::cout << "budget " << *it/1024 << " kB per frame : " << ms << " ms per frame" << std::endl;
+    scheduler.printStats();
+    std::cout << std::endl;
   }
+  
+  glDeleteTextures(texs.size(), texs.data());
+  glDeleteBuffers(pbos.size(), pbos.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for(k=0;k<nstreams;k++) {
+    delete generators[k];
+  }
+  pool.printStats();
 }
 
 
-void test_3() {
+
+void test_17() { // frame pacing : uploads just in time before the vblank vs. right after the previous swap
   Window  win;
-  GLuint  tbo_index, tex_index;
-  GLubyte *payload;
-  GLint   format, internal_format; 
-  GLsizei w, h, size;
-  int     i;
+  GLsizei w, h, ww, wh;
+  int     i, k, n, nstreams;
+  uint64_t index;
+  XWindowAttributes wa;
+  
+  w        = 640;
+  h        = 360;
+  nstreams = 4;
+  n        = 300;
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_I420, w, h);
+  const double fps[] = {30, 25, 60, 15}; // of the streams
+  
+  FramePool pool(64);
+  std::vector<FrameGenerator*> generators;
+  std::vector<GLubyte*>        frames;
+  for(k=0;k<nstreams;k++) {
+    generators.push_back(new FrameGenerator(PIXFMT_I420, w, h, fps[k], k+1));
+    frames.push_back(pool.get(generators[k]->getFrameSize()));
+  }
   
   OpenGLContext ctx = OpenGLContext();
   
@@ -1046,228 +8452,542 @@ void test_3() {
   win=ctx.createWindow();
   ctx.makeCurrent(win);
   
-  w               =1920;
-  h               =1080;
-  size            =w*h;  // size of a LUMA HD frame
+  YUVShader *shader = new YUVShader();
+  ctx.reserve(shader);
   
+  std::vector<GLuint> texs(3*nstreams);
   glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(texs.size(), texs.data());
+  for(k=0;k<nstreams;k++) {
+    for(i=0;i<3;i++) {
+      glBindTexture(GL_TEXTURE_2D, texs[3*k+i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planes[i].w, planes[i].h, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
   
-  // let's reserve a TBO
-  glGenBuffers(1, &tbo_index); // a buffer
-  glBindBuffer(GL_TEXTURE_BUFFER, tbo_index); // .. what is it
-  glBufferData(GL_TEXTURE_BUFFER, size, 0, GL_STREAM_DRAW); // .. how much
+  for(int jit=0;jit<2;jit++) {
+    FramePacer pacer(ctx.getDisplay(), win, 1);
+    pacer.setJustInTime(jit);
+    
+    // stream k has a new frame every 1/fps[k] seconds : the frame of time t is the latest one available at t
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint64_t> shown(nstreams, uint64_t(-1));
+    
+    for(i=0;i<n;i++) {
+      pacer.beginFrame();
+      auto now = std::chrono::steady_clock::now();
+      for(k=0;k<nstreams;k++) {
+        index = uint64_t(std::chrono::duration<double>(now-t0).count()*fps[k]);
+        if (index==shown[k]) { // nothing new
+          continue;
+        }
+        generators[k]->generate(frames[k], index);
+        for(int j=0;j<3;j++) {
+          ctx.getState().bindTexture(GL_TEXTURE_2D, texs[3*k+j]);
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[j].w, planes[j].h, GL_RED, GL_UNSIGNED_BYTE, frames[k]+planes[j].offset);
+        }
+        shown[k] = index;
+        pacer.addInput(k, t0+std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(index/fps[k])));
+      }
+      
+      XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+      ww = wa.width/2;
+      wh = wa.height/2;
+      ctx.getState().viewport(0, 0, wa.width, wa.height);
+      glClear(GL_COLOR_BUFFER_BIT);
+      for(k=0;k<nstreams;k++) { // 2x2 grid
+        ctx.drawYUVShader(shader, texs[3*k], texs[3*k+1], texs[3*k+2], (k%2)*ww, (k/2)*wh, ww, wh, w, h);
+      }
+      pacer.endFrame();
+    }
+    std::cout << (jit ? "just in time uploads" : "uploads right after the swap") << " : " << std::endl;
+    pacer.printStats();
+    std::cout << std::endl;
+  }
   
-  // generate a texture
-  glGenTextures(1, &tex_index);
-  std::cout << "texture " << tex_index << std::endl;
+  glDeleteTextures(texs.size(), texs.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for(k=0;k<nstreams;k++) {
+    pool.release(frames[k]);
+    delete generators[k];
+  }
+  delete shader;
+}
+
+
+
+void test_18() { // many windows, one context : a window manager renders all windows & their tiles in one pass
+  GLsizei w, h;
+  int     i, k, n, nstreams;
+  double  ms;
   
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, tbo_index);
-  std::cout << "tbo " << tbo_index << std::endl;
-  glBindBuffer(GL_TEXTURE_BUFFER, 0); // unbind
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  w        = 640;
+  h        = 360;
+  nstreams = 8;
+  n        = 300;
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_I420, w, h);
+  
+  FramePool pool(64);
+  GLubyte*  frame = pool.get(frameSize(PIXFMT_I420, w, h));
+  std::vector<FrameGenerator*> generators;
+  for(k=0;k<nstreams;k++) {
+    generators.push_back(new FrameGenerator(PIXFMT_I420, w, h, 0, k+1));
+  }
   
+  OpenGLContext ctx = OpenGLContext();
   
-  // let's try to get dma to the texture buffer
-  glBindBuffer(GL_TEXTURE_BUFFER, tbo_index); // bind
-  payload = (GLubyte*)glMapBuffer(GL_TEXTURE_BUFFER, GL_WRITE_ONLY); // ** TODO: doesn't work
-  glUnmapBuffer(GL_TEXTURE_BUFFER); // release pointer to mapping buffer
-  glBindBuffer(GL_TEXTURE_BUFFER, 0); // unbind
+  ctx.loadExtensions();
   
-  std::cout << "tbo " << tbo_index << " at " << (long unsigned int)payload << std::endl;
+  WindowManager manager(&ctx);
   
-  if (!payload) {
-    std::cout << "Could not get tbo memory access!" << std::endl;
-    exit(2);
+  // console 1 : a grid of streams 0..5.  console 2 : stream 0 big, 6 & 7 small on the right
+  manager.addWindow("console 1");
+  manager.addWindow("console 2");
+  ctx.makeCurrent(manager.getWindow(0)); // the context needs a drawable before the shader & vao can be created
+  
+  YUVShader *shader = new YUVShader();
+  ctx.reserve(shader);
+  
+  std::vector<GLuint> texs(3*nstreams);
+  glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(texs.size(), texs.data());
+  for(k=0;k<nstreams;k++) {
+    for(i=0;i<3;i++) {
+      glBindTexture(GL_TEXTURE_2D, texs[3*k+i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planes[i].w, planes[i].h, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    }
+    manager.setStream(k, StreamTextures{texs[3*k], texs[3*k+1], texs[3*k+2], w, h});
+  }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  
+  manager.assignGrid(0, {0, 1, 2, 3, 4, 5});
+  manager.assign(1, 0, 0.0f,  0.0f, 0.75f, 1.0f);
+  manager.assign(1, 6, 0.75f, 0.5f, 0.25f, 0.5f);
+  manager.assign(1, 7, 0.75f, 0.0f, 0.25f, 0.5f);
+  
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    manager.processEvents();
+    for(k=0;k<nstreams;k++) {
+      generators[k]->next(frame);
+      for(int j=0;j<3;j++) {
+        ctx.getState().bindTexture(GL_TEXTURE_2D, texs[3*k+j]); // through the cache : render() relies on it
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[j].w, planes[j].h, GL_RED, GL_UNSIGNED_BYTE, frame+planes[j].offset);
+      }
+    }
+    manager.render(shader);
+  }
+  glFinish();
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << manager.getWindowCount() << " windows, " << nstreams << " streams : " << ms << " ms per frame, "
+            << manager.getContextSwitches() << " context switches in " << n << " frames" << std::endl;
+  
+  glDeleteTextures(texs.size(), texs.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  delete shader;
+  for(k=0;k<nstreams;k++) {
+    delete generators[k];
   }
+  pool.release(frame);
+}
+
+
+
+void test_19() { // gl state cache : state calls per frame with & without skipping the redundant ones
+  GLsizei w, h;
+  int     i, k, n, nstreams, cached;
+  double  ms;
   
   auto start = std::chrono::system_clock::now();
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> dt;
   
-  for(i=0;i<10;i++) {
-    // "copy" data to tbo
-    start = std::chrono::system_clock::now();
-    memset(payload,0,size);
-    end = std::chrono::system_clock::now();
-    dt = end-start;
-    std::cout << "memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  w        = 320;
+  h        = 180;
+  nstreams = 4;
+  n        = 200;
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_I420, w, h);
+  
+  FramePool pool(64);
+  GLubyte*  frame = pool.get(frameSize(PIXFMT_I420, w, h));
+  FrameGenerator generator(PIXFMT_I420, w, h);
+  
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  
+  WindowManager manager(&ctx);
+  GLStateCache& state = ctx.getState();
+  
+  for(i=0;i<3;i++) { // three consoles showing the same streams in different layouts
+    manager.addWindow();
   }
+  ctx.makeCurrent(manager.getWindow(0));
   
-  std::cout << std::endl;
+  YUVShader *shader = new YUVShader();
+  ctx.reserve(shader);
+  state.invalidate(); // shader & reserve made raw gl calls
   
-  for(i=0;i<10;i++) {
+  std::vector<GLuint> texs(3*nstreams);
+  glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(texs.size(), texs.data());
+  for(k=0;k<nstreams;k++) {
+    for(i=0;i<3;i++) {
+      state.bindTexture(GL_TEXTURE_2D, texs[3*k+i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planes[i].w, planes[i].h, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    }
+    manager.setStream(k, StreamTextures{texs[3*k], texs[3*k+1], texs[3*k+2], w, h});
+  }
+  manager.assignGrid(0, {0, 1, 2, 3});
+  manager.assignGrid(1, {0, 0, 1, 1, 2, 2, 3, 3, 0}); // a stream in many tiles : textures stay bound between them
+  manager.assign(2, 3, 0.0f, 0.0f, 1.0f, 1.0f);
+  
+  for(cached=1;cached>=0;cached--) {
+    state.setEnabled(cached);
+    state.resetStats();
     start = std::chrono::system_clock::now();
-    // copy from pbo to texture
-    glBindTexture(GL_TEXTURE_BUFFER, tex_index);
-    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, tbo_index);
-    // glUniform1i(u_tbo_tex, 0); // u_tbo_tex would be from the shader program..
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    for(i=0;i<n;i++) {
+      manager.processEvents();
+      if (i%2==0) { // a new frame every other vsync, for stream 0 only
+        generator.next(frame);
+        for(int j=0;j<3;j++) {
+          state.bindTexture(GL_TEXTURE_2D, texs[j]);
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[j].w, planes[j].h, GL_RED, GL_UNSIGNED_BYTE, frame+planes[j].offset);
+        }
+      }
+      manager.render(shader);
+    }
     glFinish();
     end = std::chrono::system_clock::now();
     dt = end-start;
-    std::cout << "pbo => texture took " << dt.count()*1000 << " ms" << std::endl;
+    ms = dt.count()*1000/n;
+    std::cout << ms << " ms per frame" << std::endl;
+    state.printStats(n);
   }
+  
+  glDeleteTextures(texs.size(), texs.data());
+  state.invalidate(); // names may be reused
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  delete shader;
+  pool.release(frame);
 }
 
 
-void test_4() {
+
+void test_20() { // many tiles : a draw call & uniform updates per tile vs. one instanced draw with the parameters in a uniform buffer
   Window  win;
-  GLuint  y_pbo, u_pbo, v_pbo;
-  GLuint  y_tex, u_tex, v_tex;
-  GLubyte *y_payload, *u_payload, *v_payload;
-  GLubyte *image, *y_image, *u_image, *v_image;
-  GLint   format, internal_format; 
-  GLsizei w, h, size, yuvsize;
-  int     i;
+  GLsizei w, h, tw, th;
+  int     i, k, n, nstreams, cols, ntiles;
+  double  ms;
+  XWindowAttributes wa;
   
   auto start = std::chrono::system_clock::now();
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> dt;
   
-  format          =GL_RED; 
-  internal_format =GL_RED;
+  w        = 320;
+  h        = 180;
+  nstreams = 16;
+  cols     = 8;
+  ntiles   = cols*cols;
+  n        = 300;
+  std::vector<PlaneLayout> planes = planeLayout(PIXFMT_I420, w, h);
+  
+  FramePool pool(64);
+  GLubyte*  frame = pool.get(frameSize(PIXFMT_I420, w, h));
+  FrameGenerator generator(PIXFMT_I420, w, h);
   
   OpenGLContext ctx = OpenGLContext();
   
   ctx.loadExtensions();
   win=ctx.createWindow();
   ctx.makeCurrent(win);
+  XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+  tw = wa.width/cols;
+  th = wa.height/cols;
   
   YUVShader *shader = new YUVShader();
+  ctx.reserve(shader);
+  GLStateCache& state = ctx.getState();
   
-  ctx.reserve(shader); // reserve stuff .. and communicate with the shader about the whereabouts of that stuff
-  
-  // w               =1920;
-  // h               =1080;
-  
-  w               =1280;
-  h               =720;
-  
-  size            =w*h;  // single plane size
-  yuvsize         =(3*size)/2; // all planes in yuv
-  
-  image   = new GLubyte[yuvsize];
-  y_image = new GLubyte[size];
-  u_image = new GLubyte[size/4];
-  v_image = new GLubyte[size/4];
-  
-  // rgb : w*h*3
-  // yuv planes : 1 + 2*(1/4) = 1+1/2 = 3/2 = (3/2) * w*h 
-  
-  // load the image
-  std::cout << "read " << readbytes("1.yuv",image) <<" bytes" << std::endl;
-  std::cout << "should be " << yuvsize << " bytes" << std::endl;
-  
-  memcpy(y_image, image,              size  );
-  memcpy(u_image, &image[size],       size/4);
-  memcpy(v_image, &image[(5*size)/4], size/4); // 4/4 + 1/4 = 5/4
-  // return;
-  
-  // let's reserve PBOs
-  getPBO(y_pbo,size,   y_payload);
-  getPBO(u_pbo,size/4, u_payload);
-  getPBO(v_pbo,size/4, v_payload);
-  
-  // let's create yuv textures
+  // the same frames as plain textures & as texture array layers
+  std::vector<GLuint> texs(3*nstreams);
   glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glGenTextures(texs.size(), texs.data());
+  TileRenderer renderer(&ctx, w, h, nstreams);
+  for(k=0;k<nstreams;k++) {
+    generator.next(frame);
+    for(i=0;i<3;i++) {
+      glBindTexture(GL_TEXTURE_2D, texs[3*k+i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, planes[i].w, planes[i].h, 0, GL_RED, GL_UNSIGNED_BYTE, frame+planes[i].offset);
+    }
+    renderer.uploadLayer(k, frame);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  state.invalidate();
   
-  glGenTextures(1, &y_tex);
-  glBindTexture(GL_TEXTURE_2D, y_tex);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, GL_UNSIGNED_BYTE, 0); 
+  // a draw call per tile
+  state.resetStats();
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    state.viewport(0, 0, wa.width, wa.height);
+    glClear(GL_COLOR_BUFFER_BIT);
+    for(k=0;k<ntiles;k++) {
+      int stream = k % nstreams;
+      ctx.drawYUVShader(shader, texs[3*stream], texs[3*stream+1], texs[3*stream+2], (k%cols)*tw, (k/cols)*th, tw, th, w, h);
+    }
+    glXSwapBuffers(ctx.getDisplay(), win);
+  }
+  glFinish();
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << ntiles << " draw calls per frame : " << ms << " ms per frame" << std::endl;
+  state.printStats(n);
+  
+  // one instanced draw call
+  renderer.clearTiles();
+  for(k=0;k<ntiles;k++) {
+    renderer.addTile(k % nstreams, (k%cols)*tw, (k/cols)*th, tw, th, wa.width, wa.height);
+  }
+  state.resetStats();
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    state.viewport(0, 0, wa.width, wa.height);
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderer.render();
+    glXSwapBuffers(ctx.getDisplay(), win);
+  }
+  glFinish();
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << "1 instanced draw call per frame (" << (renderer.isPersistent() ? "persistent mapped" : "glBufferSubData") << " uniform buffer) : "
+            << ms << " ms per frame" << std::endl;
+  state.printStats(n);
+  
+  glDeleteTextures(texs.size(), texs.data());
+  state.invalidate();
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  delete shader;
+  pool.release(frame);
+}
+
+
+
+void test_21() { // small tiles of big streams : full resolution vs. mipmaps vs. gpu box filter vs. cpu downscale before upload
+  Window  win;
+  GLsizei w, h, tw, th;
+  int     i, k, n, nstreams, cols;
+  double  ms;
+  XWindowAttributes wa;
   
-  glGenTextures(1, &u_tex);
-  glBindTexture(GL_TEXTURE_2D, u_tex);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w/2, h/2, 0, format, GL_UNSIGNED_BYTE, 0); 
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  glGenTextures(1, &v_tex);
-  glBindTexture(GL_TEXTURE_2D, v_tex);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w/2, h/2, 0, format, GL_UNSIGNED_BYTE, 0); 
+  w        = 1920;
+  h        = 1080;
+  nstreams = 16;
+  cols     = 4;
+  n        = 100;
   
-  glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  FramePool pool(64);
+  GLubyte*  frame = pool.get(frameSize(PIXFMT_I420, w, h));
+  GLubyte*  small = pool.get(frameSize(PIXFMT_I420, w/2, h/2));
+  FrameGenerator generator(PIXFMT_I420, w, h);
+  generator.next(frame);
   
-  // ok
+  // cpu downscale alone
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    downscale2x2(small, frame, w, h); // luma only
+  }
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << "downscale2x2 " << w << "x" << h << " luma : " << ms << " ms, " << (double(w)*h/1e9)/(ms/1000) << " GB/s in" << std::endl;
   
-  // upload
-  //memcpy(y_payload, image,            size  );
-  //memcpy(u_payload, image+size,       size/4);
-  //memcpy(v_payload, image+(5*size)/4, size/4); // 4/4 + 1/4 = 5/4
+  OpenGLContext ctx = OpenGLContext();
   
-  memcpy(y_payload, y_image,  size  );
-  memcpy(u_payload, u_image,  size/4);
-  memcpy(v_payload, v_image,  size/4); // 4/4 + 1/4 = 5/4
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+  tw = wa.width/cols;
+  th = wa.height/cols;
   
-  sleep_for(1s); // give it time to upload
+  YUVShader *shader = new YUVShader();
+  ctx.reserve(shader);
+  glEnable(GL_TEXTURE_2D);
   
-  for(i=0;i<10;i++) {
+  const DownscaleMode modes[] = {DOWNSCALE_NONE, DOWNSCALE_MIPMAP, DOWNSCALE_GPU_BOX, DOWNSCALE_CPU};
+  for(auto it=std::begin(modes); it!=std::end(modes); ++it) {
+    std::vector<StreamDownscaler*> streams;
+    for(k=0;k<nstreams;k++) {
+      streams.push_back(new StreamDownscaler(&ctx, w, h, *it));
+    }
     start = std::chrono::system_clock::now();
-  
-    // y
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, y_pbo);
-    glBindTexture(GL_TEXTURE_2D, y_tex); // this is the texture we will manipulate
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
-    glBindTexture(GL_TEXTURE_2D, 0); 
-    
-    // u
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u_pbo);
-    glBindTexture(GL_TEXTURE_2D, u_tex); // this is the texture we will manipulate
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
-    glBindTexture(GL_TEXTURE_2D, 0);  
-    
-    // v
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, v_pbo);
-    glBindTexture(GL_TEXTURE_2D, v_tex); // this is the texture we will manipulate
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w/2, h/2, format, GL_UNSIGNED_BYTE, 0); // copy from pbo to texture 
-    glBindTexture(GL_TEXTURE_2D, 0); 
-    
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind
-    
-    glFlush();
+    for(i=0;i<n;i++) {
+      ctx.getState().viewport(0, 0, wa.width, wa.height);
+      glClear(GL_COLOR_BUFFER_BIT);
+      for(k=0;k<nstreams;k++) { // the same frame for every stream : it's about the upload & the sampling
+        streams[k]->upload(frame, tw, th);
+        StreamTextures textures = streams[k]->getTextures();
+        ctx.drawYUVShader(shader, textures.y_tex, textures.u_tex, textures.v_tex, (k%cols)*tw, (k/cols)*th, tw, th, w, h);
+      }
+      glXSwapBuffers(ctx.getDisplay(), win);
+    }
     glFinish();
-  
     end = std::chrono::system_clock::now();
     dt = end-start;
-    std::cout << "pbo => tex took " << dt.count()*1000 << " ms" << std::endl;
+    ms = dt.count()*1000/n;
+    std::cout << "downscale " << downscaleModeName(*it) << " : " << nstreams << " tiles of " << tw << "x" << th << " at level " << streams[0]->getLevel()
+              << " : " << ms << " ms per frame, " << double(streams[0]->getBytes())*nstreams/n/1e6 << " MB uploaded per frame" << std::endl;
+    for(k=0;k<nstreams;k++) {
+      delete streams[k];
+    }
+  }
+  
+  delete shader;
+  pool.release(frame);
+  pool.release(small);
+}
+
+
+
+void test_22() { // yuv => rgb on the cpu (SIMD, threaded, into a PBO) vs. in the fragment shader : kernels, then the startup policy
+  Window  win;
+  GLsizei w, h;
+  int     i, n, nthreads;
+  double  ms;
+  const char* kind;
+  XWindowAttributes wa;
+  
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
+  
+  w        = 1920;
+  h        = 1080;
+  n        = 50;
+  nthreads = std::max(1u, std::thread::hardware_concurrency());
+  
+  FramePool  pool(64);
+  WorkerPool workers(nthreads);
+  GLubyte*   frame = pool.get(frameSize(PIXFMT_I420, w, h));
+  GLubyte*   rgba  = pool.get(std::size_t(w)*h*4);
+  GLubyte*   ref   = pool.get(std::size_t(w)*h*4);
+  FrameGenerator generator(PIXFMT_I420, w, h);
+  generator.next(frame);
+  yuvToRGBA(ref, frame, w, h, NULL, yuvrow_c);
+  
+  const char* kernels[] = {"c", "sse2", "avx2"};
+  for(auto it=std::begin(kernels); it!=std::end(kernels); ++it) {
+    YUVRowKernel kernel = yuvRowKernel(*it, &kind);
+    if (strcmp(kind, *it)!=0) { // not on this cpu
+      continue;
+    }
+    yuvToRGBA(rgba, frame, w, h, NULL, kernel);
+    int maxdiff = 0;
+    for(std::size_t b=0;b<std::size_t(w)*h*4;b++) { // SIMD rounds half to even, yuvrow_c half up : allow one step
+      maxdiff = std::max(maxdiff, std::abs(int(rgba[b])-int(ref[b])));
+    }
+    if (maxdiff>1) {
+      std::cerr << "yuvToRGBA " << kind << " : differs from yuvrow_c by up to " << maxdiff << std::endl;
+      exit(2);
+    }
+    for(int threaded=0;threaded<2;threaded++) {
+      start = std::chrono::system_clock::now();
+      for(i=0;i<n;i++) {
+        yuvToRGBA(rgba, frame, w, h, threaded ? &workers : NULL, kernel);
+      }
+      end = std::chrono::system_clock::now();
+      dt = end-start;
+      ms = dt.count()*1000/n;
+      std::cout << "yuvToRGBA " << kind << " " << (threaded ? nthreads : 1) << " threads : " << ms << " ms per " << w << "x" << h << " frame" << std::endl;
+    }
   }
-    
-  ctx.renderYUVShader(win, shader, y_tex, u_tex, v_tex);
+  std::cout << std::endl;
   
-  sleep_for(5s);
+  OpenGLContext ctx = OpenGLContext();
+  
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
+  
+  YUVShader *shader = new YUVShader(); // for the vao
+  ctx.reserve(shader);
+  
+  ConvertRenderer renderer(&ctx, w, h, &workers);
+  ConvertPath     path = renderer.choose(frame);
+  std::cout << "using " << convertPathName(path) << " conversion" << std::endl;
+  
+  start = std::chrono::system_clock::now();
+  for(i=0;i<n;i++) {
+    XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+    generator.next(frame);
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderer.render(path, frame, 0, 0, wa.width, wa.height);
+    glXSwapBuffers(ctx.getDisplay(), win);
+  }
+  glFinish();
+  end = std::chrono::system_clock::now();
+  dt = end-start;
+  ms = dt.count()*1000/n;
+  std::cout << convertPathName(path) << " conversion, to the window : " << ms << " ms per frame" << std::endl;
   
+  delete shader;
+  pool.release(frame);
+  pool.release(rgba);
+  pool.release(ref);
 }
 
-
-void test_5() {
+void test_23() { // 10-bit yuv (P010, yuv420p10le) : R16/RG16 textures (twice the bytes) vs. cpu down-conversion to 8-bit I420
   Window  win;
-  // GLuint  y_pbo, u_pbo, v_pbo;
-  // GLuint  y_tex, u_tex, v_tex;
-  GLuint  pbo, tex;
-  // GLubyte *y_payload, *u_payload, *v_payload;
-  GLubyte    *payload, *dummypayload;
-  GLubyte *image, *y_image, *u_image, *v_image;
-  GLint   format, internal_format; 
-  GLsizei w, h, size, yuvsize, texsize, stridesize;
-  // int     i, j;
-  GLsizei   i,j;
-  GLuint    byteformat;
+  GLuint  pbo;
+  GLubyte *payload, *frame;
+  GLsizei w, h;
+  int     i, n;
+  double  ms;
+  std::size_t size16, size8;
+  XWindowAttributes wa;
+  GLuint  texs8[3], texs16[3];
   
   auto start = std::chrono::system_clock::now();
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> dt;
   
-  // one of these ..
-  format          =GL_BGRA;
-  // format          =GL_RGBA;
-  
-  // internal_format =GL_RGBA;
-  internal_format =GL_RGBA8;
+  w = 1920;
+  h = 1080;
+  n = 100;
   
-  byteformat =GL_UNSIGNED_INT_8_8_8_8_REV;
+  FramePool pool(64);
+  size8  = frameSize(PIXFMT_I420, w, h);
+  size16 = frameSize(PIXFMT_P010, w, h); // same for PIXFMT_I420P10
+  frame  = pool.get(size8);
+  GLubyte* frame16 = pool.get(size16);
+  FrameGenerator generator(PIXFMT_I420, w, h);
+  generator.next(frame);
   
   OpenGLContext ctx = OpenGLContext();
   
@@ -1275,150 +8995,725 @@ void test_5() {
   win=ctx.createWindow();
   ctx.makeCurrent(win);
   
-  YUVBlockShader *shader = new YUVBlockShader();
+  YUVShader   *shader   = new YUVShader();
+  YUV16Shader *shader16 = new YUV16Shader();
+  ctx.reserve(shader);
   
-  ctx.reserve(shader); // reserve stuff .. and communicate with the shader about the whereabouts of that stuff
+  getPBO(pbo, size16, payload);
   
-  // w               =1920;
-  // h               =1080;
+  std::vector<PlaneLayout> planes8 = planeLayout(PIXFMT_I420, w, h);
+  glEnable(GL_TEXTURE_2D);
+  glGenTextures(3, texs8);
+  glGenTextures(3, texs16);
+  for(i=0;i<3;i++) {
+    glBindTexture(GL_TEXTURE_2D, texs8[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, planes8[i].internal_format, planes8[i].w, planes8[i].h, 0, planes8[i].format, planes8[i].type, 0);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0); // unbind
   
-  w               =1280;
-  h               =720;
+  const PixelFormat formats[] = {PIXFMT_P010, PIXFMT_I420P10};
+  for(auto it=std::begin(formats); it!=std::end(formats); ++it) {
+    i420ToYUV16((uint16_t*)frame16, frame, *it, w, h);
+    std::vector<PlaneLayout> planes = planeLayout(*it, w, h);
+    
+    for(i=0;i<int(planes.size());i++) { // P010 has two planes, the third texture stays unused
+      glBindTexture(GL_TEXTURE_2D, texs16[i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, planes[i].internal_format, planes[i].w, planes[i].h, 0, planes[i].format, planes[i].type, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    ctx.getState().invalidate();
+    
+    // cpu conversion alone
+    start = std::chrono::system_clock::now();
+    for(i=0;i<n;i++) {
+      yuv16ToI420(frame, (const uint16_t*)frame16, *it, w, h);
+    }
+    end = std::chrono::system_clock::now();
+    dt = end-start;
+    ms = dt.count()*1000/n;
+    std::cout << pixelFormatName(*it) << " => i420 on the cpu : " << ms << " ms per " << w << "x" << h << " frame" << std::endl;
+    
+    for(int convert=0;convert<2;convert++) {
+      std::size_t bytes = convert ? size8 : size16;
+      start = std::chrono::system_clock::now();
+      for(i=0;i<n;i++) {
+        XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (convert) {
+          yuv16ToI420(payload, (const uint16_t*)frame16, *it, w, h); // straight into the mapped PBO
+        }
+        else {
+          streamcopy(payload, frame16, size16);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        std::vector<PlaneLayout>& pl = convert ? planes8 : planes;
+        GLuint* texs = convert ? texs8 : texs16;
+        for(std::size_t j=0;j<pl.size();j++) {
+          glBindTexture(GL_TEXTURE_2D, texs[j]);
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pl[j].w, pl[j].h, pl[j].format, pl[j].type, (GLvoid*)pl[j].offset);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0); // unbind
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+        ctx.getState().invalidate();
+        
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (convert) {
+          ctx.drawYUVShader(shader, texs8[0], texs8[1], texs8[2], 0, 0, wa.width, wa.height, w, h);
+        }
+        else {
+          ctx.drawYUV16Shader(shader16, yuv16Scale(*it), *it==PIXFMT_P010, texs16[0], texs16[1], texs16[2], 0, 0, wa.width, wa.height, w, h);
+        }
+        glXSwapBuffers(ctx.getDisplay(), win);
+      }
+      glFinish();
+      end = std::chrono::system_clock::now();
+      dt = end-start;
+      ms = dt.count()*1000/n;
+      std::cout << pixelFormatName(*it) << (convert ? " => cpu => i420 => R8 textures : " : " => R16 textures : ")
+                << bytes << " bytes per frame, " << ms << " ms per frame, " << (double(bytes)/1e9)/(ms/1000) << " GB/s" << std::endl;
+    }
+    std::cout << std::endl;
+  }
   
-  size            =w*h;  // single plane size
-  yuvsize         =(3*size)/2; // all planes in yuv
-  stridesize      =w*4; /// one BGRA line
-  texsize         =size*4; // BGRA
+  glDeleteTextures(3, texs8);
+  glDeleteTextures(3, texs16);
+  glDeleteBuffers(1, &pbo);
+  ctx.getState().invalidate();
+  delete shader;
+  delete shader16;
+  pool.release(frame);
+  pool.release(frame16);
+}
+
+void test_24() { // packed 4:2:2 (YUYV, UYVY) : one RGBA8 texture & per-fragment unpacking vs. cpu repacking to I420
+  Window  win;
+  GLuint  pbo, tex422, texs8[3];
+  GLubyte *payload, *frame;
+  GLsizei w, h;
+  int     i, n;
+  double  ms;
+  std::size_t size422, size8;
+  XWindowAttributes wa;
   
-  image   = new GLubyte[yuvsize];
-  y_image = new GLubyte[size];
-  u_image = new GLubyte[size/4];
-  v_image = new GLubyte[size/4];
+  auto start = std::chrono::system_clock::now();
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dt;
   
-  // rgb : w*h*3
-  // yuv planes : 1 + 2*(1/4) = 1+1/2 = 3/2 = (3/2) * w*h 
+  w = 1920;
+  h = 1080;
+  n = 100;
   
-  // load the image
-  std::cout << "read " << readbytes("1.yuv",image) <<" bytes" << std::endl;
-  std::cout << "should be " << yuvsize << " bytes" << std::endl;
+  FramePool pool(64);
+  size8   = frameSize(PIXFMT_I420, w, h);
+  size422 = frameSize(PIXFMT_YUYV, w, h);
+  frame   = pool.get(size422);
   
-  memcpy(y_image, image,              size  );
-  memcpy(u_image, &image[size],       size/4);
-  memcpy(v_image, &image[(5*size)/4], size/4); // 4/4 + 1/4 = 5/4
+  OpenGLContext ctx = OpenGLContext();
   
-  // return;
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  // let's reserve PBOs
-  // getPBO(y_pbo,size,   y_payload);
-  // getPBO(u_pbo,size/4, u_payload);
-  // getPBO(v_pbo,size/4, v_payload);
+  YUVShader  *shader    = new YUVShader();
+  YUYVShader *shader422 = new YUYVShader();
+  ctx.reserve(shader);
   
-  getPBO(pbo,texsize,payload);
-  // let's create a dummy payload for comparison
-  dummypayload = new GLubyte[texsize];
+  getPBO(pbo, size422, payload);
   
-  // let's create the texture
+  std::vector<PlaneLayout> planes8   = planeLayout(PIXFMT_I420, w, h);
+  std::vector<PlaneLayout> planes422 = planeLayout(PIXFMT_YUYV, w, h); // same for PIXFMT_UYVY
   glEnable(GL_TEXTURE_2D);
-  
-  glGenTextures(1, &tex);
-  glBindTexture(GL_TEXTURE_2D, tex);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, byteformat, 0); 
+  glGenTextures(3, texs8);
+  for(i=0;i<3;i++) {
+    glBindTexture(GL_TEXTURE_2D, texs8[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, planes8[i].internal_format, planes8[i].w, planes8[i].h, 0, planes8[i].format, planes8[i].type, 0);
+  }
+  glGenTextures(1, &tex422);
+  glBindTexture(GL_TEXTURE_2D, tex422);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); // texelFetch in the shader anyway
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, planes422[0].internal_format, planes422[0].w, planes422[0].h, 0, planes422[0].format, planes422[0].type, 0);
   glBindTexture(GL_TEXTURE_2D, 0); // unbind
+  ctx.getState().invalidate();
   
-  //memset(payload,0,texsize);
-  //memcpy(y_payload, y_image,  size  );
-  //memcpy(u_payload, u_image,  size/4);
-  //memcpy(v_payload, v_image,  size/4); // 4/4 + 1/4 = 5/4
-  
-  start = std::chrono::system_clock::now();
-  for(i=0;i<h;i++) { // i == luma pixel index
-    for(j=0;j<stridesize;j=j+4) { // 0, 4, 8, .. // j/4 == luma pixel index
-      dummypayload[i*(stridesize)+j  ] =y_image[i*w    +j/4];     // b
-      dummypayload[i*(stridesize)+j+1] =u_image[(i/2)*(w/2)+j/8]; // g
-      dummypayload[i*(stridesize)+j+2] =v_image[(i/2)*(w/2)+j/8]; // r
-      dummypayload[i*(stridesize)+j+3] =255;                      // a
+  const PixelFormat formats[] = {PIXFMT_YUYV, PIXFMT_UYVY};
+  for(auto it=std::begin(formats); it!=std::end(formats); ++it) {
+    FrameGenerator generator(*it, w, h);
+    
+    for(int repack=0;repack<2;repack++) {
+      std::size_t bytes = repack ? size8 : size422;
+      start = std::chrono::system_clock::now();
+      for(i=0;i<n;i++) {
+        XGetWindowAttributes(ctx.getDisplay(), win, &wa);
+        generator.next(frame);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (repack) {
+          packed422ToI420(payload, frame, *it, w, h); // straight into the mapped PBO
+        }
+        else {
+          streamcopy(payload, frame, size422);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        if (repack) {
+          for(std::size_t j=0;j<planes8.size();j++) {
+            glBindTexture(GL_TEXTURE_2D, texs8[j]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes8[j].w, planes8[j].h, planes8[j].format, planes8[j].type, (GLvoid*)planes8[j].offset);
+          }
+        }
+        else {
+          glBindTexture(GL_TEXTURE_2D, tex422);
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes422[0].w, planes422[0].h, planes422[0].format, planes422[0].type, 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0); // unbind
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+        ctx.getState().invalidate();
+        
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (repack) {
+          ctx.drawYUVShader(shader, texs8[0], texs8[1], texs8[2], 0, 0, wa.width, wa.height, w, h);
+        }
+        else {
+          ctx.drawYUYVShader(shader422, *it==PIXFMT_UYVY, tex422, 0, 0, wa.width, wa.height, w, h);
+        }
+        glXSwapBuffers(ctx.getDisplay(), win);
+      }
+      glFinish();
+      end = std::chrono::system_clock::now();
+      dt = end-start;
+      ms = dt.count()*1000/n;
+      std::cout << pixelFormatName(*it) << (repack ? " => cpu => i420 => R8 textures : " : " => RGBA8 texture : ")
+                << bytes << " bytes per frame, " << ms << " ms per frame" << std::endl;
     }
+    std::cout << std::endl;
   }
-  end = std::chrono::system_clock::now();
-  dt = end-start;
-  std::cout << "memory manipulation took " << dt.count()*1000 << " ms" << std::endl; // 66 ms 
   
-  start = std::chrono::system_clock::now();
-  memcpy(payload,dummypayload,texsize); // hd-ready : 4 ms
-  end = std::chrono::system_clock::now();
-  dt = end-start;
-  std::cout << "memory upload took " << dt.count()*1000 << " ms" << std::endl;
+  glDeleteTextures(3, texs8);
+  glDeleteTextures(1, &tex422);
+  glDeleteBuffers(1, &pbo);
+  ctx.getState().invalidate();
+  delete shader;
+  delete shader422;
+  pool.release(frame);
+}
+
+
+
+
+
+/*** Benchmark driver : ./a.out --strategy pbo --size 1920x1080 --format i420 ... ***/
+
+void runUsage(const char* name) {
+  std::cout << "usage: " << name << " [options]" << std::endl
+            << "  --strategy   direct|pbo          upload from cpu memory or through a ring of PBOs (default pbo)" << std::endl
+            << "  --size       WxH                 frame size (default 1920x1080)" << std::endl
+            << "  --format     FORMAT              i420, nv12, bgra, yuyv, uyvy, p010 or yuv420p10le (default i420)" << std::endl
+            << "  --streams    N                   concurrent streams (default 1)" << std::endl
+            << "  --duration   SECONDS             (default 5)" << std::endl
+            << "  --threads    N                   threads copying into the PBOs (default 1)" << std::endl
+            << "  --ring       N                   PBOs per stream (default 2)" << std::endl
+            << "  --source     synthetic|FILE      frames from FrameGenerator, or a y4m / raw 1280x720 I420 file (default synthetic)" << std::endl
+            << "  --output     text|csv|json       result format (default text)" << std::endl
+            << "  --trace      FILE                write the stages of every frame as trace event json (chrome://tracing, ui.perfetto.dev)" << std::endl
+            << "  --metrics    FILE|unix:PATH      live counters in the prometheus text format : a file rewritten every second, or a unix socket" << std::endl
+            << "strategy, size, format, streams, threads and ring take comma separated lists too : every combination is run (a sweep)," << std::endl
+            << "e.g. --size 1280x720,1920x1080,3840x2160 --streams 1,4,16 --ring 1,2,3 --threads 1,4 --output csv" << std::endl;
+}
+
+
+std::vector<std::string> splitList(const char* arg) {
+  std::vector<std::string> items;
+  std::string        item;
+  std::istringstream stream(arg);
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+
+bool parseIntList(const char* arg, std::vector<int>& values) {
+  values.clear();
+  for(const std::string& item : splitList(arg)) {
+    values.push_back(atoi(item.c_str()));
+    if (values.back()<1) {
+      return false;
+    }
+  }
+  return !values.empty();
+}
+
+
+bool parseRunConfig(int argc, char** argcv, RunConfig& config, RunSweep& sweep) {
+  int       opt;
+  GLsizei   w, h;
+  PixelFormat format;
+  
+  static struct option options[] = {
+    {"strategy", required_argument, 0, 's'},
+    {"size",     required_argument, 0, 'z'},
+    {"format",   required_argument, 0, 'f'},
+    {"streams",  required_argument, 0, 'n'},
+    {"duration", required_argument, 0, 'd'},
+    {"threads",  required_argument, 0, 't'},
+    {"ring",     required_argument, 0, 'r'},
+    {"source",   required_argument, 0, 'i'},
+    {"output",   required_argument, 0, 'o'},
+    {"trace",    required_argument, 0, 'x'},
+    {"metrics",  required_argument, 0, 'm'},
+    {"help",     no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+  };
   
-  /*
-  start = std::chrono::system_clock::now();
-  for(i=0;i<h;i++) { // i == luma pixel index
-    for(j=0;j<stridesize;j=j+4) { // 0, 4, 8, .. // j/4 == luma pixel index
-      payload[i*(stridesize)+j  ] =y_image[i*w    +j/4];     // b
-      payload[i*(stridesize)+j+1] =u_image[(i/2)*(w/2)+j/8]; // g
-      payload[i*(stridesize)+j+2] =v_image[(i/2)*(w/2)+j/8]; // r
-      payload[i*(stridesize)+j+3] =255;                      // a
+  config = RunConfig{"pbo", 1920, 1080, PIXFMT_I420, 1, 5.0, 1, 2, "synthetic", "text", "", ""};
+  sweep  = RunSweep{{"pbo"}, {{1920, 1080}}, {PIXFMT_I420}, {1}, {1}, {2}};
+  
+  optind = 1;
+  while ((opt = getopt_long(argc, argcv, "", options, NULL))!=-1) {
+    switch (opt) {
+      case('s'):
+        sweep.strategies = splitList(optarg);
+        for(const std::string& strategy : sweep.strategies) {
+          if (strategy!="direct" && strategy!="pbo") {
+            std::cerr << "bad strategy " << strategy << std::endl;
+            return false;
+          }
+        }
+        break;
+      case('z'):
+        sweep.sizes.clear();
+        for(const std::string& item : splitList(optarg)) {
+          if (sscanf(item.c_str(), "%dx%d", &w, &h)!=2 || w<2 || h<2) {
+            std::cerr << "bad size " << item << std::endl;
+            return false;
+          }
+          sweep.sizes.push_back(std::make_pair(w, h));
+        }
+        break;
+      case('f'):
+        sweep.formats.clear();
+        for(const std::string& item : splitList(optarg)) {
+          if (!parsePixelFormat(item.c_str(), format)) {
+            std::cerr << "bad format " << item << std::endl;
+            return false;
+          }
+          sweep.formats.push_back(format);
+        }
+        break;
+      case('n'):
+        if (!parseIntList(optarg, sweep.streams)) {
+          std::cerr << "bad streams " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case('d'):
+        config.duration = atof(optarg);
+        break;
+      case('t'):
+        if (!parseIntList(optarg, sweep.threads)) {
+          std::cerr << "bad threads " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case('r'):
+        if (!parseIntList(optarg, sweep.rings)) {
+          std::cerr << "bad ring " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case('i'):
+        config.source = optarg;
+        break;
+      case('o'):
+        config.output = optarg;
+        if (config.output!="text" && config.output!="csv" && config.output!="json") {
+          std::cerr << "bad output " << optarg << std::endl;
+          return false;
+        }
+        break;
+      case('x'):
+        config.trace = optarg;
+        break;
+      case('m'):
+        config.metrics = optarg;
+        break;
+      case('h'):
+        runUsage(argcv[0]);
+        exit(0);
+      default:
+        runUsage(argcv[0]);
+        return false;
     }
   }
-  end = std::chrono::system_clock::now();
-  dt = end-start;
-  std::cout << "direct memory upload took " << dt.count()*1000 << " ms" << std::endl;
-  */
+  if (sweep.strategies.empty() || sweep.sizes.empty() || sweep.formats.empty() || config.duration<=0) {
+    std::cerr << "bad parameters" << std::endl;
+    return false;
+  }
+  if (config.source!="synthetic" && (sweep.sizes.size()>1 || sweep.formats.size()>1)) { // the file decides : the cells would repeat
+    std::cerr << "--source " << config.source << " : size & format come from the file, not sweeping them" << std::endl;
+    sweep.sizes.resize(1);
+    sweep.formats.resize(1);
+  }
+  return true;
+}
+
+
+std::vector<RunConfig> expandSweep(const RunConfig& base, const RunSweep& sweep) { // cartesian product, the last parameter varying fastest
+  std::vector<RunConfig> configs;
+  RunConfig config = base;
+  for(const std::string& strategy : sweep.strategies) {
+    for(auto size : sweep.sizes) {
+      for(PixelFormat format : sweep.formats) {
+        for(int streams : sweep.streams) {
+          for(int ring : sweep.rings) {
+            for(int threads : sweep.threads) {
+              config.strategy = strategy;
+              config.w        = size.first;
+              config.h        = size.second;
+              config.format   = format;
+              config.streams  = streams;
+              config.ring     = ring;
+              config.threads  = threads;
+              configs.push_back(config);
+            }
+          }
+        }
+      }
+    }
+  }
+  return configs;
+}
+
+
+/** Upload frames of config.streams streams as fast as possible for config.duration seconds
+ * 
+ * Each stream has a texture per plane and a ring of config.ring PBOs ("pbo") or fences ("direct").  A fence after each upload tells
+ * when the gpu is done with it : the latency of a frame is from getting it from the source to its fence being signaled, observed
+ * when its ring slot is reused.
+ */
+RunResult runBenchmark(const RunConfig& cfg) {
+  RunConfig   config = cfg;
+  Window      win;
+  GLubyte     *payload, *data;
+  std::size_t framesize;
+  int         i, k, slot;
+  uint64_t    frames;
+  double      seconds;
+  RunResult   result;
+  std::vector<double> latencies;
+  
+  Y4MReader* reader = NULL;
+  if (config.source!="synthetic") {
+    reader = new Y4MReader(config.source.c_str(), 1280, 720);
+    if (!reader->ok() || !reader->isI420()) {
+      std::cerr << "runBenchmark : need an 8-bit 4:2:0 file of even width and height" << std::endl;
+      delete reader;
+      return RunResult{config.w, config.h, config.format, 0, 0, 0, 0, 0, 0, 0, 0};
+    }
+    config.w      = reader->getWidth();
+    config.h      = reader->getHeight();
+    config.format = PIXFMT_I420;
+  }
   
-  /*
-  std::cout << "MAX " << (i*w)/4+j/8 << std::endl;
+  std::vector<PlaneLayout> planes = planeLayout(config.format, config.w, config.h);
+  framesize = frameSize(config.format, config.w, config.h);
   
-  for(i=0;i<=10;i++) {
-    std::cout << "u> " << int(u_image[i]) << std::endl;
-  }
+  OpenGLContext ctx = OpenGLContext();
   
-  std::cout << std::endl;
+  ctx.loadExtensions();
+  win=ctx.createWindow();
+  ctx.makeCurrent(win);
   
-  for(i=0;i<=10;i++) {
-    std::cout << "v> " << int(v_image[i]) << std::endl;
+  FramePool  pool(64);
+  WorkerPool workers(config.threads);
+  
+  struct Stream {
+    std::vector<GLuint>   texs;     ///< per plane
+    std::vector<GLuint>   pbos;     ///< ring
+    std::vector<GLsync>   fences;   ///< ring
+    std::vector<std::chrono::steady_clock::time_point> starts; ///< ring : when the frame was acquired
+    int                   slot;
+    FrameGenerator*       generator;
+    GLubyte*              frame;
+    uint64_t              count;
+    MetricCounter*        metric_uploaded; ///< see MetricsRegistry
+    MetricCounter*        metric_bytes;
+    MetricGauge*          metric_in_flight; ///< ring slots the gpu hasn't finished with
+  };
+  std::vector<Stream> streams(config.streams);
+  MetricsRegistry&  registry          = MetricsRegistry::get();
+  MetricHistogram&  metric_fence_wait = registry.histogram("upload_fence_wait_seconds", "Waits for the gpu to release a PBO ring slot", MetricsRegistry::timeBuckets());
+  
+  glEnable(GL_TEXTURE_2D);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for(k=0;k<config.streams;k++) {
+    Stream& stream = streams[k];
+    stream.texs.resize(planes.size());
+    glGenTextures(planes.size(), stream.texs.data());
+    for(i=0;i<int(planes.size());i++) {
+      glBindTexture(GL_TEXTURE_2D, stream.texs[i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, planes[i].internal_format, planes[i].w, planes[i].h, 0, planes[i].format, planes[i].type, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind
+    if (config.strategy=="pbo") {
+      stream.pbos.resize(config.ring);
+      glGenBuffers(config.ring, stream.pbos.data());
+      for(i=0;i<config.ring;i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, framesize, 0, GL_STREAM_DRAW);
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind
+    }
+    stream.fences.assign(config.ring, (GLsync)0);
+    stream.starts.resize(config.ring);
+    stream.slot      = 0;
+    stream.count     = 0;
+    stream.generator = reader ? NULL : new FrameGenerator(config.format, config.w, config.h, 0, k+1);
+    stream.frame     = reader ? NULL : pool.get(framesize);
+    stream.metric_uploaded  = &registry.counter("bench_upload_frames_total", "Frames uploaded by the benchmark driver", MetricsRegistry::label("stream", k));
+    stream.metric_bytes     = &registry.counter("bench_upload_bytes_total", "Bytes uploaded by the benchmark driver", MetricsRegistry::label("stream", k));
+    stream.metric_in_flight = &registry.gauge("upload_pbo_in_flight", "PBO ring slots in use by the gpu", MetricsRegistry::label("stream", k));
+    stream.metric_in_flight->set(0);
   }
   
-  std::cout << std::endl;
+  auto waitSlot = [&](Stream& stream, int slot) { // wait for the gpu to finish with a ring slot & record the latency of its frame
+    if (!stream.fences[slot]) {
+      return;
+    }
+    TRACE_SCOPE("fence wait");
+    auto wait_start = std::chrono::steady_clock::now();
+    glClientWaitSync(stream.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+    metric_fence_wait.observe(std::chrono::duration<double>(std::chrono::steady_clock::now()-wait_start).count());
+    glDeleteSync(stream.fences[slot]);
+    stream.fences[slot] = (GLsync)0;
+    stream.metric_in_flight->add(-1);
+    latencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now()-stream.starts[slot]).count()*1000);
+  };
   
-  for(i=0;i<100;i++) {
-    std::cout << "> " << int(payload[i]) << std::endl;
+  frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto end   = start;
+  while (std::chrono::duration<double>(end-start).count()<config.duration) {
+    for(k=0;k<config.streams;k++) {
+      Stream& stream = streams[k];
+      slot = stream.slot;
+      waitSlot(stream, slot);
+      stream.starts[slot] = std::chrono::steady_clock::now();
+      
+      // get a frame
+      if (reader) {
+        TRACE_SCOPE("read");
+        data = reader->frame(stream.count % reader->getFrameCount()).data;
+      }
+      else {
+        TRACE_SCOPE("generate");
+        stream.generator->next(stream.frame);
+        data = stream.frame;
+      }
+      stream.count++;
+      
+      // upload it
+      if (config.strategy=="pbo") {
+        TRACE_SCOPE("memcpy to pbo");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.pbos[slot]);
+        payload = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, framesize, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT); // the fence guarantees the gpu is done with it
+        parallelCopy(workers, payload, data, framesize);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        data = NULL; // offsets into the pbo from here on
+      }
+      {
+        TRACE_SCOPE("glTexSubImage2D");
+        for(i=0;i<int(planes.size());i++) {
+          glBindTexture(GL_TEXTURE_2D, stream.texs[i]);
+          glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes[i].w, planes[i].h, planes[i].format, planes[i].type,
+                          data ? (GLvoid*)(data+planes[i].offset) : (GLvoid*)planes[i].offset);
+        }
+      }
+      glBindTexture(GL_TEXTURE_2D, 0); // unbind
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
+      
+      stream.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      stream.slot = (slot+1) % config.ring;
+      stream.metric_in_flight->add(1);
+      stream.metric_uploaded->add();
+      stream.metric_bytes->add(framesize);
+      frames++;
+    }
+    glFlush();
+    end = std::chrono::steady_clock::now();
   }
-  */
   
-  sleep_for(0.5s); // give it time to upload
+  for(k=0;k<config.streams;k++) { // drain
+    for(i=0;i<config.ring;i++) {
+      waitSlot(streams[k], (streams[k].slot+i) % config.ring);
+    }
+  }
+  end     = std::chrono::steady_clock::now();
+  seconds = std::chrono::duration<double>(end-start).count();
   
-  for(i=0;i<10;i++) {
-    start = std::chrono::system_clock::now();
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
-    glBindTexture(GL_TEXTURE_2D, tex); // this is the texture we will manipulate
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, byteformat, 0); // copy from pbo to texture 
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind
-    
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // unbind // important!
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind
-    
-    glFlush();
-    glFinish();
-    end = std::chrono::system_clock::now();
-    
-    dt = end-start;
-    std::cout << "pbo => tex took " << dt.count()*1000 << " ms" << std::endl;
+  for(k=0;k<config.streams;k++) {
+    glDeleteTextures(streams[k].texs.size(), streams[k].texs.data());
+    if (!streams[k].pbos.empty()) {
+      glDeleteBuffers(streams[k].pbos.size(), streams[k].pbos.data());
+    }
+    if (streams[k].generator) {
+      delete streams[k].generator;
+      pool.release(streams[k].frame);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (reader) {
+    delete reader;
   }
-    
-  ctx.renderYUVBlockShader(win, shader, tex);
   
-  sleep_for(5s);
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) -> double {
+    if (latencies.empty()) {
+      return 0;
+    }
+    return latencies[std::min(latencies.size()-1, std::size_t(p*latencies.size()))];
+  };
   
+  result.w           = config.w;
+  result.h           = config.h;
+  result.format      = config.format;
+  result.frames      = frames;
+  result.seconds     = seconds;
+  result.fps         = frames/seconds;
+  result.mbps        = (double(framesize)*frames/1e6)/seconds;
+  result.latency_p50 = percentile(0.50);
+  result.latency_p95 = percentile(0.95);
+  result.latency_p99 = percentile(0.99);
+  result.latency_max = latencies.empty() ? 0 : latencies.back();
+  return result;
+}
+
+
+std::string jsonEscape(const std::string& str) {
+  std::string out;
+  char        hex[8];
+  for(unsigned char c : str) {
+    if (c=='"' || c=='\\') {
+      out += '\\';
+      out += c;
+    }
+    else if (c<0x20) {
+      snprintf(hex, sizeof(hex), "\\u%04x", c);
+      out += hex;
+    }
+    else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+
+void printResult(std::ostream& out, const RunConfig& config, const RunResult& result, bool header) {
+  if (config.output=="csv") {
+    if (header) {
+      out << "strategy,width,height,format,streams,threads,ring,source,frames,seconds,fps,mbps,latency_p50_ms,latency_p95_ms,latency_p99_ms,latency_max_ms" << std::endl;
+    }
+    out << config.strategy << "," << result.w << "," << result.h << "," << pixelFormatName(result.format) << "," << config.streams << ","
+              << config.threads << "," << config.ring << "," << config.source << "," << result.frames << "," << result.seconds << ","
+              << result.fps << "," << result.mbps << "," << result.latency_p50 << "," << result.latency_p95 << "," << result.latency_p99 << ","
+              << result.latency_max << std::endl;
+  }
+  else if (config.output=="json") {
+    out << "{\"strategy\": \"" << config.strategy << "\", \"width\": " << result.w << ", \"height\": " << result.h
+              << ", \"format\": \"" << pixelFormatName(result.format) << "\", \"streams\": " << config.streams << ", \"threads\": " << config.threads
+              << ", \"ring\": " << config.ring << ", \"source\": \"" << jsonEscape(config.source) << "\", \"frames\": " << result.frames
+              << ", \"seconds\": " << result.seconds << ", \"fps\": " << result.fps << ", \"mbps\": " << result.mbps
+              << ", \"latency_ms\": {\"p50\": " << result.latency_p50 << ", \"p95\": " << result.latency_p95 << ", \"p99\": " << result.latency_p99
+              << ", \"max\": " << result.latency_max << "}}" << std::endl;
+  }
+  else if (config.output=="table") {
+    if (header) {
+      printf("%-8s %11s %-11s %7s %7s %4s %10s %10s %9s %9s %9s %9s\n", "strategy", "size", "format", "streams", "threads", "ring",
+             "fps", "MB/s", "p50 ms", "p95 ms", "p99 ms", "max ms");
+    }
+    printf("%-8s %5dx%-5d %-11s %7d %7d %4d %10.1f %10.1f %9.2f %9.2f %9.2f %9.2f\n", config.strategy.c_str(), result.w, result.h,
+           pixelFormatName(result.format), config.streams, config.threads, config.ring, result.fps, result.mbps,
+           result.latency_p50, result.latency_p95, result.latency_p99, result.latency_max);
+    fflush(stdout);
+  }
+  else {
+    out << config.strategy << " " << result.w << "x" << result.h << " " << pixelFormatName(result.format) << " streams " << config.streams
+              << " threads " << config.threads << " ring " << config.ring << " : " << result.frames << " frames in " << result.seconds << " s, "
+              << result.fps << " fps, " << result.mbps << " MB/s, latency p50 " << result.latency_p50 << " p95 " << result.latency_p95
+              << " p99 " << result.latency_p99 << " max " << result.latency_max << " ms" << std::endl;
+  }
+}
+
+
+int runMain(int argc, char** argcv) {
+  RunConfig config;
+  RunSweep  sweep;
+  RunResult result;
+  bool      header = true;
+  
+  if (!parseRunConfig(argc, argcv, config, sweep)) {
+    return 2;
+  }
+  // stdout carries the result rows only : the chatter of the gl, io & metrics classes goes to stderr
+  std::ostream results(std::cout.rdbuf());
+  std::cout.rdbuf(std::cerr.rdbuf());
+  std::vector<RunConfig> configs = expandSweep(config, sweep);
+  if (!config.trace.empty()) {
+#ifdef NO_TRACE
+    std::cerr << "runMain : built with NO_TRACE, the trace will be empty" << std::endl;
+#endif
+    TRACE_THREAD_NAME("main");
+    Tracer::get().start();
+  }
+  std::unique_ptr<MetricsExporter> exporter;
+  if (config.metrics.compare(0, 5, "unix:")==0) {
+    exporter.reset(new MetricsExporter("", config.metrics.substr(5)));
+  }
+  else if (!config.metrics.empty()) {
+    exporter.reset(new MetricsExporter(config.metrics, ""));
+  }
+  for(RunConfig& cell : configs) {
+    if (configs.size()>1 && cell.output=="text") { // a sweep : one row per cell
+      cell.output = "table";
+    }
+    result = runBenchmark(cell);
+    printResult(results, cell, result, header);
+    header = false;
+  }
+  if (!config.trace.empty()) {
+    Tracer::get().stop();
+    if (Tracer::get().getDropped()>0) {
+      std::cerr << "runMain : trace rings overflowed, " << Tracer::get().getDropped() << " oldest events dropped" << std::endl;
+    }
+    Tracer::get().write(config.trace.c_str());
+  }
+  exporter.reset(); // its thread logs too
+  std::cout.rdbuf(results.rdbuf());
+  return 0;
 }
 
 
 
 int main(int argc, char** argcv) {
   if (argc<2) {
-    std::cout << argcv[0] << " needs an integer argument " << std::endl;
+    std::cout << argcv[0] << " needs an integer argument (a test) or options (see --help)" << std::endl;
     exit(2);
   }
+  if (argcv[1][0]=='-') { // benchmark driver
+    return runMain(argc, argcv);
+  }
   switch (atoi(argcv[1])) { // choose test
     case(1):
       test_1();
@@ -1430,13 +9725,70 @@ int main(int argc, char** argcv) {
       test_3();
       break;
     case(4):
-      test_4();
+      test_4(argc>2 ? argcv[2] : "1.yuv");
       break;
     case(5):
-      test_5();
+      test_5(argc>2 ? argcv[2] : "1.yuv");
       break;
     case(6):
-      // test_6();
+      test_6();
+      break; 
+    case(7):
+      test_7();
+      break; 
+    case(8):
+      test_8();
+      break; 
+    case(9):
+      test_9();
+      break; 
+    case(10):
+      test_10();
+      break; 
+    case(11):
+      test_11();
+      break; 
+    case(12):
+      test_12();
+      break; 
+    case(13):
+      test_13();
+      break; 
+    case(14):
+      test_14(argc>2 ? argcv[2] : "1.yuv");
+      break; 
+    case(15):
+      test_15();
+      break; 
+    case(16):
+      test_16();
+      break; 
+    case(17):
+      test_17();
+      break; 
+    case(18):
+      test_18();
+      break; 
+    case(19):
+      test_19();
+      break; 
+    case(20):
+      test_20();
+      break; 
+    case(21):
+      test_21();
+      break; 
+    case(22):
+      test_22();
+      break; 
+    case(23):
+      test_23();
+      break; 
+    case(24):
+      test_24();
+      break; 
+    case(25):
+      // test_25();
       break; 
     default:
       std::cout << "No such test "<<argcv[1]<<" for "<<argcv[0]<<std::endl;